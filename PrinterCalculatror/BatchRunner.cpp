@@ -0,0 +1,149 @@
+#include "stdafx.h"
+#include "BatchRunner.h"
+#include "ReportWriter.h"
+#include "WorkerThreads.h"
+#include <algorithm>
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// Returns whether the name ends with ".csv", whatever the case
+static bool IsCsvFileName(const std::string& strName)
+{
+	if (strName.size() < 4)
+		return false;
+	std::string strExtension = strName.substr(strName.size() - 4);
+	std::transform(strExtension.begin(), strExtension.end(), strExtension.begin(), ::tolower);
+	return strExtension == ".csv";
+}
+
+static bool IsDirectory(const std::string& strPath)
+{
+#ifdef _WIN32
+	struct _stat info;
+	return _stat(strPath.c_str(), &info) == 0 && (info.st_mode & _S_IFDIR) != 0;
+#else
+	struct stat info;
+	return stat(strPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// Adds the .csv files of a directory, sorted by name
+static bool ListCsvFiles(const std::string& strDirectory, std::vector<std::string>& vstrFiles)
+{
+	std::vector<std::string> vstrNames;
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = ::FindFirstFileA((strDirectory + "\\*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && IsCsvFileName(findData.cFileName))
+			vstrNames.push_back(findData.cFileName);
+	} while (::FindNextFileA(hFind, &findData));
+	::FindClose(hFind);
+	const char* szSeparator = "\\";
+#else
+	DIR* pDir = opendir(strDirectory.c_str());
+	if (pDir == NULL)
+		return false;
+	for (dirent* pEntry = readdir(pDir); pEntry != NULL; pEntry = readdir(pDir))
+	{
+		if (IsCsvFileName(pEntry->d_name) && !IsDirectory(strDirectory + "/" + pEntry->d_name))
+			vstrNames.push_back(pEntry->d_name);
+	}
+	closedir(pDir);
+	const char* szSeparator = "/";
+#endif
+
+	std::sort(vstrNames.begin(), vstrNames.end());
+	for (size_t i = 0; i < vstrNames.size(); i++)
+		vstrFiles.push_back(strDirectory + szSeparator + vstrNames[i]);
+	return true;
+}
+
+bool CollectBatchFiles(const std::vector<std::string>& vstrArgs, std::vector<std::string>& vstrFiles, std::string& strError)
+{
+	for (size_t i = 0; i < vstrArgs.size(); i++)
+	{
+		const std::string& strArg = vstrArgs[i];
+		if (!strArg.empty() && strArg[0] == '@')
+		{
+			std::ifstream listFile(strArg.substr(1).c_str());
+			if (!listFile.is_open())
+			{
+				strError = "Meet error when loading the file list: " + strArg.substr(1);
+				return false;
+			}
+			std::string strLine;
+			while (std::getline(listFile, strLine))
+			{
+				if (!strLine.empty() && strLine[strLine.size() - 1] == '\r')
+					strLine.erase(strLine.size() - 1);
+				if (!strLine.empty())
+					vstrFiles.push_back(strLine);
+			}
+		}
+		else if (IsDirectory(strArg))
+		{
+			if (!ListCsvFiles(strArg, vstrFiles))
+			{
+				strError = "Meet error when listing the directory: " + strArg;
+				return false;
+			}
+		}
+		else
+			vstrFiles.push_back(strArg);
+	}
+	return true;
+}
+
+// Prices one file without writing anything, keeping only the totals
+static void RunBatchFile(const PrintTariff& tariff, bool bContinueOnError, BatchFileResult& result)
+{
+	PrinterTask task(result.m_strFileName);
+	if (task.GetLoadError()[0] != '\0')
+	{
+		result.m_strError = task.GetLoadError();
+		return;
+	}
+	task.SetTariff(tariff);
+	task.SetReportWriter(std::make_unique<CReportWriter>(ReportMode::None));
+	task.SetContinueOnError(bContinueOnError);
+	task.SetRetainJobs(false);
+
+	result.m_bDone = task.DoCalculate();
+	if (!result.m_bDone)
+	{
+		std::vector<int> vnRows = task.GetExceptionLines();
+		if (vnRows.empty())
+			result.m_strError = "No print job column";
+		else
+			result.m_strError = "Row " + std::to_string(vnRows[0]) + " is not a print job: " + GetRowErrorText(task.GetRowError(vnRows[0]));
+		return;
+	}
+	result.m_fBlackAndWhite = task.GetTotalPriceForBlackAndWhite();
+	result.m_fColor = task.GetTotalPriceForColor();
+	result.m_nBlackAndWhiteMilliCents = task.GetTotalMilliCentsForBlackAndWhite();
+	result.m_nColorMilliCents = task.GetTotalMilliCentsForColor();
+}
+
+void RunBatch(const std::vector<std::string>& vstrFiles, const PrintTariff& tariff, bool bContinueOnError,
+	int nThreads, std::vector<BatchFileResult>& vResults)
+{
+	vResults.assign(vstrFiles.size(), BatchFileResult());
+	for (size_t i = 0; i < vstrFiles.size(); i++)
+		vResults[i].m_strFileName = vstrFiles[i];
+
+	RunWorkStealing(static_cast<int>(vResults.size()), nThreads, [&](int i)
+	{
+		RunBatchFile(tariff, bContinueOnError, vResults[i]);
+	});
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "PrintJob.h"
+
+// The totals of one file priced by RunBatch
+struct BatchFileResult
+{
+	BatchFileResult() : m_bDone(false), m_fBlackAndWhite(0), m_fColor(0), m_nBlackAndWhiteMilliCents(0), m_nColorMilliCents(0) {}
+
+	std::string m_strFileName;
+	bool m_bDone;                 // false if the file could not be priced
+	std::string m_strError;       // why, when m_bDone is false
+	float m_fBlackAndWhite;
+	float m_fColor;
+	int64_t m_nBlackAndWhiteMilliCents;
+	int64_t m_nColorMilliCents;
+};
+
+// Adds the print job files named by the arguments to vstrFiles: a file, every
+// .csv file of a directory in name order, or "@list" for the files listed one
+// per line in the file list.  Returns false with strError if one can not be read.
+bool CollectBatchFiles(const std::vector<std::string>& vstrArgs, std::vector<std::string>& vstrFiles, std::string& strError);
+
+// Prices every file with its own PrinterTask on nThreads threads and returns
+// the results in the order of the files.  The files are handed out by
+// RunWorkStealing, so a few huge files do not hold up the small ones.
+void RunBatch(const std::vector<std::string>& vstrFiles, const PrintTariff& tariff, bool bContinueOnError,
+	int nThreads, std::vector<BatchFileResult>& vResults);
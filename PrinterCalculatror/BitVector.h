@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Returns whether bit i is set in an array of 32-bit words.
+inline bool IsBitSet(const uint32_t* pWords, int i)
+{
+	return (pWords[i >> 5] >> (i & 31)) & 1;
+}
+
+// A growable array of bits packed 32 to a word.
+class CBitVector
+{
+public:
+	CBitVector() : m_nSize(0) {}
+
+	void PushBack(bool bValue)
+	{
+		if ((m_nSize & 31) == 0)
+			m_vnWords.push_back(0);
+		if (bValue)
+			m_vnWords.back() |= 1u << (m_nSize & 31);
+		m_nSize++;
+	}
+
+	bool Get(int i) const { return IsBitSet(&m_vnWords[0], i); }
+
+	void Set(int i, bool bValue)
+	{
+		if (bValue)
+			m_vnWords[i >> 5] |= 1u << (i & 31);
+		else
+			m_vnWords[i >> 5] &= ~(1u << (i & 31));
+	}
+
+	// Resizes to nSize bits, new bits are cleared.
+	void Resize(int nSize)
+	{
+		m_vnWords.resize((nSize + 31) >> 5, 0);
+		if (nSize < m_nSize && (nSize & 31) != 0)
+			m_vnWords.back() &= (1u << (nSize & 31)) - 1;
+		m_nSize = nSize;
+	}
+
+	// Appends the bits of another vector.
+	void Append(const CBitVector& other)
+	{
+		int nShift = m_nSize & 31;
+		int nOldSize = m_nSize;
+		Resize(m_nSize + other.m_nSize);
+		for (size_t i = 0; i < other.m_vnWords.size(); i++)
+		{
+			size_t iWord = (nOldSize >> 5) + i;
+			m_vnWords[iWord] |= other.m_vnWords[i] << nShift;
+			if (nShift != 0 && iWord + 1 < m_vnWords.size())
+				m_vnWords[iWord + 1] |= other.m_vnWords[i] >> (32 - nShift);
+		}
+	}
+
+	// Removes all bits but keeps the allocated words.
+	void Clear()
+	{
+		m_vnWords.clear();
+		m_nSize = 0;
+	}
+
+	int Size() const { return m_nSize; }
+
+	const uint32_t* GetWords() const { return m_vnWords.empty() ? NULL : &m_vnWords[0]; }
+
+private:
+	std::vector<uint32_t> m_vnWords;
+	int m_nSize;
+};
@@ -1,571 +1,1457 @@
-#include "CsvDataFile.h"
-#include <fstream>
-#include <algorithm>
-#include <atlstr.h>
-#include <cstring>
-#include <cctype>
-
-using namespace std;
-using std::find_if;
-using std::for_each;
-using std::ifstream;
-using std::istream;
-using std::ostream;
-using std::string;
-using std::vector;
-
-// defines value to be used
-const char* DEFAULT_DELIMITER = ",";
-const char* TRUE_VALUE = "true";
-const char* FALSE_VALUE = "false";
-static const int   MAX_FIELD_BUFFER = 1024;
-// error code table for error reporting
-const char* ERROR_REASON[] =
-{
-	"ERROR 0000: UNKNOWN ERROR",
-	"ERROR 0001: An unknown error occurred in GetString()!",
-	"ERROR 0002: An unknown error occurred in GetData()!",
-	"ERROR 0003: GetString() was called while the content is wrong.",
-	"ERROR 0004: The field is not a valid data type."
-	"ERROR 0005: Variable name not found!",
-	"ERROR 0006: Filename name not found!",
-	"ERROR 0007: File not found!",
-	"ERROR 0008: The Number of Headers is different than the Number of Data Columns!",
-};
-
-// local functions and function objects
-
-// Counts the number of columns in an istream denoted by delim.
-static int CountCols(istream& is, const char& delim)
-{
-	int nCols = 1;
-	int iChar;
-	do
-	{
-		if (is.peek() == delim)
-			nCols++;
-		iChar = is.get();
-	} while (iChar != '\n' && iChar != '\r' && iChar != -1);
-
-	return nCols;
-}
-
-// trim the space in the begin and end
-static void trimSpace(string& strValue)
-{
-	strValue.erase(strValue.begin(), std::find_if(strValue.begin(), strValue.end(), [](int ch) {
-		return !std::isspace(ch);
-	}));
-
-	strValue.erase(std::find_if(strValue.rbegin(), strValue.rend(), [](int ch) {
-		return !std::isspace(ch);
-	}).base(), strValue.end());
-}
-
-// A function object designed to be used as a predicate
-// for remove_if(). Returns true if names match, false if 
-// they don't.
-class CompareByName :
-	public std::unary_function<std::string, bool>
-{
-public:
-	CompareByName(const char* szName) : m_szName(szName) {}
-
-	bool operator()(const std::string& szVarName) const
-	{
-		string compareString = szVarName;
-		string sourceString = m_szName;
-		trimSpace(compareString);
-		trimSpace(sourceString);
-		return (_stricmp(compareString.c_str(), sourceString.c_str()) == 0);
-	}
-
-private:
-	std::string m_szName;
-};
-
-// end local stuff
-
-// Default constructor
-//Do not use it, it is for test purpose
-CCsvDataFile::CCsvDataFile()
-{
-	m_delim = DEFAULT_DELIMITER;
-}
-
-// Misc. constructor.  Instantiates an instance of CDataFile and reads the
-// specified file.
-CCsvDataFile::CCsvDataFile(const char* szFilename)
-{
-	m_delim = DEFAULT_DELIMITER;
-	m_szError = "";
-
-	this->ReadFile(szFilename);
-}
-
-// Copy constructor.  Instantiates an instance of CDataFile with the
-// contents of another CDataFile.
-CCsvDataFile::CCsvDataFile(const CCsvDataFile& df)
-{
-	*this = df;
-}
-
-// destructor
-CCsvDataFile::~CCsvDataFile(void)
-{
-	this->ClearData();
-}
-
-// Reads the specified file.
-// Returns true if successful, false if an error occurred.
-bool CCsvDataFile::ReadFile(const char* szFilename)
-{
-	try
-	{
-		m_szFilename = szFilename;
-
-		ifstream inFile;
-		inFile.open(szFilename, ifstream::binary | ifstream::in);
-
-		if (inFile.rdstate() & std::ios::failbit)
-		{
-			inFile.close();
-			m_szError = ERROR_REASON[7];
-			m_szError += "\nDetails: ";
-			m_szError += szFilename;
-			return false;
-		}
-
-		ReadFromStream(inFile, *this);
-
-		inFile.close();
-		return true;
-	}
-
-	catch (const exception& e)
-	{
-		m_szError = e.what();
-	}
-
-	catch (...)
-	{
-		m_szError = ERROR_REASON[0];
-	}
-
-	return false;
-}
-
-// reads the data from the stream and returns the stream when done.
-istream& CCsvDataFile::ReadFromStream(istream& inFile, CCsvDataFile& df)
-{
-	try
-	{
-		df.ClearData();
-
-		// Check header
-		streampos posData = 0;
-
-		// count the number of variables
-		int nVars = CountCols(inFile, df.m_delim.at(0));
-
-		inFile.seekg(posData);
-
-		int iVar = 0;
-		int varOffset = df.GetNumberOfVariables();
-		int nVarInfo = -1;
-
-		char buff[MAX_FIELD_BUFFER] = { 0 };
-
-		for (iVar = 0; iVar<nVars; iVar++)
-		{
-			//			inFile.getline(buff, sizeof buff, (iVar == nVars-1) ? '\n' : df.m_delim.at(0));	
-			// Changed previous line to the following to correctly support CSV format
-			bool bEndOfLine = false;
-			ReadCSVstring(inFile, buff, sizeof(buff), (iVar == nVars - 1) ? '\n' : df.m_delim.at(0), bEndOfLine);
-			df.m_vstrVariableNames.push_back(buff);
-			df.m_vstrSourceFilenames.push_back(df.m_szFilename);
-			df.m_v2dStrData.push_back(vector<string>());			
-		}
-
-		do
-		{
-			string strMsg;
-			bool bEndOfLine = false;
-
-			for (iVar = 0; iVar<nVars; iVar++)
-			{
-				//				inFile.getline(buff, sizeof(buff), (iVar == nVars-1) ? '\n' : df.m_delim.at(0));	
-				// Changed previous line to the following to correctly support CSV format
-				if (!bEndOfLine)
-				{
-					int iRead = ReadCSVstring(inFile, buff, sizeof(buff), (iVar == nVars - 1) ? '\n' : df.m_delim.at(0), bEndOfLine);
-
-					if (iVar != nVars - 1 && (iRead == 0 || bEndOfLine))
-						strMsg = "Line terminated without enough delimiter";
-
-					//we haven't read anything in this line. So, skip it.
-					if (iRead == 0)
-						break;
-				}
-				else
-					buff[0] = '\0';
-
-				// make sure we didn't pick up extra junk @ eof.
-				if (/*!inFile.eof() &&*/ buff[0] != '\n' && buff[0] != '\r')
-					df.m_v2dStrData.at(iVar + varOffset).push_back(buff);
-			}
-
-			if (!bEndOfLine)
-			{
-				ReadCSVstring(inFile, buff, sizeof(buff), '\n', bEndOfLine);
-				if (strlen(buff) > 0)
-					strMsg = "Line contains too many delimiter and data";
-			}
-
-			if (nVarInfo != -1)
-				df.m_v2dStrData.at(nVarInfo).push_back(strMsg);
-
-		} while (!inFile.eof());
-
-		if (df.m_vstrVariableNames.back().find("\n") != -1)
-			df.m_vstrVariableNames.back().resize(df.m_vstrVariableNames.back().length() - 1);
-
-		if (df.m_vstrVariableNames.back().find("\r") != -1)
-			df.m_vstrVariableNames.back().resize(df.m_vstrVariableNames.back().length() - 1);
-	}
-
-	catch (const exception& e)
-	{
-		df.m_szError = e.what();
-		throw e;
-	}
-
-	catch (...)
-	{
-		df.m_szError = ERROR_REASON[0];
-		throw exception(df.m_szError.c_str());
-	}
-
-	return inFile;
-}
-
-int CCsvDataFile::GetVariableName(const int& iVariable, std::string& rStr)
-{
-	try
-	{
-		rStr = m_vstrVariableNames.at(iVariable).c_str();
-		return static_cast<int>(rStr.length());
-	}
-
-	catch (const exception& e) { m_szError = e.what(); }
-	catch (...) { m_szError = ERROR_REASON[1]; }
-	return -1;
-}
-
-// Clears all data in the CDataFile
-void CCsvDataFile::ClearData()
-{
-	m_szError = "";
-	std::vector<std::string>().swap(m_vstrVariableNames);
-	std::vector<std::string>().swap(m_vstrSourceFilenames);
-	std::vector<std::vector<std::string> >().swap(m_v2dStrData);
-}
-
-// Returns the length of the string if successful. 
-// Returns -1 if an error is encountered.
-int CCsvDataFile::GetData(const int& iVariable, const int& iSample, std::string& rStr)
-{
-	try
-	{
-		rStr = m_v2dStrData.at(iVariable).at(iSample).c_str();
-		return static_cast<int>(rStr.length());
-	}
-
-	catch (const exception& e)
-	{
-		m_szError = e.what();
-		return -1;
-	}
-
-	catch (...)
-	{
-		m_szError = ERROR_REASON[1];
-		return -1;
-	}
-}
-
-// Returns the length of the string if successful. 
-// Returns -1 if an error is encountered.
-int CCsvDataFile::GetData(const char* szVariableName, const int& iSample, std::string& rStr)
-{
-	int retVal = 0;
-
-	int index = LookupVariableIndex(szVariableName);
-
-	if (index != -1)
-		retVal = GetData(index, iSample, rStr);
-
-	else
-	{
-		m_szError = ERROR_REASON[5];
-		retVal = -1;
-	}
-
-	return retVal;
-}
-
-// Returns whether get a valid int value from the field
-bool CCsvDataFile::GetData(const char* szVariableName, const int& iSample, int& iValue)
-{
-	// Set default to be zero
-	iValue = 0;
-	std::string rStr;
-	int nLengthStr = GetData(szVariableName, iSample, rStr);
-
-	if (nLengthStr > 0)
-	{
-		char *numberValidCheck;
-		iValue = std::strtol(rStr.c_str(), &numberValidCheck, 10);
-
-		if (*numberValidCheck == '\0')
-			return true;
-	}
-	// If empty string was found in the field, default to be 0
-	else if (nLengthStr == 0)
-		return true;
-
-	m_szError = ERROR_REASON[4];
-	return false;
-}
-
-// Returns whether get a bool value from the field
-bool CCsvDataFile::GetData(const char* szVariableName, const int& iSample, bool& bValue)
-{
-	std::string rStr;
-	int nLengthStr = GetData(szVariableName, iSample, rStr);
-
-	if (nLengthStr > 0)
-	{
-		trimSpace(rStr);
-		if (_stricmp(rStr.c_str(), TRUE_VALUE) == 0)
-			bValue = true;
-		else if (_stricmp(rStr.c_str(), FALSE_VALUE) == 0)
-			bValue = false;
-		else
-		{
-			m_szError = ERROR_REASON[4];
-			return false;
-		}
-	}
-	// If empty string was found in the field, default to be 0
-	else if (nLengthStr == 0)
-		return false;
-
-	m_szError = ERROR_REASON[3];
-	return true;
-}
-
-// Returns the index of the first variable name that matches szName.
-// Returns -1 if szName is not found.
-int CCsvDataFile::LookupVariableIndex(const char* szName, const int& offset /*=0*/) const
-{
-	int retVal = 0;
-
-	std::vector<std::string>::const_iterator it =
-		find_if
-		(
-		m_vstrVariableNames.begin() + offset,
-		m_vstrVariableNames.end(),
-		CompareByName(szName)
-		);
-
-	if (it == m_vstrVariableNames.end())
-		retVal = -1;
-
-	else
-	{
-		while (it != m_vstrVariableNames.begin())
-		{
-			retVal++;
-			it--;
-		}
-	}
-
-	return retVal;
-}
-
-//********************************************************
-// Function:    ReadCSVstring
-// Description: Reads an string from an input stream conform CSV specification
-//********************************************************
-int CCsvDataFile::ReadCSVstring(std::istream& inFile, // input stream to pass
-	char* buff,      // buffer to return the value
-	int size,        // maximum buffersize passsed
-	char delimiter  // what delimiter to be used
-	)
-{
-	bool bEndOfLine;
-
-	return ReadCSVstring(inFile, buff, size, delimiter, bEndOfLine);
-}
-
-int CCsvDataFile::ReadCSVstring(std::istream& inFile, // input stream to pass
-	char* buff,      // buffer to return the value
-	int size,        // maximum buffersize passsed
-	char delimiter,  // what delimiter to be used
-	bool& bEndOfLine // return if hit end of line
-	)
-{
-	bool quoted = false;     // Is this a quoted string?
-	bool backslash = false;  // Is there a backslash?
-	int bpos = 0;            // Position within the buffer
-	int cRead = 0;           // Characters read sofar from stream
-	char cc = 0;             // Current character
-	int pc;                 // Peek character
-
-	inFile.get(cc);
-	if (cc == 0 || inFile.eof())
-	{
-		bEndOfLine = true;
-		buff[bpos] = '\0';  // terminate string and return
-		return 0;       // Read one character and returned...
-	}
-
-	cRead++;
-
-	if (cc == '\\')        // Finding a backslash sign...
-		backslash = true;
-
-	if (cc == '"')         // Decide is a quoted string and ignore it...
-		quoted = true;
-
-	else if (cc == delimiter || cc == '\n' || cc == '\r')
-	{
-		bEndOfLine = (cc == '\n' || cc == '\r');
-		buff[bpos] = '\0';  // terminate string and return
-
-		//if we have CR and next is LF, we read the next char too
-		if (cc == '\r' && inFile.peek() == '\n')
-		{
-			inFile.get(cc);
-		}
-
-		return cRead;       // Read one character and returned...
-	}
-	else
-	{
-		buff[bpos] = cc;
-		bpos++;
-	}
-
-	if (inFile.peek() == std::istream::traits_type::eof())
-	{
-		bEndOfLine = true;
-		buff[bpos] = '\0';  // terminate string and return
-		return cRead;
-	}
-
-	while (!inFile.eof() && (bpos < size))
-	{
-		inFile.get(cc);     // read next character 
-
-		if (inFile.eof())
-			break;
-
-		pc = inFile.peek();
-
-		if ((backslash && cc == 'n') || (backslash && cc == 'r'))
-		{
-			// convert string '\n' to real new line. 
-			// as windows multiline editbox control does not make a new line for just '\n'
-			// we need CRLF here
-			buff[bpos - 1] = '\r';
-			buff[bpos] = '\n';
-			bpos++;
-			backslash = false;
-			continue;
-		}
-
-		backslash = (cc == '\\');
-
-		cRead++;
-		if (cc == '"' && quoted == true)      // either end of string or an escape quote
-		{
-			if (delimiter == '\n')
-			{
-				if (pc == '\n')
-				{
-					inFile.get(cc); // remove delimiter from the stream
-					cRead++;
-					break;
-				}
-				else if (pc == '\r')
-				{
-					inFile.get(cc); // remove delimiter from the stream
-					if (inFile.peek() == '\n')
-					{
-						inFile.get(cc);
-					}
-					cRead++;
-					break;
-				}
-				else if (pc == '"')
-				{
-					inFile.get(cc); // read the "
-					cRead++;
-				}
-
-			}
-			else
-			{
-				if (pc == delimiter)
-				{
-					inFile.get(cc); // remove delimiter from the stream
-					cRead++;
-					break;
-				}
-				else if (pc == '"')
-				{
-					inFile.get(cc); // read the "
-					cRead++;
-				}
-			}
-
-			//            else if (isspace(pc)) *** remove spaces after "???
-		}
-
-		if (delimiter == '\n')
-		{
-			if ((cc == '\n' || cc == '\r') && quoted == false)
-			{
-				if (cc == '\r' && inFile.peek() == '\n')
-				{
-					inFile.get(cc);
-				}
-
-				break;
-			}
-		}
-		else
-		{
-			if ((cc == delimiter || cc == '\n' || cc == '\r') && quoted == false)
-			{
-				if (cc == '\r' && inFile.peek() == '\n')
-				{
-					inFile.get(cc);
-				}
-				break;
-			}
-		}
-
-
-		buff[bpos] = cc;
-		bpos++;
-		cRead++;
-	}
-
-	bEndOfLine = (cc == '\n' || cc == '\r' || inFile.eof());
-	buff[bpos] = '\0';  // terminate string and return
-	inFile.peek();	// when reach file end, this operation will make inFile.eof return true;
-	return cRead;
+#include "CsvDataFile.h"
+#include "MappedFile.h"
+#include "CsvScanner.h"
+#include "CsvColumnCache.h"
+#include "DecompressInput.h"
+#include "CsvFieldConvert.h"
+#include "WorkerThreads.h"
+#include "PrinterStats.h"
+#include <fstream>
+#include <algorithm>
+#include <atlstr.h>
+#include <cstring>
+#include <cctype>
+
+using namespace std;
+using std::find_if;
+using std::for_each;
+using std::ifstream;
+using std::istream;
+using std::ostream;
+using std::string;
+using std::vector;
+
+// defines value to be used
+const char* DEFAULT_DELIMITER = ",";
+// smallest range of a mapped file handed to a parse thread
+static const int   MIN_PARSE_CHUNK_SIZE = 64 * 1024;
+// error code table for error reporting
+const char* ERROR_REASON[] =
+{
+	"ERROR 0000: UNKNOWN ERROR",
+	"ERROR 0001: An unknown error occurred in GetString()!",
+	"ERROR 0002: An unknown error occurred in GetData()!",
+	"ERROR 0003: GetString() was called while the content is wrong.",
+	"ERROR 0004: The field is not a valid data type.",
+	"ERROR 0005: Variable name not found!",
+	"ERROR 0006: Filename name not found!",
+	"ERROR 0007: File not found!",
+	"ERROR 0008: The Number of Headers is different than the Number of Data Columns!",
+	"ERROR 0009: Row or column index out of range!",
+	"ERROR 0010: The file is compressed in a format this build can not read.",
+	"ERROR 0011: The compressed file is damaged.",
+};
+
+// local functions and function objects
+
+// trim the space in the begin and end
+static void trimSpace(string& strValue)
+{
+	strValue.erase(strValue.begin(), std::find_if(strValue.begin(), strValue.end(), [](int ch) {
+		return !std::isspace(ch);
+	}));
+
+	strValue.erase(std::find_if(strValue.rbegin(), strValue.rend(), [](int ch) {
+		return !std::isspace(ch);
+	}).base(), strValue.end());
+}
+
+// Returns the key of a variable name in the header index: the name without
+// leading and trailing space, in lower case.  Two names have the same key
+// exactly when CompareByName considers them equal.
+static string NormalizeName(const char* szName)
+{
+	string strKey = szName;
+	trimSpace(strKey);
+	for (size_t i = 0; i < strKey.length(); i++)
+		strKey[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(strKey[i])));
+	return strKey;
+}
+
+// A function object designed to be used as a predicate
+// for remove_if(). Returns true if names match, false if 
+// they don't.
+class CompareByName :
+	public std::unary_function<std::string, bool>
+{
+public:
+	CompareByName(const char* szName) : m_szName(szName) {}
+
+	bool operator()(const std::string& szVarName) const
+	{
+		string compareString = szVarName;
+		string sourceString = m_szName;
+		trimSpace(compareString);
+		trimSpace(sourceString);
+		return (_stricmp(compareString.c_str(), sourceString.c_str()) == 0);
+	}
+
+private:
+	std::string m_szName;
+};
+
+// Reads a string conform CSV specification, defined with ReadCSVstring below.
+template <class TInput, class TOutput>
+static int ReadCSVfield(TInput& inFile, TOutput& output, char delimiter, bool& bEndOfLine);
+
+// Takes the place of the arena for the fields of a column which is not kept.
+// Nothing is copied, only the length and the first character of the field
+// are remembered, which is all a row needs to tell whether it is stored.
+class CCsvFieldSkipper
+{
+public:
+	CCsvFieldSkipper() : m_nLength(0), m_cFirst(0) {}
+
+	void Put(char cc)
+	{
+		if (m_nLength++ == 0)
+			m_cFirst = cc;
+	}
+
+	void SetLast(char cc)
+	{
+		if (m_nLength == 1)
+			m_cFirst = cc;
+	}
+
+	int GetFieldLength() const { return m_nLength; }
+	const char* GetFieldData() const { return &m_cFirst; }
+	void DiscardField() { m_nLength = 0; }
+
+private:
+	int m_nLength;
+	char m_cFirst;
+};
+
+// Returns whether a field read is stored: a field picking up the line end
+// is junk at the end of the file.
+static bool IsStoredField(const char* pField, int nLength)
+{
+	return nLength == 0 || (pField[0] != '\n' && pField[0] != '\r');
+}
+
+// Reads a mapped file like an istream, without copying it.
+class CCsvMemoryInput
+{
+public:
+	typedef std::istream::traits_type traits_type;
+
+	CCsvMemoryInput(const char* pBegin, const char* pEnd, char delimiter)
+		: m_pCur(pBegin), m_pEnd(pEnd), m_scanner(delimiter), m_bEof(false) {}
+
+	void get(char& cc)
+	{
+		if (m_pCur < m_pEnd)
+			cc = *m_pCur++;
+		else
+			m_bEof = true;
+	}
+
+	int peek()
+	{
+		if (m_pCur < m_pEnd)
+			return traits_type::to_int_type(*m_pCur);
+		m_bEof = true;
+		return traits_type::eof();
+	}
+
+	bool eof() const { return m_bEof; }
+
+	const char* m_pCur;
+	const char* m_pEnd;
+
+	// finds the end of the unquoted fields
+	CCsvScanner m_scanner;
+
+private:
+	bool m_bEof;
+};
+
+// Reads a field of a mapped file.  A field without leading quote or
+// backslash needs no unescaping, so it is returned as a view of the mapped
+// bytes.  Every other field is read by ReadCSVfield() into the output, the
+// arena or a CCsvFieldSkipper, and bCopied is set, the caller then ends or
+// discards the field of the output.
+// Returns the number of characters read like ReadCSVfield().
+template <class TOutput>
+static int ReadMappedField(CCsvMemoryInput& inFile, TOutput& output,
+	char delimiter, bool& bEndOfLine, CsvFieldView& field, bool& bCopied)
+{
+	const char* pStart = inFile.m_pCur;
+	const char* pEnd = inFile.m_pEnd;
+	bCopied = false;
+
+	if (pStart < pEnd && *pStart != '"' && *pStart != '\\' && *pStart != '\0')
+	{
+		// the last field of a line only ends at the line end
+		const char* p = inFile.m_scanner.FindFieldEnd(pStart, pEnd, delimiter != '\n');
+
+		if (p == pEnd || *p != '\\')
+		{
+			field.m_pData = pStart;
+			field.m_nLength = static_cast<int>(p - pStart);
+			// like ReadCSVfield, a delimiter ending the file also ends the line
+			// unless it is the first character of the field
+			bEndOfLine = (p == pEnd || *p == '\n' || *p == '\r' || (p > pStart && p + 1 == pEnd));
+
+			if (p < pEnd)
+			{
+				//if we have CR and next is LF, we read the next char too
+				if (*p == '\r' && p + 1 < pEnd && p[1] == '\n')
+					p++;
+				p++;
+			}
+			inFile.m_pCur = p;
+			inFile.peek();	// sets eof at the end of the file like ReadCSVfield
+			return static_cast<int>(p - pStart);
+		}
+	}
+
+	bCopied = true;
+	int iRead = ReadCSVfield(inFile, output, delimiter, bEndOfLine);
+	field.m_pData = output.GetFieldData();
+	field.m_nLength = output.GetFieldLength();
+	return iRead;
+}
+
+// Rows of a mapped file parsed by one thread: from m_pBegin up to the first
+// row starting at or after m_pEnd.
+class CCsvMappedChunk
+{
+public:
+	CCsvMappedChunk() : m_pBegin(NULL), m_pEnd(NULL), m_pStop(NULL), m_nRows(0) {}
+
+	const char* m_pBegin;
+	const char* m_pEnd;
+	const char* m_pStop;	// where the next row starts once parsed
+	int m_nRows;
+
+	std::vector<std::vector<CsvFieldView> > m_v2dFieldData;
+	std::vector<CCsvTypedColumn> m_vTypedColumns;
+	std::shared_ptr<CCsvArena> m_ptrArena;	// the fields which had quotes or escapes removed
+};
+
+// Returns the position after the first '\n' at or after p which is not
+// inside quotes, bInQuotes telling whether p is.  Returns pEnd if none.
+static const char* FindRowStart(const char* p, const char* pEnd, bool bInQuotes)
+{
+	for (; p < pEnd; p++)
+	{
+		if (*p == '"')
+			bInQuotes = !bInQuotes;
+		else if (*p == '\n' && !bInQuotes)
+			return p + 1;
+	}
+	return pEnd;
+}
+
+// end local stuff
+
+// Default constructor
+//Do not use it, it is for test purpose
+CCsvDataFile::CCsvDataFile()
+{
+	m_delim = DEFAULT_DELIMITER;
+	m_nFirstSampleRow = 0;
+	m_nParseThreads = 1;
+	m_nRows = 0;
+	m_nCachedRows = 0;
+	m_bUseCache = false;
+}
+
+// Misc. constructor.  Instantiates an instance of CDataFile and reads the
+// specified file.
+CCsvDataFile::CCsvDataFile(const char* szFilename)
+{
+	m_delim = DEFAULT_DELIMITER;
+	m_szError = "";
+	m_nFirstSampleRow = 0;
+	m_nParseThreads = 1;
+	m_nRows = 0;
+	m_nCachedRows = 0;
+	m_bUseCache = false;
+
+	this->ReadFile(szFilename);
+}
+
+// Reads the specified file, converting the typed columns while loading.
+CCsvDataFile::CCsvDataFile(const char* szFilename, const CsvReadOptions& options)
+{
+	m_delim = DEFAULT_DELIMITER;
+	m_szError = "";
+	m_nFirstSampleRow = 0;
+	m_nParseThreads = options.m_nParseThreads;
+	m_nRows = 0;
+	m_nCachedRows = 0;
+	m_bUseCache = options.m_bUseCache;
+	m_vstrProjectedColumns = options.m_vstrProjectedColumns;
+
+	for (size_t i = 0; i < options.m_vTypedColumns.size(); i++)
+		m_vTypedColumns.push_back(CCsvTypedColumn(options.m_vTypedColumns[i]));
+
+	this->ReadFile(szFilename);
+}
+
+// Copy constructor.  Instantiates an instance of CDataFile with the
+// contents of another CDataFile.
+CCsvDataFile::CCsvDataFile(const CCsvDataFile& df)
+{
+	*this = df;
+}
+
+// destructor
+CCsvDataFile::~CCsvDataFile(void)
+{
+	this->ClearData();
+}
+
+// Reads the specified file.
+// Returns true if successful, false if an error occurred.
+bool CCsvDataFile::ReadFile(const char* szFilename)
+{
+	try
+	{
+		m_szFilename = szFilename;
+
+		if (m_bUseCache && ReadColumnCache(szFilename))
+			return true;
+
+		CompressionFormat eCompression = DetectCompression(szFilename);
+		if (eCompression != CompressionFormat::None)
+			return ReadCompressedFile(szFilename, eCompression);
+
+		// Map the file and index it in place, stream it if it can't be mapped
+		if (ReadMappedFile(szFilename))
+		{
+			if (m_bUseCache)
+				UpdateColumnCache(szFilename);
+			return true;
+		}
+
+		ifstream inFile;
+		{
+			PRINTER_STATS_SCOPE(FileRead);
+			inFile.open(szFilename, ifstream::binary | ifstream::in);
+		}
+
+		if (inFile.rdstate() & std::ios::failbit)
+		{
+			inFile.close();
+			m_szError = ERROR_REASON[7];
+			m_szError += "\nDetails: ";
+			m_szError += szFilename;
+			return false;
+		}
+
+		ReadFromStream(inFile, *this);
+
+		inFile.close();
+		return true;
+	}
+
+	catch (const exception& e)
+	{
+		m_szError = e.what();
+	}
+
+	catch (...)
+	{
+		m_szError = ERROR_REASON[0];
+	}
+
+	return false;
+}
+
+// Parses the decompressed bytes as a stream while a thread decompresses
+// the next block.
+bool CCsvDataFile::ReadCompressedFile(const char* szFilename, CompressionFormat eCompression)
+{
+	if (!IsCompressionSupported(eCompression))
+	{
+		m_szError = ERROR_REASON[10];
+		m_szError += "\nDetails: ";
+		m_szError += szFilename;
+		return false;
+	}
+
+	CDecompressStreamBuf decompressBuf;
+	if (!decompressBuf.Open(szFilename, eCompression))
+	{
+		m_szError = ERROR_REASON[7];
+		m_szError += "\nDetails: ";
+		m_szError += szFilename;
+		return false;
+	}
+
+	istream inFile(&decompressBuf);
+	ReadFromStream(inFile, *this);
+
+	std::string strError = decompressBuf.GetError();
+	if (!strError.empty())
+	{
+		ClearData();
+		m_szError = ERROR_REASON[11];
+		m_szError += "\nDetails: ";
+		m_szError += strError;
+		return false;
+	}
+
+	if (m_bUseCache)
+		UpdateColumnCache(szFilename);
+	return true;
+}
+
+// reads the data from the stream and returns the stream when done.
+istream& CCsvDataFile::ReadFromStream(istream& inFile, CCsvDataFile& df)
+{
+	try
+	{
+		PRINTER_STATS_SCOPE(Parse);
+		df.ClearData();
+
+		df.ReadHeader(inFile);
+
+		CCsvArena& arena = df.ResetStreamArena();
+		do
+		{
+			df.ReadRecord(inFile, arena);
+		} while (!inFile.eof());
+	}
+
+	catch (const exception& e)
+	{
+		df.m_szError = e.what();
+		throw e;
+	}
+
+	catch (...)
+	{
+		df.m_szError = ERROR_REASON[0];
+		throw exception(df.m_szError.c_str());
+	}
+
+	return inFile;
+}
+
+// Starts reading a stream in batches.  Only the header is read here.
+bool CCsvDataFile::BeginStream(istream& inFile, int nFirstSampleRow)
+{
+	try
+	{
+		ClearData();
+		m_nFirstSampleRow = nFirstSampleRow;
+
+		return ReadHeader(inFile) > 0;
+	}
+
+	catch (const exception& e) { m_szError = e.what(); }
+	catch (...) { m_szError = ERROR_REASON[0]; }
+	return false;
+}
+
+// Reads the next batch of rows, replacing the rows of the previous batch.
+int CCsvDataFile::ReadNextBatch(istream& inFile, const int& nMaxRows)
+{
+	return ReadBatch(inFile, nMaxRows, m_nFirstSampleRow + m_nRows);
+}
+
+int CCsvDataFile::ReadBatch(istream& inFile, const int& nMaxRows, int nFirstSampleRow)
+{
+	try
+	{
+		PRINTER_STATS_SCOPE(Parse);
+		m_nFirstSampleRow = nFirstSampleRow;
+		m_nRows = 0;
+
+		// clear() keeps the capacity, so the columns are not reallocated per batch
+		// and the arena refills the slab of the previous batch
+		for (size_t iVar = 0; iVar < m_v2dFieldData.size(); iVar++)
+			m_v2dFieldData[iVar].clear();
+		for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+			m_vTypedColumns[i].Clear();
+
+		CCsvArena& arena = ResetStreamArena();
+		int nRows = 0;
+
+		while (nRows < nMaxRows && !inFile.eof())
+		{
+			if (ReadRecord(inFile, arena))
+				nRows++;
+		}
+
+		return nRows;
+	}
+
+	catch (const exception& e) { m_szError = e.what(); }
+	catch (...) { m_szError = ERROR_REASON[0]; }
+	return -1;
+}
+
+// Empties the arena of the rows read from a stream.  An arena still shared
+// with a copy of this file is left to the copy.
+CCsvArena& CCsvDataFile::ResetStreamArena()
+{
+	if (m_vptrArenas.size() == 1 && m_vptrArenas[0].unique())
+		m_vptrArenas[0]->Reset();
+	else
+		m_vptrArenas.assign(1, std::make_shared<CCsvArena>());
+	return *m_vptrArenas[0];
+}
+
+// Maps the specified file and stores the position of every field instead of
+// a copy of it.  Returns false if the file can't be mapped.
+bool CCsvDataFile::ReadMappedFile(const char* szFilename)
+{
+	std::shared_ptr<CMappedFile> ptrMappedFile = std::make_shared<CMappedFile>();
+	{
+		PRINTER_STATS_SCOPE(FileRead);
+		if (!ptrMappedFile->Open(szFilename))
+			return false;
+	}
+
+	ClearData();
+	m_szFilename = szFilename;
+	m_ptrMappedFile = ptrMappedFile;
+
+	CCsvMemoryInput inFile(m_ptrMappedFile->GetData(), m_ptrMappedFile->GetData() + m_ptrMappedFile->GetSize(), m_delim.at(0));
+
+	ReadHeader(inFile);
+
+	vector<CCsvMappedChunk> vChunks;
+	SplitMappedChunks(inFile.m_pCur, inFile.m_pEnd, vChunks);
+
+	RunParallel(static_cast<int>(vChunks.size()), m_nParseThreads, [&](int iChunk)
+	{
+		ParseMappedChunk(vChunks[iChunk]);
+	});
+
+	JoinMappedChunks(vChunks);
+	return true;
+}
+
+bool CCsvDataFile::ReadColumnCache(const char* szFilename)
+{
+	PRINTER_STATS_SCOPE(FileRead);
+	std::shared_ptr<CCsvColumnCache> ptrCache = std::make_shared<CCsvColumnCache>();
+	if (!ptrCache->Open(GetCsvCacheFileName(szFilename).c_str(), szFilename))
+		return false;
+
+	ClearData();
+	m_szFilename = szFilename;
+	m_ptrCache = ptrCache;
+	m_nCachedRows = ptrCache->GetNumberOfRows();
+	for (int iVar = 0; iVar < ptrCache->GetNumberOfColumns(); iVar++)
+	{
+		m_vstrVariableNames.push_back(ptrCache->GetColumnName(iVar));
+		m_vstrSourceFilenames.push_back(m_szFilename);
+		m_mapVariableIndex.insert(std::make_pair(NormalizeName(m_vstrVariableNames.back().c_str()), iVar));
+	}
+	BindTypedColumns();
+
+	// The typed columns of the cache are used in place, others are converted
+	for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+	{
+		CCsvTypedColumn& column = m_vTypedColumns[i];
+		if (column.m_iVariable == -1)
+			continue;
+		CsvColumnType eType;
+		if (ptrCache->GetColumnType(column.m_iVariable, eType) && eType == column.m_eType)
+		{
+			column.m_bCached = true;
+			continue;
+		}
+		const char* pField;
+		int nLength;
+		for (int iRow = 0; iRow < m_nCachedRows; iRow++)
+		{
+			// a damaged cache is left for the caller to parse the file
+			if (!ptrCache->GetField(column.m_iVariable, iRow, pField, nLength))
+			{
+				ClearData();
+				return false;
+			}
+			column.Append(pField, nLength);
+		}
+	}
+	return true;
+}
+
+bool CCsvDataFile::WriteColumnCache(const char* szCacheName, const char* szSourceName)
+{
+	return CCsvColumnCache::Write(*this, szCacheName, szSourceName, m_szError);
+}
+
+// A cache which can not be written only costs the next load a parse, so
+// its error is dropped and the file stays loaded without error.
+void CCsvDataFile::UpdateColumnCache(const char* szFilename)
+{
+	std::string strError;
+	CCsvColumnCache::Write(*this, GetCsvCacheFileName(szFilename).c_str(), szFilename, strError);
+}
+
+// Splits the rows at line ends found from the quotes counted before them.
+void CCsvDataFile::SplitMappedChunks(const char* pBegin, const char* pEnd, vector<CCsvMappedChunk>& vChunks) const
+{
+	int nChunks = 1;
+	if (m_nParseThreads > 1 && pEnd - pBegin >= 2 * MIN_PARSE_CHUNK_SIZE)
+		nChunks = static_cast<int>(std::min<ptrdiff_t>(m_nParseThreads, (pEnd - pBegin) / MIN_PARSE_CHUNK_SIZE));
+
+	vector<const char*> vpBounds(nChunks + 1);
+	for (int i = 0; i <= nChunks; i++)
+		vpBounds[i] = pBegin + (pEnd - pBegin) / nChunks * i;
+	vpBounds[nChunks] = pEnd;
+
+	// a bound is inside quotes if an odd number of quotes come before it
+	vector<int> vnQuotes(nChunks, 0);
+	RunParallel(nChunks - 1, m_nParseThreads, [&](int i)
+	{
+		CCsvScanner scanner(m_delim.at(0));
+		vnQuotes[i] = scanner.CountQuotes(vpBounds[i], vpBounds[i + 1]);
+	});
+
+	vChunks.resize(nChunks);
+	vChunks[0].m_pBegin = pBegin;
+	int nQuotes = 0;
+	for (int i = 1; i < nChunks; i++)
+	{
+		nQuotes += vnQuotes[i - 1];
+		vChunks[i].m_pBegin = std::max(FindRowStart(vpBounds[i], pEnd, (nQuotes & 1) != 0), vChunks[i - 1].m_pBegin);
+		vChunks[i - 1].m_pEnd = vChunks[i].m_pBegin;
+	}
+	vChunks[nChunks - 1].m_pEnd = pEnd;
+}
+
+void CCsvDataFile::ParseMappedChunk(CCsvMappedChunk& chunk) const
+{
+	PRINTER_STATS_SCOPE(Parse);
+	chunk.m_v2dFieldData.assign(m_v2dFieldData.size(), vector<CsvFieldView>());
+	chunk.m_nRows = 0;
+	chunk.m_vTypedColumns = m_vTypedColumns;
+	chunk.m_ptrArena = std::make_shared<CCsvArena>();
+
+	CCsvMemoryInput inFile(chunk.m_pBegin, m_ptrMappedFile->GetData() + m_ptrMappedFile->GetSize(), m_delim.at(0));
+
+	// the last row may run past m_pEnd
+	while (!inFile.eof() && inFile.m_pCur < chunk.m_pEnd)
+		ReadMappedRecord(inFile, chunk);
+
+	chunk.m_pStop = inFile.m_pCur;
+	PRINTER_STATS_ADD(Bytes, chunk.m_pStop - chunk.m_pBegin);
+	PRINTER_STATS_ADD(Rows, chunk.m_nRows);
+}
+
+void CCsvDataFile::JoinMappedChunks(vector<CCsvMappedChunk>& vChunks)
+{
+	size_t nRows = 0;
+	const char* pNext = vChunks[0].m_pBegin;
+	for (size_t i = 0; i < vChunks.size(); i++)
+	{
+		// the split guessed wrong, e.g. on unbalanced quotes
+		if (vChunks[i].m_pBegin != pNext)
+		{
+			vChunks[i].m_pBegin = pNext;
+			ParseMappedChunk(vChunks[i]);
+		}
+		pNext = vChunks[i].m_pStop;
+		nRows += vChunks[i].m_nRows;
+	}
+	m_nRows += static_cast<int>(nRows);
+
+	for (size_t iVar = 0; iVar < m_v2dFieldData.size(); iVar++)
+	{
+		if (m_vbStoreVariable[iVar])
+			m_v2dFieldData[iVar].reserve(nRows);
+		for (size_t i = 0; i < vChunks.size(); i++)
+		{
+			vector<CsvFieldView>& vFields = vChunks[i].m_v2dFieldData[iVar];
+			m_v2dFieldData[iVar].insert(m_v2dFieldData[iVar].end(), vFields.begin(), vFields.end());
+			vector<CsvFieldView>().swap(vFields);
+		}
+	}
+
+	for (size_t i = 0; i < vChunks.size(); i++)
+	{
+		for (size_t iTyped = 0; iTyped < m_vTypedColumns.size(); iTyped++)
+			m_vTypedColumns[iTyped].AppendColumn(vChunks[i].m_vTypedColumns[iTyped]);
+		m_vptrArenas.push_back(vChunks[i].m_ptrArena);
+	}
+}
+
+// Reads the variable names from the first line of the stream.
+// The names are read up to the end of the line rather than counted first,
+// so the stream is never rewound.
+template <class TInput>
+int CCsvDataFile::ReadHeader(TInput& inFile)
+{
+	bool bEndOfLine = false;
+	CCsvArena arena;
+
+	while (!bEndOfLine)
+	{
+		ReadCSVfield(inFile, arena, m_delim.at(0), bEndOfLine);
+		m_vstrVariableNames.push_back(string(arena.GetFieldData(), arena.GetFieldLength()));
+		arena.DiscardField();
+		m_vstrSourceFilenames.push_back(m_szFilename);
+		m_v2dFieldData.push_back(vector<CsvFieldView>());
+	}
+
+	if (m_vstrVariableNames.back().find("\n") != -1)
+		m_vstrVariableNames.back().resize(m_vstrVariableNames.back().length() - 1);
+
+	if (m_vstrVariableNames.back().find("\r") != -1)
+		m_vstrVariableNames.back().resize(m_vstrVariableNames.back().length() - 1);
+
+	// index the names, the first of equal names wins like in a linear search
+	for (size_t iVar = 0; iVar < m_vstrVariableNames.size(); iVar++)
+		m_mapVariableIndex.insert(std::make_pair(NormalizeName(m_vstrVariableNames[iVar].c_str()), static_cast<int>(iVar)));
+
+	BindTypedColumns();
+	BindProjection();
+
+	return GetNumberOfVariables();
+}
+
+// Reads one line of data.  The last field is read up to the end of the line
+// and anything left over is reported as too many delimiters.
+bool CCsvDataFile::ReadRecord(istream& inFile, CCsvArena& arena)
+{
+	int nVars = GetNumberOfVariables();
+	int nVarInfo = -1;
+	bool bStored = false;
+	string strMsg;
+	bool bEndOfLine = false;
+	int nBytes = 0;
+	CCsvFieldSkipper skipper;
+
+	for (int iVar = 0; iVar<nVars; iVar++)
+	{
+		bool bStore = m_vbStoreVariable[iVar];
+
+		//				inFile.getline(buff, sizeof(buff), (iVar == nVars-1) ? '\n' : df.m_delim.at(0));	
+		// Changed previous line to the following to correctly support CSV format
+		if (!bEndOfLine)
+		{
+			char delimiter = (iVar == nVars - 1) ? '\n' : m_delim.at(0);
+			int iRead = bStore ? ReadCSVstring(inFile, arena, delimiter, bEndOfLine) : ReadCSVfield(inFile, skipper, delimiter, bEndOfLine);
+			nBytes += iRead;
+
+			if (iVar != nVars - 1 && (iRead == 0 || bEndOfLine))
+				strMsg = "Line terminated without enough delimiter";
+
+			//we haven't read anything in this line. So, skip it.
+			if (iRead == 0)
+				break;
+		}
+
+		// a column which is not kept still tells whether the row is stored
+		if (!bStore)
+		{
+			if (iVar == 0 && IsStoredField(skipper.GetFieldData(), skipper.GetFieldLength()))
+				bStored = true;
+			skipper.DiscardField();
+			continue;
+		}
+
+		// make sure we didn't pick up extra junk @ eof.
+		if (IsStoredField(arena.GetFieldData(), arena.GetFieldLength()))
+		{
+			CsvFieldView field = arena.EndField();
+			m_v2dFieldData.at(iVar).push_back(field);
+			if (m_vnTypedColumnOfVariable[iVar] >= 0)
+				m_vTypedColumns[m_vnTypedColumnOfVariable[iVar]].Append(field.m_pData, field.m_nLength);
+			if (iVar == 0)
+				bStored = true;
+		}
+		else
+			arena.DiscardField();
+	}
+
+	if (!bEndOfLine)
+	{
+		ReadCSVfield(inFile, skipper, '\n', bEndOfLine);
+		if (skipper.GetFieldLength() > 0)
+			strMsg = "Line contains too many delimiter and data";
+	}
+
+	if (nVarInfo != -1)
+		m_v2dFieldData.at(nVarInfo).push_back(arena.Store(strMsg.c_str(), static_cast<int>(strMsg.length())));
+	if (bStored)
+		m_nRows++;
+
+	PRINTER_STATS_ADD(Bytes, nBytes);
+	PRINTER_STATS_ADD(Rows, bStored ? 1 : 0);
+	return bStored;
+}
+
+// Reads one line of a mapped file, see ReadRecord().
+bool CCsvDataFile::ReadMappedRecord(CCsvMemoryInput& inFile, CCsvMappedChunk& chunk) const
+{
+	CCsvArena& arena = *chunk.m_ptrArena;
+	int nVars = GetNumberOfVariables();
+	bool bStored = false;
+	bool bEndOfLine = false;
+	bool bCopied = false;
+	CsvFieldView field;
+	CCsvFieldSkipper skipper;
+
+	for (int iVar = 0; iVar<nVars; iVar++)
+	{
+		bool bStore = m_vbStoreVariable[iVar];
+		if (!bEndOfLine)
+		{
+			char delimiter = (iVar == nVars - 1) ? '\n' : m_delim.at(0);
+			int iRead = bStore ? ReadMappedField(inFile, arena, delimiter, bEndOfLine, field, bCopied)
+				: ReadMappedField(inFile, skipper, delimiter, bEndOfLine, field, bCopied);
+
+			//we haven't read anything in this line. So, skip it.
+			if (iRead == 0)
+				break;
+		}
+		else
+		{
+			field.m_pData = "";
+			field.m_nLength = 0;
+			bCopied = false;
+		}
+
+		// a column which is not kept still tells whether the row is stored
+		if (!bStore)
+		{
+			if (iVar == 0 && IsStoredField(field.m_pData, field.m_nLength))
+				bStored = true;
+			skipper.DiscardField();
+			continue;
+		}
+
+		// make sure we didn't pick up extra junk @ eof.
+		if (IsStoredField(field.m_pData, field.m_nLength))
+		{
+			// unescaped fields are the only ones kept in the arena
+			if (bCopied)
+				field = arena.EndField();
+			chunk.m_v2dFieldData[iVar].push_back(field);
+			if (m_vnTypedColumnOfVariable[iVar] >= 0)
+				chunk.m_vTypedColumns[m_vnTypedColumnOfVariable[iVar]].Append(field.m_pData, field.m_nLength);
+			if (iVar == 0)
+				bStored = true;
+		}
+		else if (bCopied)
+			arena.DiscardField();
+	}
+
+	// skip whatever follows the last field, as ReadRecord() does
+	if (!bEndOfLine)
+		ReadMappedField(inFile, skipper, '\n', bEndOfLine, field, bCopied);
+
+	if (bStored)
+		chunk.m_nRows++;
+	return bStored;
+}
+
+int CCsvDataFile::GetVariableName(const int& iVariable, std::string& rStr)
+{
+	try
+	{
+		rStr = m_vstrVariableNames.at(iVariable).c_str();
+		return static_cast<int>(rStr.length());
+	}
+
+	catch (const exception& e) { m_szError = e.what(); }
+	catch (...) { m_szError = ERROR_REASON[1]; }
+	return -1;
+}
+
+// Clears all data in the CDataFile
+void CCsvDataFile::ClearData()
+{
+	m_szError = "";
+	m_nFirstSampleRow = 0;
+	std::vector<std::string>().swap(m_vstrVariableNames);
+	std::vector<std::string>().swap(m_vstrSourceFilenames);
+	std::vector<std::vector<CsvFieldView> >().swap(m_v2dFieldData);
+	m_nRows = 0;
+	std::vector<std::shared_ptr<CCsvArena> >().swap(m_vptrArenas);
+	m_ptrMappedFile.reset();
+	m_ptrCache.reset();
+	m_nCachedRows = 0;
+	std::vector<int>().swap(m_vnTypedColumnOfVariable);
+	std::vector<bool>().swap(m_vbStoreVariable);
+	m_mapVariableIndex.clear();
+	for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+	{
+		m_vTypedColumns[i].Clear();
+		m_vTypedColumns[i].m_iVariable = -1;
+		m_vTypedColumns[i].m_bCached = false;
+	}
+}
+
+// Resolves the variable of every typed column.  A variable gets at most one
+// typed column, later ones asking for the same variable stay empty.
+void CCsvDataFile::BindTypedColumns()
+{
+	m_vnTypedColumnOfVariable.assign(m_vstrVariableNames.size(), -1);
+
+	for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+	{
+		int iVariable = LookupVariableIndex(m_vTypedColumns[i].m_strName.c_str());
+		if (iVariable != -1 && m_vnTypedColumnOfVariable[iVariable] == -1)
+		{
+			m_vTypedColumns[i].m_iVariable = iVariable;
+			m_vnTypedColumnOfVariable[iVariable] = static_cast<int>(i);
+		}
+		else
+			m_vTypedColumns[i].m_iVariable = -1;
+	}
+}
+
+// Keeps every variable unless columns are projected, then only the
+// projected and typed columns.
+void CCsvDataFile::BindProjection()
+{
+	bool bKeepAll = m_vstrProjectedColumns.empty() || m_bUseCache;
+	m_vbStoreVariable.assign(m_vstrVariableNames.size(), bKeepAll);
+	if (bKeepAll)
+		return;
+
+	for (size_t i = 0; i < m_vstrProjectedColumns.size(); i++)
+	{
+		int iVariable = LookupVariableIndex(m_vstrProjectedColumns[i].c_str());
+		if (iVariable != -1)
+			m_vbStoreVariable[iVariable] = true;
+	}
+	for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+	{
+		if (m_vTypedColumns[i].m_iVariable != -1)
+			m_vbStoreVariable[m_vTypedColumns[i].m_iVariable] = true;
+	}
+}
+
+// The rows already read keep the cells they have.
+void CCsvDataFile::SetProjectedColumns(const std::vector<std::string>& vstrColumns)
+{
+	m_vstrProjectedColumns = vstrColumns;
+	if (!m_vstrVariableNames.empty())
+		BindProjection();
+}
+
+// Adds a typed column and converts the rows which are already loaded.
+void CCsvDataFile::AddTypedColumn(const char* szVariableName, CsvColumnType eType)
+{
+	if (FindTypedColumn(szVariableName, eType) != NULL)
+		return;
+
+	m_vTypedColumns.push_back(CCsvTypedColumn(CsvColumnSpec(szVariableName, eType)));
+	if (m_vstrVariableNames.empty())
+		return;
+
+	BindTypedColumns();
+	BindProjection();
+
+	CCsvTypedColumn& column = m_vTypedColumns.back();
+	if (column.m_iVariable == -1)
+		return;
+
+	std::string rStr;
+	int nSamples = GetNumberOfSamples(column.m_iVariable);
+	for (int i = 0; i < nSamples; i++)
+	{
+		GetData(column.m_iVariable, i, rStr);
+		column.Append(rStr.c_str(), static_cast<int>(rStr.length()));
+	}
+}
+
+const CCsvTypedColumn* CCsvDataFile::FindTypedColumn(const char* szVariableName, CsvColumnType eType) const
+{
+	int iVariable = LookupVariableIndex(szVariableName);
+	for (size_t i = 0; i < m_vTypedColumns.size(); i++)
+	{
+		const CCsvTypedColumn& column = m_vTypedColumns[i];
+		if (column.m_eType != eType)
+			continue;
+		if (iVariable != -1 ? column.m_iVariable == iVariable : CompareByName(szVariableName)(column.m_strName))
+			return &column;
+	}
+	return NULL;
+}
+
+bool CCsvDataFile::GetIntColumn(const char* szVariableName, CsvIntColumn& column) const
+{
+	return GetIntColumn(ResolveColumn(szVariableName), column);
+}
+
+bool CCsvDataFile::GetBoolColumn(const char* szVariableName, CsvBoolColumn& column) const
+{
+	return GetBoolColumn(ResolveColumn(szVariableName), column);
+}
+
+// Returns the typed column of a variable if it has the requested type.
+const CCsvTypedColumn* CCsvDataFile::GetTypedColumn(const CsvColumnHandle& hColumn, CsvColumnType eType) const
+{
+	if (!hColumn.IsValid() || hColumn.m_iVariable >= static_cast<int>(m_vnTypedColumnOfVariable.size()))
+		return NULL;
+
+	int iTyped = m_vnTypedColumnOfVariable[hColumn.m_iVariable];
+	if (iTyped < 0 || m_vTypedColumns[iTyped].m_eType != eType)
+		return NULL;
+	return &m_vTypedColumns[iTyped];
+}
+
+bool CCsvDataFile::GetIntColumn(const CsvColumnHandle& hColumn, CsvIntColumn& column) const
+{
+	const CCsvTypedColumn* pColumn = GetTypedColumn(hColumn, CsvColumnType::Int32);
+	if (pColumn == NULL)
+		return false;
+	if (pColumn->m_bCached)
+		return m_ptrCache->GetIntColumn(pColumn->m_iVariable, column);
+
+	column.m_pValues = pColumn->m_vnValues.empty() ? NULL : &pColumn->m_vnValues[0];
+	column.m_pValidBits = pColumn->m_bvValid.GetWords();
+	column.m_nCount = pColumn->m_bvValid.Size();
+	return true;
+}
+
+bool CCsvDataFile::GetBoolColumn(const CsvColumnHandle& hColumn, CsvBoolColumn& column) const
+{
+	const CCsvTypedColumn* pColumn = GetTypedColumn(hColumn, CsvColumnType::Bool);
+	if (pColumn == NULL)
+		return false;
+	if (pColumn->m_bCached)
+		return m_ptrCache->GetBoolColumn(pColumn->m_iVariable, column);
+
+	column.m_pBits = pColumn->m_bvValues.GetWords();
+	column.m_pValidBits = pColumn->m_bvValid.GetWords();
+	column.m_nCount = pColumn->m_bvValid.Size();
+	return true;
+}
+
+// Converts a cell with the same rules as GetData().  Invalid cells are
+// stored as 0 / false with their valid bit cleared.
+void CCsvTypedColumn::Append(const char* pField, int nLength)
+{
+	PRINTER_STATS_SAMPLED_SCOPE(Convert);
+	if (m_eType == CsvColumnType::Int32)
+	{
+		int iValue;
+		bool bValid = ConvertCsvInt(pField, nLength, iValue);
+		m_vnValues.push_back(bValid ? iValue : 0);
+		m_bvValid.PushBack(bValid);
+	}
+	else
+	{
+		bool bValue = false;
+		bool bValid = ConvertCsvBool(pField, nLength, bValue);
+		m_bvValues.PushBack(bValid && bValue);
+		m_bvValid.PushBack(bValid);
+	}
+}
+
+void CCsvTypedColumn::AppendColumn(const CCsvTypedColumn& other)
+{
+	m_vnValues.insert(m_vnValues.end(), other.m_vnValues.begin(), other.m_vnValues.end());
+	m_bvValues.Append(other.m_bvValues);
+	m_bvValid.Append(other.m_bvValid);
+}
+
+void CCsvTypedColumn::Clear()
+{
+	m_vnValues.clear();
+	m_bvValues.Clear();
+	m_bvValid.Clear();
+}
+
+// Returns the length of the string if successful. 
+// Returns -1 if an error is encountered.
+int CCsvDataFile::GetData(const int& iVariable, const int& iSample, std::string& rStr)
+{
+	// bounds are checked rather than caught, bad rows are common in big files
+	const char* pField;
+	int nLength;
+	if (!GetField(iVariable, iSample, pField, nLength))
+	{
+		m_szError = ERROR_REASON[9];
+		return -1;
+	}
+
+	rStr.assign(pField, nLength);
+	return nLength;
+}
+
+// Returns the length of the string if successful. 
+// Returns -1 if an error is encountered.
+int CCsvDataFile::GetData(const char* szVariableName, const int& iSample, std::string& rStr)
+{
+	int retVal = 0;
+
+	int index = LookupVariableIndex(szVariableName);
+
+	if (index != -1)
+		retVal = GetData(index, iSample, rStr);
+
+	else
+	{
+		m_szError = ERROR_REASON[5];
+		retVal = -1;
+	}
+
+	return retVal;
+}
+
+// Points pField at a cell found by the name of its variable, without
+// copying it.  Returns the length of the cell, -1 if an error is
+// encountered, with the same errors as GetData().
+int CCsvDataFile::GetFieldByName(const char* szVariableName, const int& iSample, const char*& pField)
+{
+	int index = LookupVariableIndex(szVariableName);
+	if (index == -1)
+	{
+		m_szError = ERROR_REASON[5];
+		return -1;
+	}
+
+	int nLength;
+	if (!GetField(index, iSample, pField, nLength))
+	{
+		m_szError = ERROR_REASON[9];
+		return -1;
+	}
+	return nLength;
+}
+
+// Returns whether get a valid int value from the field
+bool CCsvDataFile::GetData(const char* szVariableName, const int& iSample, int& iValue)
+{
+	// Set default to be zero
+	iValue = 0;
+	const char* pField;
+	int nLengthStr = GetFieldByName(szVariableName, iSample, pField);
+
+	if (nLengthStr > 0)
+	{
+		if (ConvertCsvInt(pField, nLengthStr, iValue))
+			return true;
+	}
+	// If empty string was found in the field, default to be 0
+	else if (nLengthStr == 0)
+		return true;
+
+	m_szError = ERROR_REASON[4];
+	return false;
+}
+
+// Returns whether get a bool value from the field
+bool CCsvDataFile::GetData(const char* szVariableName, const int& iSample, bool& bValue)
+{
+	const char* pField;
+	int nLengthStr = GetFieldByName(szVariableName, iSample, pField);
+
+	if (nLengthStr > 0)
+	{
+		if (!ConvertCsvBool(pField, nLengthStr, bValue))
+		{
+			m_szError = ERROR_REASON[4];
+			return false;
+		}
+	}
+	// If empty string was found in the field, default to be 0
+	else if (nLengthStr == 0)
+		return false;
+
+	m_szError = ERROR_REASON[3];
+	return true;
+}
+
+// Resolves a variable name once so that its cells can be read without
+// any string work.
+CsvColumnHandle CCsvDataFile::ResolveColumn(const char* szVariableName) const
+{
+	CsvColumnHandle hColumn;
+	hColumn.m_iVariable = LookupVariableIndex(szVariableName);
+	return hColumn;
+}
+
+// Points pField at the bytes of a cell without copying them.
+// Returns false if the column or row is out of range.
+bool CCsvDataFile::GetField(const int& iVariable, const int& iSample, const char*& pField, int& nLength) const
+{
+	if (iVariable < 0 || iSample < 0 || iVariable >= GetNumberOfVariables())
+		return false;
+
+	if (m_ptrCache)
+		return m_ptrCache->GetField(iVariable, iSample, pField, nLength);
+
+	const std::vector<CsvFieldView>& vColumn = m_v2dFieldData[iVariable];
+	if (iSample >= static_cast<int>(vColumn.size()))
+		return false;
+	pField = vColumn[iSample].m_pData;
+	nLength = vColumn[iSample].m_nLength;
+	return true;
+}
+
+// Returns whether get a valid int value from the field
+bool CCsvDataFile::GetData(const CsvColumnHandle& hColumn, const int& iSample, int& iValue)
+{
+	const char* pField;
+	int nLength;
+	if (!GetField(hColumn.m_iVariable, iSample, pField, nLength))
+	{
+		iValue = 0;
+		m_szError = ERROR_REASON[9];
+		return false;
+	}
+
+	if (ConvertCsvInt(pField, nLength, iValue))
+		return true;
+
+	m_szError = ERROR_REASON[4];
+	return false;
+}
+
+// Returns whether get a bool value from the field
+bool CCsvDataFile::GetData(const CsvColumnHandle& hColumn, const int& iSample, bool& bValue)
+{
+	const char* pField;
+	int nLength;
+	if (!GetField(hColumn.m_iVariable, iSample, pField, nLength))
+	{
+		m_szError = ERROR_REASON[9];
+		return false;
+	}
+
+	if (ConvertCsvBool(pField, nLength, bValue))
+		return true;
+
+	m_szError = ERROR_REASON[4];
+	return false;
+}
+
+// Copies the field into rStr
+bool CCsvDataFile::GetData(const CsvColumnHandle& hColumn, const int& iSample, std::string& rStr)
+{
+	const char* pField;
+	int nLength;
+	if (!GetField(hColumn.m_iVariable, iSample, pField, nLength))
+	{
+		rStr.clear();
+		m_szError = ERROR_REASON[9];
+		return false;
+	}
+
+	rStr.assign(pField, nLength);
+	return true;
+}
+
+// Returns the index of the first variable name that matches szName.
+// Returns -1 if szName is not found.
+int CCsvDataFile::LookupVariableIndex(const char* szName, const int& offset /*=0*/) const
+{
+	PRINTER_STATS_SAMPLED_SCOPE(HeaderLookup);
+	PRINTER_STATS_ADD(HeaderLookups, 1);
+	if (offset == 0)
+	{
+		std::unordered_map<std::string, int>::const_iterator itIndex = m_mapVariableIndex.find(NormalizeName(szName));
+		return itIndex == m_mapVariableIndex.end() ? -1 : itIndex->second;
+	}
+
+	int retVal = 0;
+
+	std::vector<std::string>::const_iterator it =
+		find_if
+		(
+		m_vstrVariableNames.begin() + offset,
+		m_vstrVariableNames.end(),
+		CompareByName(szName)
+		);
+
+	if (it == m_vstrVariableNames.end())
+		retVal = -1;
+
+	else
+	{
+		while (it != m_vstrVariableNames.begin())
+		{
+			retVal++;
+			it--;
+		}
+	}
+
+	return retVal;
+}
+
+//********************************************************
+// Function:    ReadCSVstring
+// Description: Reads an string from an input stream conform CSV specification
+//********************************************************
+int CCsvDataFile::ReadCSVstring(std::istream& inFile, // input stream to pass
+	CCsvArena& arena, // arena to write the value to
+	char delimiter  // what delimiter to be used
+	)
+{
+	bool bEndOfLine;
+
+	return ReadCSVstring(inFile, arena, delimiter, bEndOfLine);
+}
+
+int CCsvDataFile::ReadCSVstring(std::istream& inFile, // input stream to pass
+	CCsvArena& arena, // arena to write the value to
+	char delimiter,  // what delimiter to be used
+	bool& bEndOfLine // return if hit end of line
+	)
+{
+	return ReadCSVfield(inFile, arena, delimiter, bEndOfLine);
+}
+
+// Reads a string conform CSV specification from any input offering the
+// get(char&), peek() and eof() members of std::istream, so that streams and
+// mapped files share exactly the same quoting and CR/LF behaviour.
+template <class TInput, class TOutput>
+static int ReadCSVfield(TInput& inFile, // input to read from
+	TOutput& output, // arena to write the value to, or a CCsvFieldSkipper
+	char delimiter,  // what delimiter to be used
+	bool& bEndOfLine // return if hit end of line
+	)
+{
+	bool quoted = false;     // Is this a quoted string?
+	bool backslash = false;  // Is there a backslash?
+	int cRead = 0;           // Characters read sofar from stream
+	char cc = 0;             // Current character
+	int pc;                 // Peek character
+
+	inFile.get(cc);
+	if (cc == 0 || inFile.eof())
+	{
+		bEndOfLine = true;
+		return 0;       // Read one character and returned...
+	}
+
+	cRead++;
+
+	if (cc == '\\')        // Finding a backslash sign...
+		backslash = true;
+
+	if (cc == '"')         // Decide is a quoted string and ignore it...
+		quoted = true;
+
+	else if (cc == delimiter || cc == '\n' || cc == '\r')
+	{
+		bEndOfLine = (cc == '\n' || cc == '\r');
+
+		//if we have CR and next is LF, we read the next char too
+		if (cc == '\r' && inFile.peek() == '\n')
+		{
+			inFile.get(cc);
+		}
+
+		return cRead;       // Read one character and returned...
+	}
+	else
+	{
+		output.Put(cc);
+	}
+
+	if (inFile.peek() == TInput::traits_type::eof())
+	{
+		bEndOfLine = true;
+		return cRead;
+	}
+
+	while (!inFile.eof())
+	{
+		inFile.get(cc);     // read next character 
+
+		if (inFile.eof())
+			break;
+
+		pc = inFile.peek();
+
+		if ((backslash && cc == 'n') || (backslash && cc == 'r'))
+		{
+			// convert string '\n' to real new line. 
+			// as windows multiline editbox control does not make a new line for just '\n'
+			// we need CRLF here
+			output.SetLast('\r');
+			output.Put('\n');
+			backslash = false;
+			continue;
+		}
+
+		backslash = (cc == '\\');
+
+		cRead++;
+		if (cc == '"' && quoted == true)      // either end of string or an escape quote
+		{
+			if (delimiter == '\n')
+			{
+				if (pc == '\n')
+				{
+					inFile.get(cc); // remove delimiter from the stream
+					cRead++;
+					break;
+				}
+				else if (pc == '\r')
+				{
+					inFile.get(cc); // remove delimiter from the stream
+					if (inFile.peek() == '\n')
+					{
+						inFile.get(cc);
+					}
+					cRead++;
+					break;
+				}
+				else if (pc == '"')
+				{
+					inFile.get(cc); // read the "
+					cRead++;
+				}
+
+			}
+			else
+			{
+				if (pc == delimiter)
+				{
+					inFile.get(cc); // remove delimiter from the stream
+					cRead++;
+					break;
+				}
+				else if (pc == '"')
+				{
+					inFile.get(cc); // read the "
+					cRead++;
+				}
+			}
+
+			//            else if (isspace(pc)) *** remove spaces after "???
+		}
+
+		if (delimiter == '\n')
+		{
+			if ((cc == '\n' || cc == '\r') && quoted == false)
+			{
+				if (cc == '\r' && inFile.peek() == '\n')
+				{
+					inFile.get(cc);
+				}
+
+				break;
+			}
+		}
+		else
+		{
+			if ((cc == delimiter || cc == '\n' || cc == '\r') && quoted == false)
+			{
+				if (cc == '\r' && inFile.peek() == '\n')
+				{
+					inFile.get(cc);
+				}
+				break;
+			}
+		}
+
+
+		output.Put(cc);
+		cRead++;
+	}
+
+	bEndOfLine = (cc == '\n' || cc == '\r' || inFile.eof());
+	inFile.peek();	// when reach file end, this operation will make inFile.eof return true;
+	return cRead;
 }
\ No newline at end of file
@@ -1,95 +1,374 @@
-#pragma once
-#include <vector>
-// the CDataFile class
-class CCsvDataFile
-{
-public:
-
-	//Default constructor.
-	CCsvDataFile();
-
-	// Misc. constructor.  Instantiates an instance of CDataFile and reads the
-	// specified file with the specified read flags.
-	CCsvDataFile(const char* szFilename);
-
-	// Copy constructor.  Instantiates an instance of CDataFile with the
-	// contents of another CDataFile.
-	CCsvDataFile(const CCsvDataFile& df);
-
-	// Calls ClearData() before the CDataFile is destroyed.
-	virtual ~CCsvDataFile(void);
-
-	// Get the int at particular line
-	// Return true if the int value is valid
-	// Return false if the value is not an Integer
-	bool GetData(const char* szVariableName, const int& iSample, int& iValue);
-
-	// Get the bool at particular line
-	// Return true if the bool value is valid
-	// Return false if the value could not represent as a bool
-	bool GetData(const char* szVariableName, const int& iSample, bool& bValue);
-
-	// Assigns the variable name at the specified index to rStr.
-	// Returns the new length of rStr if successful, -1 if
-	// an error is encountered.
-	int GetVariableName(const int& iVariable, std::string& rStr);
-
-	std::istream& ReadFromStream(std::istream& inFile, CCsvDataFile& df);
-
-	// Returns the last error encountered by the class.
-	const char* GetLastError() const { return m_szError.c_str(); }
-
-	// Returns the number of variables currently in the CDataFile.
-	int GetNumberOfVariables() const { return static_cast<int>(m_vstrVariableNames.size()); }
-
-	// Returns the number of samples currently in the variable.
-	int GetNumberOfSamples(const int& iVariable)  const
-	{
-		return static_cast<int>(m_v2dStrData.at(iVariable).size());
-	}
-
-private:
-	std::string m_delim;
-	std::string m_szFilename;
-	std::string m_szError;
-	std::vector<std::string> m_vstrVariableNames;
-	std::vector<std::string> m_vstrSourceFilenames;
-	std::vector<std::vector<std::string> > m_v2dStrData;
-
-	// Private member function for internal bookeeping.
-
-	// Clears the data contained in a CDataFile 
-	// and reclaims any allocated memory.
-	virtual void ClearData();
-
-	// Reads the specified file with the current read flags.
-	// Returns true if successful, false if an error is encountered.
-	bool ReadFile(const char* szFilename);
-
-	// Assigns rStr with the data at the target variable.
-	// Returns the new length of rStr.  
-	// Returns -1 if an error is encountered.
-	int GetData(const int&  iVariable, const int& iSample, std::string& rStr);
-
-	// Assigns rStr with the data at the target variable.
-	// Returns the new length of rStr.  
-	// Returns -1 if an error is encountered.
-	int GetData(const char* szVariableName, const int& iSample, std::string& tStr);
-
-	int ReadCSVstring(std::istream& inFile, // input stream to pass
-		char* buff,      // buffer to return the value
-		int size,        // maximum buffersize passsed
-		char delimiter  // what delimiter to be used
-		);
-
-	int ReadCSVstring(std::istream& inFile, // input stream to pass
-		char* buff,      // buffer to return the value
-		int size,        // maximum buffersize passsed
-		char delimiter,  // what delimiter to be used
-		bool & bEndOfLine
-		);
-
-	int LookupVariableIndex(const char* szName, const int& offset = 0) const;
-};
-
-
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "BitVector.h"
+#include "CsvArena.h"
+
+class CMappedFile;
+class CCsvColumnCache;
+enum class CompressionFormat;
+class CCsvMemoryInput;
+class CCsvMappedChunk;
+
+// Types a column can be converted to while the file is loaded.
+enum class CsvColumnType
+{
+	Int32,
+	Bool
+};
+
+// A column to convert while loading, see CsvReadOptions.
+struct CsvColumnSpec
+{
+	CsvColumnSpec(const std::string& strName, CsvColumnType eType) : m_strName(strName), m_eType(eType) {}
+	std::string m_strName;
+	CsvColumnType m_eType;
+};
+
+// Options applied while a file is read.
+struct CsvReadOptions
+{
+	CsvReadOptions() : m_nParseThreads(1), m_bUseCache(false) {}
+
+	// Columns converted once during the load instead of on every GetData()
+	std::vector<CsvColumnSpec> m_vTypedColumns;
+
+	// Threads parsing a mapped file, each one a separate range of rows.
+	// Small files and streams are always parsed by the calling thread.
+	int m_nParseThreads;
+
+	// Load the file from its column cache when the cache is up to date, and
+	// write the cache after parsing the file otherwise.
+	bool m_bUseCache;
+
+	// The only columns whose cells are kept, empty to keep every column.
+	// The typed columns are always kept.  The fields of the other columns
+	// are skipped by the parser without being copied or stored, so those
+	// columns keep their name but hold no rows.  Ignored with m_bUseCache,
+	// as the cache written must hold every column.
+	std::vector<std::string> m_vstrProjectedColumns;
+};
+
+// Read-only view of an Int32 column.  Bit i of m_pValidBits is set if row i
+// holds a valid int, invalid rows read as 0.
+struct CsvIntColumn
+{
+	const int* m_pValues;
+	const uint32_t* m_pValidBits;
+	int m_nCount;
+
+	bool IsValid(int i) const { return i < m_nCount && IsBitSet(m_pValidBits, i); }
+};
+
+// Read-only view of a Bool column, one bit per row in m_pBits.
+struct CsvBoolColumn
+{
+	const uint32_t* m_pBits;
+	const uint32_t* m_pValidBits;
+	int m_nCount;
+
+	bool IsValid(int i) const { return i < m_nCount && IsBitSet(m_pValidBits, i); }
+	bool GetValue(int i) const { return IsBitSet(m_pBits, i); }
+};
+
+// A variable resolved by CCsvDataFile::ResolveColumn(), reading through it
+// needs no lookup of the name.
+struct CsvColumnHandle
+{
+	CsvColumnHandle() : m_iVariable(-1) {}
+	bool IsValid() const { return m_iVariable >= 0; }
+	int m_iVariable;
+};
+
+// Storage of a typed column, filled as the cells of its variable are read.
+class CCsvTypedColumn
+{
+public:
+	CCsvTypedColumn(const CsvColumnSpec& spec) : m_strName(spec.m_strName), m_eType(spec.m_eType), m_iVariable(-1), m_bCached(false) {}
+
+	// Converts and appends the next cell of the column.
+	void Append(const char* pField, int nLength);
+
+	// Appends the rows of another column of the same type.
+	void AppendColumn(const CCsvTypedColumn& other);
+
+	// Removes all rows but keeps the allocated memory.
+	void Clear();
+
+	std::string m_strName;
+	CsvColumnType m_eType;
+	int m_iVariable;			// -1 if the file has no such variable
+	std::vector<int> m_vnValues;	// Int32 columns
+	CBitVector m_bvValues;		// Bool columns
+	CBitVector m_bvValid;
+	bool m_bCached;				// the values are read from the column cache instead
+};
+
+// the CDataFile class
+class CCsvDataFile
+{
+public:
+
+	//Default constructor.
+	CCsvDataFile();
+
+	// Misc. constructor.  Instantiates an instance of CDataFile and reads the
+	// specified file with the specified read flags.
+	CCsvDataFile(const char* szFilename);
+
+	// Reads the specified file, converting the typed columns of options
+	// while the file is loaded.
+	CCsvDataFile(const char* szFilename, const CsvReadOptions& options);
+
+	// Copy constructor.  Instantiates an instance of CDataFile with the
+	// contents of another CDataFile.
+	CCsvDataFile(const CCsvDataFile& df);
+
+	// Calls ClearData() before the CDataFile is destroyed.
+	virtual ~CCsvDataFile(void);
+
+	// Get the int at particular line
+	// Return true if the int value is valid
+	// Return false if the value is not an Integer
+	bool GetData(const char* szVariableName, const int& iSample, int& iValue);
+
+	// Get the bool at particular line
+	// Return true if the bool value is valid
+	// Return false if the value could not represent as a bool
+	bool GetData(const char* szVariableName, const int& iSample, bool& bValue);
+
+	// Resolves a variable name, ignoring case and surrounding space.
+	// The handle is not valid if there is no such variable.
+	CsvColumnHandle ResolveColumn(const char* szVariableName) const;
+
+	// Same as the GetData() overloads by name, reading the cell through a
+	// resolved handle.  Returns false if the handle or row is out of range,
+	// or the field is not of the requested type.
+	bool GetData(const CsvColumnHandle& hColumn, const int& iSample, int& iValue);
+	bool GetData(const CsvColumnHandle& hColumn, const int& iSample, bool& bValue);
+	bool GetData(const CsvColumnHandle& hColumn, const int& iSample, std::string& rStr);
+
+	// Points pField at the bytes of a cell without copying them, valid as long
+	// as the file holds the row.  Unlike GetData() it never changes the file,
+	// so threads may call it at the same time.  Returns false if the handle
+	// or row is out of range.
+	bool GetField(const CsvColumnHandle& hColumn, const int& iSample, const char*& pField, int& nLength) const
+	{
+		return GetField(hColumn.m_iVariable, iSample, pField, nLength);
+	}
+
+	// Converts the named column to eType.  Rows already loaded are converted
+	// now, rows read later are converted while they are loaded.
+	void AddTypedColumn(const char* szVariableName, CsvColumnType eType);
+
+	// Returns the values of a column added as CsvColumnType::Int32.
+	// Returns false if there is no such typed column in the file.
+	bool GetIntColumn(const char* szVariableName, CsvIntColumn& column) const;
+
+	// Returns the values of a column added as CsvColumnType::Bool.
+	// Returns false if there is no such typed column in the file.
+	bool GetBoolColumn(const char* szVariableName, CsvBoolColumn& column) const;
+
+	// Same as above, through a resolved handle.
+	bool GetIntColumn(const CsvColumnHandle& hColumn, CsvIntColumn& column) const;
+	bool GetBoolColumn(const CsvColumnHandle& hColumn, CsvBoolColumn& column) const;
+
+	// Assigns the variable name at the specified index to rStr.
+	// Returns the new length of rStr if successful, -1 if
+	// an error is encountered.
+	int GetVariableName(const int& iVariable, std::string& rStr);
+
+	std::istream& ReadFromStream(std::istream& inFile, CCsvDataFile& df);
+
+	// Streaming mode.  Reads the header line from the stream without seeking,
+	// so pipes and stdin can be used.  The rows are numbered from nFirstSampleRow.
+	// Returns false if an error is encountered.
+	bool BeginStream(std::istream& inFile, int nFirstSampleRow = 0);
+
+	// Streaming mode.  Discards the rows of the previous batch and reads up to
+	// nMaxRows rows from the stream, so memory stays bounded by the batch size.
+	// Returns the number of rows read, 0 when the stream is exhausted and
+	// -1 if an error is encountered.
+	int ReadNextBatch(std::istream& inFile, const int& nMaxRows);
+
+	// Same as ReadNextBatch(), numbering the rows from nFirstSampleRow, so
+	// that several copies of a file begun by BeginStream() can take turns
+	// reading the batches of one stream.
+	int ReadBatch(std::istream& inFile, const int& nMaxRows, int nFirstSampleRow);
+
+	// Returns the row number of the first sample currently held.  This is 0
+	// unless the data was read in batches by ReadNextBatch().
+	int GetFirstSampleRow() const { return m_nFirstSampleRow; }
+
+	// Writes the loaded variables and typed columns to a column cache, which
+	// a CCsvDataFile reading szSourceName with CsvReadOptions::m_bUseCache
+	// loads instead of parsing the file again.
+	bool WriteColumnCache(const char* szCacheName, const char* szSourceName);
+
+	// Returns the last error encountered by the class.
+	const char* GetLastError() const { return m_szError.c_str(); }
+
+	// Returns the number of variables currently in the CDataFile.
+	int GetNumberOfVariables() const { return static_cast<int>(m_vstrVariableNames.size()); }
+
+	// Keeps only the cells of the given columns and of the typed columns in
+	// the rows read from now on, see CsvReadOptions::m_vstrProjectedColumns.
+	// An empty list keeps every column again.
+	void SetProjectedColumns(const std::vector<std::string>& vstrColumns);
+	const std::vector<std::string>& GetProjectedColumns() const { return m_vstrProjectedColumns; }
+
+	// Returns the number of rows currently held.  Unlike GetNumberOfSamples()
+	// it does not depend on which columns are kept.
+	int GetNumberOfRows() const { return m_ptrCache ? m_nCachedRows : m_nRows; }
+
+	// Returns the number of samples currently in the variable.
+	int GetNumberOfSamples(const int& iVariable)  const
+	{
+		if (m_ptrCache)
+			return iVariable >= 0 && iVariable < GetNumberOfVariables() ? m_nCachedRows : 0;
+		return static_cast<int>(m_v2dFieldData.at(iVariable).size());
+	}
+
+private:
+	friend class CCsvColumnCache;
+
+	std::string m_delim;
+	std::string m_szFilename;
+	std::string m_szError;
+	std::vector<std::string> m_vstrVariableNames;
+	std::vector<std::string> m_vstrSourceFilenames;
+	int m_nFirstSampleRow;
+	int m_nParseThreads;
+	int m_nRows;
+
+	// The cells of every variable.  They point into the mapped file, or into
+	// an arena for the cells which were copied: every cell of a stream, and
+	// the cells of a mapped file which had quotes or escapes removed.  Both
+	// are shared so that copies of the CCsvDataFile keep the views valid.
+	// A stream has one arena, every chunk of a parallel parse its own.
+	std::shared_ptr<CMappedFile> m_ptrMappedFile;
+	std::vector<std::shared_ptr<CCsvArena> > m_vptrArenas;
+	std::vector<std::vector<CsvFieldView> > m_v2dFieldData;
+
+	// The column cache the file was loaded from, its cells are read in place
+	std::shared_ptr<CCsvColumnCache> m_ptrCache;
+	int m_nCachedRows;
+	bool m_bUseCache;
+
+	// Columns converted during the load, and for every variable the index of
+	// its typed column or -1.
+	std::vector<CCsvTypedColumn> m_vTypedColumns;
+	std::vector<int> m_vnTypedColumnOfVariable;
+
+	// The columns to keep, and for every variable whether its cells are kept
+	std::vector<std::string> m_vstrProjectedColumns;
+	std::vector<bool> m_vbStoreVariable;
+
+	// Normalized variable name to the index of its first variable
+	std::unordered_map<std::string, int> m_mapVariableIndex;
+
+	// Private member function for internal bookeeping.
+
+	// Clears the data contained in a CDataFile 
+	// and reclaims any allocated memory.
+	virtual void ClearData();
+
+	// Reads the specified file with the current read flags.
+	// Returns true if successful, false if an error is encountered.
+	bool ReadFile(const char* szFilename);
+
+	// Maps the specified file into memory and indexes its fields in place.
+	// Returns false if the file can not be mapped, the caller then falls
+	// back to reading it as a stream.
+	bool ReadMappedFile(const char* szFilename);
+
+	// Reads a gzip or zstd file, decompressed on another thread while the
+	// rows are parsed.
+	bool ReadCompressedFile(const char* szFilename, CompressionFormat eCompression);
+
+	// Loads the file from its column cache.  Returns false if there is no
+	// cache or it is out of date, the caller then parses the file.
+	bool ReadColumnCache(const char* szFilename);
+
+	// Writes the cache of a file just parsed, ignoring a failure.
+	void UpdateColumnCache(const char* szFilename);
+
+	// Assigns rStr with the data at the target variable.
+	// Returns the new length of rStr.  
+	// Returns -1 if an error is encountered.
+	int GetData(const int&  iVariable, const int& iSample, std::string& rStr);
+
+	// Assigns rStr with the data at the target variable.
+	// Returns the new length of rStr.  
+	// Returns -1 if an error is encountered.
+	int GetData(const char* szVariableName, const int& iSample, std::string& tStr);
+
+	// Reads a field into the arena, left for the caller to end or discard.
+	int ReadCSVstring(std::istream& inFile, // input stream to pass
+		CCsvArena& arena, // arena to write the value to
+		char delimiter  // what delimiter to be used
+		);
+
+	int ReadCSVstring(std::istream& inFile, // input stream to pass
+		CCsvArena& arena, // arena to write the value to
+		char delimiter,  // what delimiter to be used
+		bool & bEndOfLine
+		);
+
+	// Reads the header line and creates one empty column per variable name.
+	// Returns the number of variables read.
+	template <class TInput>
+	int ReadHeader(TInput& inFile);
+
+	// Reads one line of data and appends its fields to the columns.
+	// Returns false if the line was empty and nothing was stored.
+	bool ReadRecord(std::istream& inFile, CCsvArena& arena);
+
+	// Same as ReadRecord() for a mapped file, storing views instead of copies
+	// into the columns of chunk.
+	bool ReadMappedRecord(CCsvMemoryInput& inFile, CCsvMappedChunk& chunk) const;
+
+	// Returns the arena of the rows read from a stream, emptied.
+	CCsvArena& ResetStreamArena();
+
+	// Splits the rows of a mapped file from pBegin to pEnd into one chunk per
+	// parse thread.  Chunks start after a line end which is not quoted, so
+	// they usually start at a row.
+	void SplitMappedChunks(const char* pBegin, const char* pEnd, std::vector<CCsvMappedChunk>& vChunks) const;
+
+	// Parses the rows of a chunk, may run on any thread.
+	void ParseMappedChunk(CCsvMappedChunk& chunk) const;
+
+	// Appends the rows of the chunks in file order.  A chunk which did not
+	// start where the previous one stopped is parsed again from there, so
+	// the rows are the same as parsed by a single thread.
+	void JoinMappedChunks(std::vector<CCsvMappedChunk>& vChunks);
+
+	// Finds the variable of every typed column once the header is known.
+	void BindTypedColumns();
+
+	// Decides which variables are kept once the header and the typed
+	// columns are known.
+	void BindProjection();
+
+	// Returns the typed column of a variable if it has type eType, NULL if not.
+	const CCsvTypedColumn* GetTypedColumn(const CsvColumnHandle& hColumn, CsvColumnType eType) const;
+
+	// Points pField at the cell without copying it.
+	// Returns false if the variable or row is out of range.
+	bool GetField(const int& iVariable, const int& iSample, const char*& pField, int& nLength) const;
+
+	// Same as GetField() for a variable given by name, sets m_szError.
+	// Returns the length of the cell, -1 if an error is encountered.
+	int GetFieldByName(const char* szVariableName, const int& iSample, const char*& pField);
+
+	// Returns the typed column of the given name and type, NULL if none.
+	const CCsvTypedColumn* FindTypedColumn(const char* szVariableName, CsvColumnType eType) const;
+
+	int LookupVariableIndex(const char* szName, const int& offset = 0) const;
+};
+
+
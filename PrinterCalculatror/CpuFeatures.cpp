@@ -0,0 +1,44 @@
+#include "CpuFeatures.h"
+
+#if defined(CPU_HAS_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// Queries the CPU.  AVX2 also needs the OS to save the YMM registers.
+static CpuFeatures DetectCpuFeatures()
+{
+	CpuFeatures features = { false, false, false };
+
+#if defined(CPU_HAS_X86_SIMD) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int nMaxLeaf = info[0];
+
+	__cpuid(info, 1);
+	features.m_bSse2 = (info[3] & (1 << 26)) != 0;
+	features.m_bSse42 = (info[2] & (1 << 20)) != 0;
+	bool bOsxsave = (info[2] & (1 << 27)) != 0;
+	bool bAvx = (info[2] & (1 << 28)) != 0;
+
+	if (nMaxLeaf >= 7 && bOsxsave && bAvx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+		features.m_bAvx2 = (info[1] & (1 << 5)) != 0;
+	}
+#elif defined(CPU_HAS_X86_SIMD) && defined(__GNUC__)
+	__builtin_cpu_init();
+	features.m_bSse2 = __builtin_cpu_supports("sse2") != 0;
+	features.m_bSse42 = __builtin_cpu_supports("sse4.2") != 0;
+	features.m_bAvx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+	return features;
+}
+
+static const CpuFeatures s_cpuFeatures = DetectCpuFeatures();
+
+const CpuFeatures& GetCpuFeatures()
+{
+	return s_cpuFeatures;
+}
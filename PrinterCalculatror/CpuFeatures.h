@@ -0,0 +1,25 @@
+#pragma once
+
+// Instruction set extensions of the running CPU, detected once at startup
+// so that vectorized kernels can be chosen at runtime.
+struct CpuFeatures
+{
+	bool m_bSse2;
+	bool m_bSse42;
+	bool m_bAvx2;
+};
+
+// Returns the features of the CPU the program runs on.
+const CpuFeatures& GetCpuFeatures();
+
+// Compilers other than MSVC only emit AVX2 instructions in functions marked
+// for it; MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__)
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_AVX2
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_HAS_X86_SIMD 1
+#endif
@@ -0,0 +1,75 @@
+#include "CsvArena.h"
+#include <algorithm>
+#include <cstring>
+
+CCsvArena::CCsvArena() : m_pField(NULL), m_pCur(NULL), m_pLimit(NULL)
+{
+}
+
+CsvFieldView CCsvArena::EndField()
+{
+	CsvFieldView field;
+	field.m_nLength = GetFieldLength();
+	field.m_pData = field.m_nLength > 0 ? m_pField : "";
+	m_pField = m_pCur;
+	return field;
+}
+
+CsvFieldView CCsvArena::Store(const char* pData, int nLength)
+{
+	if (m_pLimit - m_pCur < nLength)
+		Grow(nLength);
+	memcpy(m_pCur, pData, nLength);
+	m_pCur += nLength;
+	return EndField();
+}
+
+void CCsvArena::Reset()
+{
+	if (m_vptrSlabs.empty())
+		return;
+
+	// keep the slab being filled, an older one may be larger, e.g. a slab of
+	// its own for a long field, but is freed with the rest
+	m_vptrSlabs.front().swap(m_vptrSlabs.back());
+	std::swap(m_vnSlabSizes.front(), m_vnSlabSizes.back());
+	m_vptrSlabs.resize(1);
+	m_vnSlabSizes.resize(1);
+	m_pField = m_pCur = m_vptrSlabs[0].get();
+	m_pLimit = m_pField + m_vnSlabSizes[0];
+}
+
+size_t CCsvArena::GetReservedSize() const
+{
+	size_t nSize = 0;
+	for (size_t i = 0; i < m_vnSlabSizes.size(); i++)
+		nSize += m_vnSlabSizes[i];
+	return nSize;
+}
+
+void CCsvArena::Grow(size_t nMore)
+{
+	size_t nLength = m_pCur - m_pField;
+	// copied, as std::max takes the class constant by reference
+	size_t nSlabSize = SLAB_SIZE;
+	size_t nSize = std::max(nSlabSize, 2 * (nLength + nMore));
+	std::unique_ptr<char[]> ptrSlab(new char[nSize]);
+	if (nLength > 0)
+		memcpy(ptrSlab.get(), m_pField, nLength);
+
+	// a slab holding nothing but the field being written is not needed any more
+	if (!m_vptrSlabs.empty() && m_pField == m_vptrSlabs.back().get())
+	{
+		m_vptrSlabs.back().swap(ptrSlab);
+		m_vnSlabSizes.back() = nSize;
+	}
+	else
+	{
+		m_vptrSlabs.push_back(std::move(ptrSlab));
+		m_vnSlabSizes.push_back(nSize);
+	}
+
+	m_pField = m_vptrSlabs.back().get();
+	m_pCur = m_pField + nLength;
+	m_pLimit = m_pField + nSize;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// A field of a file: points either into the mapped bytes or, for fields
+// which were copied, into a CCsvArena.
+struct CsvFieldView
+{
+	const char* m_pData;
+	int m_nLength;
+};
+
+// Storage of the fields copied while a file is parsed.  The bytes of the
+// fields are packed one after another into large slabs, so a field costs no
+// allocation of its own and fields never move once written.  Everything is
+// released at once when the arena is reset or destroyed.
+//
+// A field is written a character at a time with Put() and finished with
+// EndField(), so it may grow to any length without knowing it in advance.
+class CCsvArena
+{
+public:
+	// Bytes of a slab, a field longer than this gets a slab of its own
+	static const size_t SLAB_SIZE = 64 * 1024;
+
+	CCsvArena();
+
+	// Appends a character to the field being written.
+	void Put(char cc)
+	{
+		if (m_pCur == m_pLimit)
+			Grow(1);
+		*m_pCur++ = cc;
+	}
+
+	// Replaces the last character of the field being written, which must
+	// not be empty.
+	void SetLast(char cc) { m_pCur[-1] = cc; }
+
+	// Returns the number of characters of the field being written.
+	int GetFieldLength() const { return static_cast<int>(m_pCur - m_pField); }
+
+	// Returns the characters of the field being written, valid until the
+	// next Put().
+	const char* GetFieldData() const { return m_pField; }
+
+	// Finishes the field being written and returns it.  The view stays valid
+	// until the arena is reset or destroyed.
+	CsvFieldView EndField();
+
+	// Drops the field being written.
+	void DiscardField() { m_pCur = m_pField; }
+
+	// Copies nLength bytes as a new field.
+	CsvFieldView Store(const char* pData, int nLength);
+
+	// Drops every field.  The current slab is kept to be filled again, the
+	// others are freed.
+	void Reset();
+
+	// Returns the bytes of all slabs.
+	size_t GetReservedSize() const;
+
+private:
+	// The fields are owned by this object and can not be copied.
+	CCsvArena(const CCsvArena&);
+	CCsvArena& operator=(const CCsvArena&);
+
+	// Moves the field being written to a new slab with room for at least
+	// nMore more characters.
+	void Grow(size_t nMore);
+
+	std::vector<std::unique_ptr<char[]> > m_vptrSlabs;
+	std::vector<size_t> m_vnSlabSizes;
+	char* m_pField;		// the first character of the field being written
+	char* m_pCur;		// where the next character is written
+	char* m_pLimit;		// the end of the current slab
+};
@@ -0,0 +1,450 @@
+#include "CsvColumnCache.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char CSV_CACHE_MAGIC[8] = { 'P', 'J', 'C', 'S', 'V', 'C', 0, 0 };
+
+// Rounds a size up to the 8 bytes every section is aligned to
+static uint64_t AlignSize(uint64_t nSize)
+{
+	return (nSize + 7) & ~static_cast<uint64_t>(7);
+}
+
+static uint64_t BitWordsSize(uint64_t nRows)
+{
+	return AlignSize((nRows + 31) / 32 * sizeof(uint32_t));
+}
+
+// Reads the size and modification time of a file
+static bool GetFileStamp(const char* szFileName, uint64_t& nSize, int64_t& nTime)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(szFileName, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(szFileName, &info) != 0)
+		return false;
+#endif
+	nSize = static_cast<uint64_t>(info.st_size);
+	nTime = static_cast<int64_t>(info.st_mtime);
+	return true;
+}
+
+// A 64-bit checksum taken 8 bytes at a time.  Bytes may be added in pieces
+// of any size, the sum only depends on the whole sequence.
+class CCacheChecksum
+{
+public:
+	CCacheChecksum() : m_nSum(0xcbf29ce484222325ULL), m_nCarry(0) {}
+
+	void Add(const void* pData, size_t nSize)
+	{
+		const char* p = static_cast<const char*>(pData);
+		while (m_nCarry != 0 && nSize > 0)
+		{
+			m_achCarry[m_nCarry++] = *p++;
+			nSize--;
+			if (m_nCarry == 8)
+			{
+				AddWord(m_achCarry);
+				m_nCarry = 0;
+			}
+		}
+		for (; nSize >= 8; p += 8, nSize -= 8)
+			AddWord(p);
+		while (nSize-- > 0)
+			m_achCarry[m_nCarry++] = *p++;
+	}
+
+	// Sections are padded to 8 bytes, so there is never a carry left
+	uint64_t GetSum() const { return m_nSum ^ m_nCarry; }
+
+private:
+	void AddWord(const char* p)
+	{
+		uint64_t nWord;
+		memcpy(&nWord, p, sizeof(nWord));
+		m_nSum = (m_nSum ^ nWord) * 0x100000001b3ULL;
+		m_nSum ^= m_nSum >> 29;
+	}
+
+	uint64_t m_nSum;
+	char m_achCarry[8];
+	int m_nCarry;
+};
+
+// Writes the sections of a cache and sums what it writes
+class CCacheWriter
+{
+public:
+	CCacheWriter(FILE* pFile) : m_pFile(pFile), m_nWritten(0), m_bFailed(false) {}
+
+	void Write(const void* pData, size_t nSize, CCacheChecksum& checksum)
+	{
+		if (nSize == 0)
+			return;
+		checksum.Add(pData, nSize);
+		m_bFailed = m_bFailed || fwrite(pData, 1, nSize, m_pFile) != nSize;
+		m_nWritten += nSize;
+	}
+
+	// Pads with zeros up to the next multiple of 8
+	void Pad(CCacheChecksum& checksum)
+	{
+		static const char achZeros[8] = { 0 };
+		Write(achZeros, static_cast<size_t>(AlignSize(m_nWritten) - m_nWritten), checksum);
+	}
+
+	uint64_t GetWritten() const { return m_nWritten; }
+	bool Failed() const { return m_bFailed; }
+
+private:
+	FILE* m_pFile;
+	uint64_t m_nWritten;
+	bool m_bFailed;
+};
+
+std::string GetCsvCacheFileName(const char* szSourceName)
+{
+	return std::string(szSourceName) + ".pjc";
+}
+
+CCsvColumnCache::CCsvColumnCache() : m_pData(NULL), m_pHeader(NULL), m_pColumns(NULL)
+{
+}
+
+CCsvColumnCache::~CCsvColumnCache()
+{
+}
+
+// The layout is planned first, then the sections are written in order and
+// the header with the checksums last.
+bool CCsvColumnCache::Write(const CCsvDataFile& df, const char* szCacheName, const char* szSourceName, std::string& strError)
+{
+	CsvCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_achMagic, CSV_CACHE_MAGIC, sizeof(header.m_achMagic));
+	header.m_nVersion = CSV_CACHE_VERSION;
+	header.m_nColumns = static_cast<uint32_t>(df.GetNumberOfVariables());
+	if (!GetFileStamp(szSourceName, header.m_nSourceSize, header.m_nSourceTime))
+	{
+		strError = std::string("Meet error when writing the cache, no such file: ") + szSourceName;
+		return false;
+	}
+
+	int nRows = df.GetNumberOfRows();
+	header.m_nRows = static_cast<uint64_t>(nRows);
+	int nBlocks = (nRows + CSV_CACHE_BLOCK_ROWS - 1) / CSV_CACHE_BLOCK_ROWS;
+
+	std::vector<CsvCacheColumn> vColumns(header.m_nColumns);
+	std::vector<std::string> vstrNames(header.m_nColumns);
+	std::vector<CsvIntColumn> vIntColumns(header.m_nColumns);
+	std::vector<CsvBoolColumn> vBoolColumns(header.m_nColumns);
+	uint64_t nOffset = sizeof(CsvCacheHeader) + header.m_nColumns * sizeof(CsvCacheColumn);
+	for (uint32_t iColumn = 0; iColumn < header.m_nColumns; iColumn++)
+	{
+		vstrNames[iColumn] = df.m_vstrVariableNames[iColumn];
+		memset(&vColumns[iColumn], 0, sizeof(CsvCacheColumn));
+		vColumns[iColumn].m_nNameOffset = nOffset;
+		vColumns[iColumn].m_nNameLength = static_cast<uint32_t>(vstrNames[iColumn].size());
+		nOffset += vstrNames[iColumn].size();
+	}
+	nOffset = AlignSize(nOffset);
+
+	for (uint32_t iColumn = 0; iColumn < header.m_nColumns; iColumn++)
+	{
+		if (df.GetNumberOfSamples(iColumn) != nRows)
+		{
+			strError = "Meet error when writing the cache, the columns have different lengths";
+			return false;
+		}
+
+		CsvCacheColumn& column = vColumns[iColumn];
+		uint64_t nTextSize = 0;
+		const char* pField;
+		int nLength;
+		for (int iRow = 0; iRow < nRows; iRow++)
+		{
+			if (df.GetField(iColumn, iRow, pField, nLength))
+				nTextSize += nLength;
+		}
+		column.m_nFieldEndsOffset = nOffset;
+		nOffset += static_cast<uint64_t>(nRows) * sizeof(uint64_t);
+		column.m_nTextOffset = nOffset;
+		nOffset = AlignSize(nOffset + nTextSize);
+
+		CsvColumnHandle hColumn;
+		hColumn.m_iVariable = static_cast<int>(iColumn);
+		column.m_nType = -1;
+		if (df.GetIntColumn(hColumn, vIntColumns[iColumn]))
+		{
+			column.m_nType = static_cast<int32_t>(CsvColumnType::Int32);
+			column.m_nValuesOffset = nOffset;
+			nOffset += AlignSize(static_cast<uint64_t>(nRows) * sizeof(int));
+		}
+		else if (df.GetBoolColumn(hColumn, vBoolColumns[iColumn]))
+		{
+			column.m_nType = static_cast<int32_t>(CsvColumnType::Bool);
+			column.m_nValuesOffset = nOffset;
+			nOffset += BitWordsSize(nRows);
+		}
+		if (column.m_nType != -1)
+		{
+			column.m_nValidOffset = nOffset;
+			nOffset += BitWordsSize(nRows);
+			column.m_nBlockStatsOffset = nOffset;
+			nOffset += static_cast<uint64_t>(nBlocks) * sizeof(CsvCacheBlockStats);
+		}
+	}
+	header.m_nFileSize = nOffset;
+
+	std::string strTempName = std::string(szCacheName) + ".tmp";
+	FILE* pFile = fopen(strTempName.c_str(), "wb");
+	if (pFile == NULL)
+	{
+		strError = "Meet error when writing the cache: " + strTempName;
+		return false;
+	}
+
+	CCacheWriter writer(pFile);
+	CCacheChecksum headerSum, schemaSum, dataSum;
+	writer.Write(&header, sizeof(header), headerSum);
+	if (!vColumns.empty())
+		writer.Write(&vColumns[0], vColumns.size() * sizeof(CsvCacheColumn), schemaSum);
+	for (uint32_t iColumn = 0; iColumn < header.m_nColumns; iColumn++)
+		writer.Write(vstrNames[iColumn].data(), vstrNames[iColumn].size(), schemaSum);
+	writer.Pad(schemaSum);
+
+	std::vector<uint64_t> vnEnds;
+	std::vector<CsvCacheBlockStats> vStats;
+	for (uint32_t iColumn = 0; iColumn < header.m_nColumns && !writer.Failed(); iColumn++)
+	{
+		const char* pField;
+		int nLength;
+		vnEnds.resize(nRows);
+		uint64_t nEnd = 0;
+		for (int iRow = 0; iRow < nRows; iRow++)
+		{
+			if (df.GetField(iColumn, iRow, pField, nLength))
+				nEnd += nLength;
+			vnEnds[iRow] = nEnd;
+		}
+		if (nRows > 0)
+			writer.Write(&vnEnds[0], nRows * sizeof(uint64_t), dataSum);
+		for (int iRow = 0; iRow < nRows; iRow++)
+		{
+			if (df.GetField(iColumn, iRow, pField, nLength))
+				writer.Write(pField, nLength, dataSum);
+		}
+		writer.Pad(dataSum);
+
+		const CsvCacheColumn& column = vColumns[iColumn];
+		if (column.m_nType == -1)
+			continue;
+
+		const uint32_t* pValidBits;
+		if (column.m_nType == static_cast<int32_t>(CsvColumnType::Int32))
+		{
+			writer.Write(vIntColumns[iColumn].m_pValues, nRows * sizeof(int), dataSum);
+			pValidBits = vIntColumns[iColumn].m_pValidBits;
+		}
+		else
+		{
+			writer.Write(vBoolColumns[iColumn].m_pBits, (nRows + 31) / 32 * sizeof(uint32_t), dataSum);
+			pValidBits = vBoolColumns[iColumn].m_pValidBits;
+		}
+		writer.Pad(dataSum);
+		writer.Write(pValidBits, (nRows + 31) / 32 * sizeof(uint32_t), dataSum);
+		writer.Pad(dataSum);
+
+		vStats.assign(nBlocks, CsvCacheBlockStats());
+		for (int iBlock = 0; iBlock < nBlocks; iBlock++)
+		{
+			CsvCacheBlockStats& stats = vStats[iBlock];
+			memset(&stats, 0, sizeof(stats));
+			int iEnd = nRows < (iBlock + 1) * CSV_CACHE_BLOCK_ROWS ? nRows : (iBlock + 1) * CSV_CACHE_BLOCK_ROWS;
+			for (int iRow = iBlock * CSV_CACHE_BLOCK_ROWS; iRow < iEnd; iRow++)
+			{
+				if (!IsBitSet(pValidBits, iRow))
+					continue;
+				int nValue = column.m_nType == static_cast<int32_t>(CsvColumnType::Int32) ? vIntColumns[iColumn].m_pValues[iRow]
+					: (vBoolColumns[iColumn].GetValue(iRow) ? 1 : 0);
+				stats.m_nMin = stats.m_nValid == 0 || nValue < stats.m_nMin ? nValue : stats.m_nMin;
+				stats.m_nMax = stats.m_nValid == 0 || nValue > stats.m_nMax ? nValue : stats.m_nMax;
+				stats.m_nValid++;
+			}
+		}
+		if (nBlocks > 0)
+			writer.Write(&vStats[0], nBlocks * sizeof(CsvCacheBlockStats), dataSum);
+	}
+
+	header.m_nSchemaChecksum = schemaSum.GetSum();
+	header.m_nDataChecksum = dataSum.GetSum();
+	bool bWritten = !writer.Failed() && writer.GetWritten() == header.m_nFileSize
+		&& fseek(pFile, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, pFile) == 1;
+	bWritten = fclose(pFile) == 0 && bWritten;
+
+	// the new cache replaces the old one in one step, so a reader sees the
+	// old cache or the whole new one
+#ifdef _WIN32
+	bWritten = bWritten && ::MoveFileExA(strTempName.c_str(), szCacheName, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bWritten = bWritten && rename(strTempName.c_str(), szCacheName) == 0;
+#endif
+	if (!bWritten)
+	{
+		std::remove(strTempName.c_str());
+		strError = std::string("Meet error when writing the cache: ") + szCacheName;
+		return false;
+	}
+	return true;
+}
+
+bool CCsvColumnCache::Open(const char* szCacheName, const char* szSourceName)
+{
+	uint64_t nSourceSize;
+	int64_t nSourceTime;
+	if (!GetFileStamp(szSourceName, nSourceSize, nSourceTime))
+		return false;
+
+	std::unique_ptr<CMappedFile> ptrFile(new CMappedFile());
+	if (!ptrFile->Open(szCacheName) || ptrFile->GetSize() < sizeof(CsvCacheHeader))
+		return false;
+
+	const char* pData = ptrFile->GetData();
+	const CsvCacheHeader* pHeader = reinterpret_cast<const CsvCacheHeader*>(pData);
+	if (memcmp(pHeader->m_achMagic, CSV_CACHE_MAGIC, sizeof(CSV_CACHE_MAGIC)) != 0 || pHeader->m_nVersion != CSV_CACHE_VERSION
+		|| pHeader->m_nFileSize != ptrFile->GetSize() || pHeader->m_nRows > 0x7fffffff
+		|| pHeader->m_nSourceSize != nSourceSize || pHeader->m_nSourceTime != nSourceTime)
+		return false;
+
+	uint64_t nSize = pHeader->m_nFileSize;
+	uint64_t nTableEnd = sizeof(CsvCacheHeader) + static_cast<uint64_t>(pHeader->m_nColumns) * sizeof(CsvCacheColumn);
+	if (nTableEnd > nSize)
+		return false;
+
+	// The names follow the table, the schema is checked as a whole
+	const CsvCacheColumn* pColumns = reinterpret_cast<const CsvCacheColumn*>(pData + sizeof(CsvCacheHeader));
+	uint64_t nNamesEnd = nTableEnd;
+	for (uint32_t i = 0; i < pHeader->m_nColumns; i++)
+		nNamesEnd += pColumns[i].m_nNameLength;
+	nNamesEnd = AlignSize(nNamesEnd);
+	if (nNamesEnd > nSize)
+		return false;
+	CCacheChecksum schemaSum;
+	schemaSum.Add(pData + sizeof(CsvCacheHeader), static_cast<size_t>(nNamesEnd - sizeof(CsvCacheHeader)));
+	if (schemaSum.GetSum() != pHeader->m_nSchemaChecksum)
+		return false;
+
+	// Every section must lie in the file, so a damaged cache can not be read past its end
+	uint64_t nRows = pHeader->m_nRows;
+	uint64_t nBlocks = (nRows + CSV_CACHE_BLOCK_ROWS - 1) / CSV_CACHE_BLOCK_ROWS;
+	for (uint32_t i = 0; i < pHeader->m_nColumns; i++)
+	{
+		const CsvCacheColumn& column = pColumns[i];
+		if (column.m_nNameOffset + column.m_nNameLength > nSize || column.m_nFieldEndsOffset % 8 != 0
+			|| column.m_nFieldEndsOffset + nRows * sizeof(uint64_t) > nSize || column.m_nTextOffset > nSize)
+			return false;
+		const uint64_t* pnEnds = reinterpret_cast<const uint64_t*>(pData + column.m_nFieldEndsOffset);
+		if (nRows > 0 && column.m_nTextOffset + pnEnds[nRows - 1] > nSize)
+			return false;
+		if (column.m_nType == -1)
+			continue;
+		uint64_t nValuesSize = column.m_nType == static_cast<int32_t>(CsvColumnType::Int32) ? nRows * sizeof(int) : BitWordsSize(nRows);
+		if ((column.m_nType != static_cast<int32_t>(CsvColumnType::Int32) && column.m_nType != static_cast<int32_t>(CsvColumnType::Bool))
+			|| column.m_nValuesOffset % 8 != 0 || column.m_nValuesOffset + nValuesSize > nSize
+			|| column.m_nValidOffset % 8 != 0 || column.m_nValidOffset + BitWordsSize(nRows) > nSize
+			|| column.m_nBlockStatsOffset % 8 != 0 || column.m_nBlockStatsOffset + nBlocks * sizeof(CsvCacheBlockStats) > nSize)
+			return false;
+	}
+
+	m_ptrFile = std::move(ptrFile);
+	m_pData = pData;
+	m_pHeader = pHeader;
+	m_pColumns = pColumns;
+	return true;
+}
+
+bool CCsvColumnCache::VerifyData() const
+{
+	uint64_t nNamesEnd = sizeof(CsvCacheHeader) + static_cast<uint64_t>(m_pHeader->m_nColumns) * sizeof(CsvCacheColumn);
+	for (uint32_t i = 0; i < m_pHeader->m_nColumns; i++)
+		nNamesEnd += m_pColumns[i].m_nNameLength;
+	nNamesEnd = AlignSize(nNamesEnd);
+
+	CCacheChecksum dataSum;
+	dataSum.Add(m_pData + nNamesEnd, static_cast<size_t>(m_pHeader->m_nFileSize - nNamesEnd));
+	return dataSum.GetSum() == m_pHeader->m_nDataChecksum;
+}
+
+std::string CCsvColumnCache::GetColumnName(int iColumn) const
+{
+	return std::string(m_pData + m_pColumns[iColumn].m_nNameOffset, m_pColumns[iColumn].m_nNameLength);
+}
+
+bool CCsvColumnCache::GetColumnType(int iColumn, CsvColumnType& eType) const
+{
+	if (m_pColumns[iColumn].m_nType == -1)
+		return false;
+	eType = static_cast<CsvColumnType>(m_pColumns[iColumn].m_nType);
+	return true;
+}
+
+bool CCsvColumnCache::GetField(int iColumn, int iRow, const char*& pField, int& nLength) const
+{
+	if (iColumn < 0 || iColumn >= GetNumberOfColumns() || iRow < 0 || iRow >= GetNumberOfRows())
+		return false;
+
+	// Open() checked that the text up to the last end lies in the file.  The
+	// ends are not read there, so a damaged cache whose ends do not grow is
+	// caught here instead of reading outside the text
+	const CsvCacheColumn& column = m_pColumns[iColumn];
+	const uint64_t* pnEnds = At<uint64_t>(column.m_nFieldEndsOffset);
+	uint64_t nBegin = iRow == 0 ? 0 : pnEnds[iRow - 1];
+	uint64_t nEnd = pnEnds[iRow];
+	if (nEnd < nBegin || nEnd > pnEnds[GetNumberOfRows() - 1] || nEnd - nBegin > 0x7fffffff)
+		return false;
+	pField = m_pData + column.m_nTextOffset + nBegin;
+	nLength = static_cast<int>(nEnd - nBegin);
+	return true;
+}
+
+bool CCsvColumnCache::GetIntColumn(int iColumn, CsvIntColumn& column) const
+{
+	if (m_pColumns[iColumn].m_nType != static_cast<int32_t>(CsvColumnType::Int32))
+		return false;
+	column.m_pValues = At<int>(m_pColumns[iColumn].m_nValuesOffset);
+	column.m_pValidBits = At<uint32_t>(m_pColumns[iColumn].m_nValidOffset);
+	column.m_nCount = GetNumberOfRows();
+	return true;
+}
+
+bool CCsvColumnCache::GetBoolColumn(int iColumn, CsvBoolColumn& column) const
+{
+	if (m_pColumns[iColumn].m_nType != static_cast<int32_t>(CsvColumnType::Bool))
+		return false;
+	column.m_pBits = At<uint32_t>(m_pColumns[iColumn].m_nValuesOffset);
+	column.m_pValidBits = At<uint32_t>(m_pColumns[iColumn].m_nValidOffset);
+	column.m_nCount = GetNumberOfRows();
+	return true;
+}
+
+bool CCsvColumnCache::GetBlockStats(int iColumn, int iBlock, CsvCacheBlockStats& stats) const
+{
+	int nBlocks = (GetNumberOfRows() + CSV_CACHE_BLOCK_ROWS - 1) / CSV_CACHE_BLOCK_ROWS;
+	if (m_pColumns[iColumn].m_nType == -1 || iBlock < 0 || iBlock >= nBlocks)
+		return false;
+	stats = At<CsvCacheBlockStats>(m_pColumns[iColumn].m_nBlockStatsOffset)[iBlock];
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "CSVDataFile.h"
+
+class CMappedFile;
+
+// Rows summarized by one CsvCacheBlockStats of a typed column
+const static int CSV_CACHE_BLOCK_ROWS = 65536;
+
+// Version of the cache layout, a cache of another version is ignored
+const static uint32_t CSV_CACHE_VERSION = 1;
+
+// The start of a column cache file.  Every offset is from the start of the
+// file and a multiple of 8, so the columns can be used where they are mapped.
+struct CsvCacheHeader
+{
+	char m_achMagic[8];          // "PJCSVC\0\0"
+	uint32_t m_nVersion;
+	uint32_t m_nColumns;
+	uint64_t m_nRows;
+	uint64_t m_nSourceSize;      // size and modification time of the CSV file
+	int64_t m_nSourceTime;
+	uint64_t m_nFileSize;        // size of the cache file
+	uint64_t m_nSchemaChecksum;  // of the column table and the names
+	uint64_t m_nDataChecksum;    // of everything after the names
+};
+
+// One column of a cache: the text of every cell, and for a typed column its
+// values, valid bits and the range of every block of rows.
+struct CsvCacheColumn
+{
+	uint64_t m_nNameOffset;
+	uint32_t m_nNameLength;
+	int32_t m_nType;             // a CsvColumnType, -1 for a text only column
+	uint64_t m_nFieldEndsOffset; // uint64_t per row, end of its text
+	uint64_t m_nTextOffset;
+	uint64_t m_nValuesOffset;    // int per row, or a bit per row for Bool
+	uint64_t m_nValidOffset;     // a bit per row
+	uint64_t m_nBlockStatsOffset;// CsvCacheBlockStats per CSV_CACHE_BLOCK_ROWS rows
+};
+
+// Range of the valid values of a block of rows of a typed column
+struct CsvCacheBlockStats
+{
+	int32_t m_nMin;
+	int32_t m_nMax;
+	uint32_t m_nValid;           // rows with a valid value, m_nMin and m_nMax are 0 if none
+	uint32_t m_nReserved;
+};
+
+// Returns the name of the cache written for a CSV file.
+std::string GetCsvCacheFileName(const char* szSourceName);
+
+// A column cache written by CCsvDataFile after it parsed a file.  Opening
+// it maps the file and checks its header, so reloading costs the same
+// whatever the number of rows; the cells are read where they are mapped.
+class CCsvColumnCache
+{
+public:
+	CCsvColumnCache();
+	~CCsvColumnCache();
+
+	// Writes the variables and typed columns of a loaded file to szCacheName,
+	// stamped with the size and time of szSourceName.
+	static bool Write(const CCsvDataFile& df, const char* szCacheName, const char* szSourceName, std::string& strError);
+
+	// Maps a cache.  Returns false if it can not be read, is of another
+	// version, or szSourceName changed size or time since it was written.
+	bool Open(const char* szCacheName, const char* szSourceName);
+
+	// Checks the checksum of the data, which Open() does not read.
+	bool VerifyData() const;
+
+	int GetNumberOfColumns() const { return static_cast<int>(m_pHeader->m_nColumns); }
+	int GetNumberOfRows() const { return static_cast<int>(m_pHeader->m_nRows); }
+	std::string GetColumnName(int iColumn) const;
+	// Returns the type of a column, false for a text only column.
+	bool GetColumnType(int iColumn, CsvColumnType& eType) const;
+
+	// Points pField at the text of a cell.  Returns false if the row or
+	// column is out of range, or the cell is damaged.
+	bool GetField(int iColumn, int iRow, const char*& pField, int& nLength) const;
+
+	// Views of a typed column, false if the column has not this type.
+	bool GetIntColumn(int iColumn, CsvIntColumn& column) const;
+	bool GetBoolColumn(int iColumn, CsvBoolColumn& column) const;
+
+	// The value range of the rows iBlock * CSV_CACHE_BLOCK_ROWS and on of a
+	// typed column, so blocks without wanted values can be skipped.
+	bool GetBlockStats(int iColumn, int iBlock, CsvCacheBlockStats& stats) const;
+
+private:
+	CCsvColumnCache(const CCsvColumnCache&);
+	CCsvColumnCache& operator=(const CCsvColumnCache&);
+
+	template <class T>
+	const T* At(uint64_t nOffset) const { return reinterpret_cast<const T*>(m_pData + nOffset); }
+
+	std::unique_ptr<CMappedFile> m_ptrFile;
+	const char* m_pData;
+	const CsvCacheHeader* m_pHeader;
+	const CsvCacheColumn* m_pColumns;
+};
@@ -0,0 +1,155 @@
+#include "CsvFieldConvert.h"
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// "true" and "fals" as the little endian words LoadWord() returns for them
+static const uint32_t TRUE_WORD = 0x65757274;
+static const uint32_t FALS_WORD = 0x736c6166;
+
+// Setting this bit turns an upper case ASCII letter into lower case
+static const uint32_t LOWER_CASE_BITS = 0x20202020;
+
+// White space as isspace() finds it in the "C" locale, whatever the
+// locale of the process is.
+static bool IsCsvSpace(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Reads 4 or 8 bytes of a field in little endian order, the field does not
+// need to be aligned.
+static uint32_t LoadWord(const char* p)
+{
+	uint32_t nWord;
+	memcpy(&nWord, p, sizeof(nWord));
+	return nWord;
+}
+
+static uint64_t LoadWord64(const char* p)
+{
+	uint64_t nWord;
+	memcpy(&nWord, p, sizeof(nWord));
+	return nWord;
+}
+
+// Returns whether the 8 bytes of a word are all '0' to '9': the high nibble
+// of each must be 3, and adding 6 to the low nibble must not carry into it.
+static bool IsEightDigits(uint64_t nWord)
+{
+	return (((nWord & 0xF0F0F0F0F0F0F0F0ULL) | (((nWord + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+		== 0x3333333333333333ULL);
+}
+
+// Returns the value of 8 digits read by LoadWord64(), the first digit being
+// the most significant.  Pairs of digits, then of pairs and so on are
+// combined with a multiply each instead of one digit at a time.
+static uint32_t ParseEightDigits(uint64_t nWord)
+{
+	nWord = ((nWord & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+	nWord = ((nWord & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+	return static_cast<uint32_t>(((nWord & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32);
+}
+
+bool ConvertCsvInt(const char* pField, int nLength, int& iValue)
+{
+	iValue = 0;
+	if (nLength == 0)
+		return true;
+
+	const char* p = pField;
+	const char* pEnd = pField + nLength;
+	while (p < pEnd && IsCsvSpace(*p))
+		p++;
+
+	bool bNegative = false;
+	if (p < pEnd && (*p == '-' || *p == '+'))
+	{
+		bNegative = *p == '-';
+		p++;
+	}
+	if (p == pEnd)
+		return false;
+
+	// INT_MAX + 1 is allowed for "-2147483648".  Once the magnitude is past
+	// it every further digit only makes it larger, so the value overflowed;
+	// checking before each step keeps nMagnitude far from overflowing itself.
+	const uint64_t nLimit = static_cast<uint64_t>(INT_MAX) + (bNegative ? 1 : 0);
+	uint64_t nMagnitude = 0;
+	while (pEnd - p >= 8)
+	{
+		uint64_t nWord = LoadWord64(p);
+		if (!IsEightDigits(nWord))
+			break;
+		nMagnitude = nMagnitude * 100000000 + ParseEightDigits(nWord);
+		if (nMagnitude > nLimit)
+			return false;
+		p += 8;
+	}
+	for (; p < pEnd; p++)
+	{
+		unsigned int nDigit = static_cast<unsigned char>(*p) - '0';
+		if (nDigit > 9)
+			return false;
+		nMagnitude = nMagnitude * 10 + nDigit;
+		if (nMagnitude > nLimit)
+			return false;
+	}
+
+	int64_t nValue = static_cast<int64_t>(nMagnitude);
+	iValue = static_cast<int>(bNegative ? -nValue : nValue);
+	return true;
+}
+
+// Returns the field as a terminated string for strtod, copied into buff if
+// it fits and into strLong if not.
+static const char* TerminateField(const char* pField, int nLength, char* buff, int size, std::string& strLong)
+{
+	if (nLength < size)
+	{
+		memcpy(buff, pField, nLength);
+		buff[nLength] = '\0';
+		return buff;
+	}
+	strLong.assign(pField, nLength);
+	return strLong.c_str();
+}
+
+bool ConvertCsvFloat(const char* pField, int nLength, float& fValue)
+{
+	fValue = 0;
+	if (nLength == 0)
+		return true;
+
+	char buff[64];
+	std::string strLong;
+	const char* szField = TerminateField(pField, nLength, buff, sizeof(buff), strLong);
+
+	char *numberValidCheck;
+	fValue = static_cast<float>(std::strtod(szField, &numberValidCheck));
+	return *numberValidCheck == '\0';
+}
+
+bool ConvertCsvBool(const char* pField, int nLength, bool& bValue)
+{
+	// trim the space in the begin and end
+	while (nLength > 0 && IsCsvSpace(*pField))
+	{
+		pField++;
+		nLength--;
+	}
+	while (nLength > 0 && IsCsvSpace(pField[nLength - 1]))
+		nLength--;
+
+	// Only letters are compared, and of each letter only its upper and lower
+	// case give the same byte once the case bit is set.
+	if (nLength == 4 && (LoadWord(pField) | LOWER_CASE_BITS) == TRUE_WORD)
+		bValue = true;
+	else if (nLength == 5 && (LoadWord(pField) | LOWER_CASE_BITS) == FALS_WORD && (pField[4] | 0x20) == 'e')
+		bValue = false;
+	else
+		return false;
+	return true;
+}
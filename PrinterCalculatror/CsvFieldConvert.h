@@ -0,0 +1,20 @@
+#pragma once
+
+// Conversion of the raw bytes of a field, shared by the GetData() overloads
+// and the typed columns of CCsvDataFile so that both accept the same values.
+
+// Converts a field to an int.  An empty field is 0, leading white space is
+// skipped and anything after the digits ("12ab") is rejected.  The digits
+// are read straight from the field, 8 at a time when it has that many, and
+// the locale is not used.
+// Returns false if the field is not an int or does not fit in one.
+bool ConvertCsvInt(const char* pField, int nLength, int& iValue);
+
+// Converts a field to a float like ConvertCsvInt() does to an int.
+// Returns false if the field is not a number.
+bool ConvertCsvFloat(const char* pField, int nLength, float& fValue);
+
+// Converts "true" or "false" in any case, with optional white space around.
+// The trimmed field is compared as one word whatever its case.
+// Returns false if the field is not a bool, including an empty field.
+bool ConvertCsvBool(const char* pField, int nLength, bool& bValue);
@@ -0,0 +1,212 @@
+#include "CsvScanner.h"
+#include "CpuFeatures.h"
+#include <cstring>
+
+#if defined(CPU_HAS_X86_SIMD)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Returns the index of the lowest set bit, nMask must not be 0.
+static int LowestBit(uint64_t nMask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long nIndex;
+	_BitScanForward64(&nIndex, nMask);
+	return static_cast<int>(nIndex);
+#elif defined(_MSC_VER)
+	unsigned long nIndex;
+	if (_BitScanForward(&nIndex, static_cast<unsigned long>(nMask)))
+		return static_cast<int>(nIndex);
+	_BitScanForward(&nIndex, static_cast<unsigned long>(nMask >> 32));
+	return static_cast<int>(nIndex) + 32;
+#else
+	return __builtin_ctzll(nMask);
+#endif
+}
+
+// Returns the number of set bits.
+static int CountBits(uint64_t nMask)
+{
+	nMask = nMask - ((nMask >> 1) & 0x5555555555555555ULL);
+	nMask = (nMask & 0x3333333333333333ULL) + ((nMask >> 2) & 0x3333333333333333ULL);
+	nMask = (nMask + (nMask >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<int>((nMask * 0x0101010101010101ULL) >> 56);
+}
+
+// Portable kernel, also used as the reference for the vectorized ones.
+static void ScanBlockScalar(const char* p, char delimiter, CsvBlockMasks& masks)
+{
+	masks.m_nDelimiters = 0;
+	masks.m_nQuotes = 0;
+	masks.m_nNewLines = 0;
+	masks.m_nBackslashes = 0;
+
+	for (int i = 0; i < CCsvScanner::BLOCK_SIZE; i++)
+	{
+		uint64_t nBit = static_cast<uint64_t>(1) << i;
+		char cc = p[i];
+		if (cc == delimiter)
+			masks.m_nDelimiters |= nBit;
+		else if (cc == '"')
+			masks.m_nQuotes |= nBit;
+		else if (cc == '\r' || cc == '\n')
+			masks.m_nNewLines |= nBit;
+		else if (cc == '\\')
+			masks.m_nBackslashes |= nBit;
+	}
+}
+
+#if defined(CPU_HAS_X86_SIMD)
+
+// Returns the mask of the bytes of the 16-byte chunk equal to cc.
+static uint64_t MatchSse(__m128i chunk, __m128i cc)
+{
+	return static_cast<uint64_t>(static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, cc))));
+}
+
+// 128-bit kernel, four chunks per block.
+static void ScanBlockSse(const char* p, char delimiter, CsvBlockMasks& masks)
+{
+	const __m128i vDelim = _mm_set1_epi8(delimiter);
+	const __m128i vQuote = _mm_set1_epi8('"');
+	const __m128i vCR = _mm_set1_epi8('\r');
+	const __m128i vLF = _mm_set1_epi8('\n');
+	const __m128i vBackslash = _mm_set1_epi8('\\');
+
+	masks.m_nDelimiters = 0;
+	masks.m_nQuotes = 0;
+	masks.m_nNewLines = 0;
+	masks.m_nBackslashes = 0;
+
+	for (int i = 0; i < CCsvScanner::BLOCK_SIZE; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+		masks.m_nDelimiters |= MatchSse(chunk, vDelim) << i;
+		masks.m_nQuotes |= MatchSse(chunk, vQuote) << i;
+		masks.m_nNewLines |= (MatchSse(chunk, vCR) | MatchSse(chunk, vLF)) << i;
+		masks.m_nBackslashes |= MatchSse(chunk, vBackslash) << i;
+	}
+}
+
+// Returns the mask of the bytes of the 64-byte block (lo, hi) equal to cc.
+CPU_TARGET_AVX2 static uint64_t MatchAvx2(__m256i lo, __m256i hi, __m256i cc)
+{
+	uint64_t nLo = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, cc)));
+	uint64_t nHi = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, cc)));
+	return nLo | (nHi << 32);
+}
+
+// 256-bit kernel, two halves per block.
+CPU_TARGET_AVX2 static void ScanBlockAvx2(const char* p, char delimiter, CsvBlockMasks& masks)
+{
+	__m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+	__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+
+	masks.m_nDelimiters = MatchAvx2(lo, hi, _mm256_set1_epi8(delimiter));
+	masks.m_nQuotes = MatchAvx2(lo, hi, _mm256_set1_epi8('"'));
+	masks.m_nNewLines = MatchAvx2(lo, hi, _mm256_set1_epi8('\r')) | MatchAvx2(lo, hi, _mm256_set1_epi8('\n'));
+	masks.m_nBackslashes = MatchAvx2(lo, hi, _mm256_set1_epi8('\\'));
+}
+
+#endif
+
+CsvScanKernel GetBestCsvScanKernel()
+{
+	const CpuFeatures& features = GetCpuFeatures();
+	if (features.m_bAvx2)
+		return CsvScanKernel::AVX2;
+	if (features.m_bSse2)
+		return CsvScanKernel::SSE;
+	return CsvScanKernel::Scalar;
+}
+
+CCsvScanner::CCsvScanner(char delimiter, CsvScanKernel eKernel)
+	: m_delim(delimiter)
+	, m_eKernel(CsvScanKernel::Scalar)
+	, m_fnScanBlock(ScanBlockScalar)
+	, m_pBlock(NULL)
+	, m_pBlockEnd(NULL)
+{
+	// never pick a kernel the CPU can't run
+	if (eKernel > GetBestCsvScanKernel())
+		eKernel = GetBestCsvScanKernel();
+
+#if defined(CPU_HAS_X86_SIMD)
+	if (eKernel == CsvScanKernel::AVX2)
+		m_fnScanBlock = ScanBlockAvx2;
+	else if (eKernel == CsvScanKernel::SSE)
+		m_fnScanBlock = ScanBlockSse;
+	else
+		eKernel = CsvScanKernel::Scalar;
+#else
+	eKernel = CsvScanKernel::Scalar;
+#endif
+	m_eKernel = eKernel;
+	memset(&m_masks, 0, sizeof(m_masks));
+}
+
+void CCsvScanner::ScanBlock(const char* p, CsvBlockMasks& masks) const
+{
+	m_fnScanBlock(p, m_delim, masks);
+}
+
+void CCsvScanner::LoadBlock(const char* p, const char* pEnd)
+{
+	m_pBlock = p;
+	if (pEnd - p >= BLOCK_SIZE)
+	{
+		m_pBlockEnd = p + BLOCK_SIZE;
+		m_fnScanBlock(p, m_delim, m_masks);
+		return;
+	}
+
+	// the tail of the buffer is scanned from a copy so no byte past pEnd is read;
+	// the padding is masked off because the delimiter might be '\0'
+	char block[BLOCK_SIZE] = { 0 };
+	int nLength = static_cast<int>(pEnd - p);
+	memcpy(block, p, nLength);
+	m_pBlockEnd = pEnd;
+	m_fnScanBlock(block, m_delim, m_masks);
+
+	uint64_t nValid = (static_cast<uint64_t>(1) << nLength) - 1;
+	m_masks.m_nDelimiters &= nValid;
+	m_masks.m_nQuotes &= nValid;
+	m_masks.m_nNewLines &= nValid;
+	m_masks.m_nBackslashes &= nValid;
+}
+
+const char* CCsvScanner::FindFieldEnd(const char* p, const char* pEnd, bool bStopAtDelimiter)
+{
+	while (p < pEnd)
+	{
+		if (p < m_pBlock || p >= m_pBlockEnd)
+			LoadBlock(p, pEnd);
+
+		uint64_t nMask = m_masks.m_nNewLines | m_masks.m_nBackslashes;
+		if (bStopAtDelimiter)
+			nMask |= m_masks.m_nDelimiters;
+
+		// drop the bytes of the block before p
+		nMask &= ~static_cast<uint64_t>(0) << (p - m_pBlock);
+		if (nMask != 0)
+			return m_pBlock + LowestBit(nMask);
+
+		p = m_pBlockEnd;
+	}
+	return pEnd;
+}
+
+int CCsvScanner::CountQuotes(const char* p, const char* pEnd)
+{
+	int nQuotes = 0;
+	for (; p < pEnd; p = m_pBlockEnd)
+	{
+		LoadBlock(p, pEnd);
+		nQuotes += CountBits(m_masks.m_nQuotes);
+	}
+	return nQuotes;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+
+// Implementations of the block scan, from slowest to fastest.
+enum class CsvScanKernel
+{
+	Scalar = 0,
+	SSE,
+	AVX2
+};
+
+// Returns the fastest kernel the running CPU supports.
+CsvScanKernel GetBestCsvScanKernel();
+
+// Bitmaps of the structural characters of a 64-byte block.
+// Bit i is set if byte i of the block is of that class.
+struct CsvBlockMasks
+{
+	uint64_t m_nDelimiters;
+	uint64_t m_nQuotes;
+	uint64_t m_nNewLines;      // both '\r' and '\n'
+	uint64_t m_nBackslashes;
+};
+
+// Finds the delimiters, quotes, line ends and backslashes of a buffer
+// 64 bytes at a time, so the parser can jump from one structural character
+// to the next instead of testing every byte.
+class CCsvScanner
+{
+public:
+	static const int BLOCK_SIZE = 64;
+
+	CCsvScanner(char delimiter, CsvScanKernel eKernel = GetBestCsvScanKernel());
+
+	// Fills the masks of the BLOCK_SIZE bytes starting at p.
+	// The bytes from p to p + BLOCK_SIZE must be readable.
+	void ScanBlock(const char* p, CsvBlockMasks& masks) const;
+
+	// Returns the first delimiter, '\r', '\n' or '\\' at or after p, or pEnd
+	// if there is none.  Delimiters are skipped if bStopAtDelimiter is false.
+	// The masks of the last block are kept, so consecutive calls moving
+	// forward through a buffer scan every byte once.
+	const char* FindFieldEnd(const char* p, const char* pEnd, bool bStopAtDelimiter);
+
+	// Returns the number of '"' characters from p up to pEnd.
+	int CountQuotes(const char* p, const char* pEnd);
+
+	CsvScanKernel GetKernel() const { return m_eKernel; }
+
+private:
+	typedef void(*ScanBlockFn)(const char* p, char delimiter, CsvBlockMasks& masks);
+
+	// Scans the block starting at p, padding it if less than BLOCK_SIZE
+	// bytes are left before pEnd.
+	void LoadBlock(const char* p, const char* pEnd);
+
+	char m_delim;
+	CsvScanKernel m_eKernel;
+	ScanBlockFn m_fnScanBlock;
+
+	// the block whose masks are cached
+	const char* m_pBlock;
+	const char* m_pBlockEnd;
+	CsvBlockMasks m_masks;
+};
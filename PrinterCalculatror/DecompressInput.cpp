@@ -0,0 +1,288 @@
+#include "DecompressInput.h"
+#include <cstring>
+
+#ifdef PRINTER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PRINTER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Compressed bytes read from the file at a time
+static const size_t COMPRESSED_READ_SIZE = 256 * 1024;
+
+CompressionFormat DetectCompression(const char* szFilename)
+{
+	FILE* pFile = fopen(szFilename, "rb");
+	if (pFile == NULL)
+		return CompressionFormat::None;
+
+	unsigned char achMagic[4] = { 0 };
+	size_t nRead = fread(achMagic, 1, sizeof(achMagic), pFile);
+	fclose(pFile);
+
+	if (nRead >= 2 && achMagic[0] == 0x1f && achMagic[1] == 0x8b)
+		return CompressionFormat::Gzip;
+	if (nRead == 4 && achMagic[0] == 0x28 && achMagic[1] == 0xb5 && achMagic[2] == 0x2f && achMagic[3] == 0xfd)
+		return CompressionFormat::Zstd;
+	return CompressionFormat::None;
+}
+
+bool IsCompressionSupported(CompressionFormat eFormat)
+{
+	switch (eFormat)
+	{
+	case CompressionFormat::None:
+		return true;
+#ifdef PRINTER_HAVE_ZLIB
+	case CompressionFormat::Gzip:
+		return true;
+#endif
+#ifdef PRINTER_HAVE_ZSTD
+	case CompressionFormat::Zstd:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+CDecompressStreamBuf::CDecompressStreamBuf()
+	: m_pFile(NULL)
+	, m_eFormat(CompressionFormat::None)
+	, m_iWrite(0)
+	, m_iRead(0)
+	, m_bReading(false)
+	, m_bDone(false)
+	, m_bStop(false)
+{
+}
+
+CDecompressStreamBuf::~CDecompressStreamBuf()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cvChanged.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+	if (m_pFile != NULL)
+		fclose(m_pFile);
+}
+
+bool CDecompressStreamBuf::Open(const char* szFilename, CompressionFormat eFormat)
+{
+	if (eFormat == CompressionFormat::None || !IsCompressionSupported(eFormat) || m_pFile != NULL)
+		return false;
+
+	m_pFile = fopen(szFilename, "rb");
+	if (m_pFile == NULL)
+		return false;
+
+	m_eFormat = eFormat;
+	m_aBlocks[0].m_vData.resize(DECOMPRESS_BLOCK_SIZE);
+	m_aBlocks[1].m_vData.resize(DECOMPRESS_BLOCK_SIZE);
+	m_thread = std::thread(&CDecompressStreamBuf::Decompress, this);
+	return true;
+}
+
+std::string CDecompressStreamBuf::GetError()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_strError;
+}
+
+void CDecompressStreamBuf::SetError(const std::string& strError)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_strError.empty())
+		m_strError = strError;
+}
+
+CDecompressStreamBuf::int_type CDecompressStreamBuf::underflow()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_bReading)
+	{
+		m_aBlocks[m_iRead].m_bFull = false;
+		m_iRead ^= 1;
+		m_bReading = false;
+		m_cvChanged.notify_all();
+	}
+
+	while (!m_aBlocks[m_iRead].m_bFull && !m_bDone)
+		m_cvChanged.wait(lock);
+	if (!m_aBlocks[m_iRead].m_bFull)
+		return traits_type::eof();
+
+	Block& block = m_aBlocks[m_iRead];
+	m_bReading = true;
+	setg(&block.m_vData[0], &block.m_vData[0], &block.m_vData[0] + block.m_nSize);
+	return traits_type::to_int_type(block.m_vData[0]);
+}
+
+bool CDecompressStreamBuf::EmitBlock(size_t nSize)
+{
+	if (nSize == 0)
+		return true;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_aBlocks[m_iWrite].m_nSize = nSize;
+	m_aBlocks[m_iWrite].m_bFull = true;
+	m_iWrite ^= 1;
+	m_cvChanged.notify_all();
+
+	while (m_aBlocks[m_iWrite].m_bFull && !m_bStop)
+		m_cvChanged.wait(lock);
+	return !m_bStop;
+}
+
+void CDecompressStreamBuf::Decompress()
+{
+	if (m_eFormat == CompressionFormat::Gzip)
+		DecompressGzip();
+	else if (m_eFormat == CompressionFormat::Zstd)
+		DecompressZstd();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bDone = true;
+	m_cvChanged.notify_all();
+}
+
+// Reads every gzip member of the file, as gzip does for concatenated files
+bool CDecompressStreamBuf::DecompressGzip()
+{
+#ifdef PRINTER_HAVE_ZLIB
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, 15 + 16) != Z_OK)
+	{
+		SetError("Meet error when starting the gzip decompression");
+		return false;
+	}
+
+	std::vector<unsigned char> vInput(COMPRESSED_READ_SIZE);
+	stream.next_out = reinterpret_cast<Bytef*>(GetWriteBlock());
+	stream.avail_out = DECOMPRESS_BLOCK_SIZE;
+	bool bInMember = false;
+	bool bMoreOutput = false;	// a full block may leave output in the inflater
+	bool bOk = true;
+	for (;;)
+	{
+		if (stream.avail_in == 0 && !bMoreOutput)
+		{
+			stream.avail_in = static_cast<uInt>(fread(&vInput[0], 1, vInput.size(), m_pFile));
+			stream.next_in = &vInput[0];
+			if (stream.avail_in == 0)
+			{
+				if (bInMember || ferror(m_pFile))
+				{
+					SetError("The gzip data ends in the middle of the file");
+					bOk = false;
+				}
+				break;
+			}
+		}
+
+		// a call only flushing a full block may follow the end of a member
+		if (stream.avail_in > 0)
+			bInMember = true;
+		int nResult = inflate(&stream, Z_NO_FLUSH);
+		if (nResult == Z_STREAM_END)
+		{
+			bInMember = false;
+			inflateReset(&stream);
+		}
+		else if (nResult != Z_OK && nResult != Z_BUF_ERROR)
+		{
+			SetError(std::string("The gzip data is damaged: ") + (stream.msg != NULL ? stream.msg : "unknown error"));
+			bOk = false;
+			break;
+		}
+
+		bMoreOutput = stream.avail_out == 0;
+		if (bMoreOutput)
+		{
+			if (!EmitBlock(DECOMPRESS_BLOCK_SIZE))
+			{
+				bOk = false;
+				break;
+			}
+			stream.next_out = reinterpret_cast<Bytef*>(GetWriteBlock());
+			stream.avail_out = DECOMPRESS_BLOCK_SIZE;
+		}
+	}
+	if (bOk)
+		bOk = EmitBlock(DECOMPRESS_BLOCK_SIZE - stream.avail_out);
+	inflateEnd(&stream);
+	return bOk;
+#else
+	SetError("This build can not read gzip files");
+	return false;
+#endif
+}
+
+// Reads every zstd frame of the file
+bool CDecompressStreamBuf::DecompressZstd()
+{
+#ifdef PRINTER_HAVE_ZSTD
+	ZSTD_DCtx* pContext = ZSTD_createDCtx();
+	if (pContext == NULL)
+	{
+		SetError("Meet error when starting the zstd decompression");
+		return false;
+	}
+
+	std::vector<char> vInput(ZSTD_DStreamInSize());
+	ZSTD_inBuffer input = { &vInput[0], 0, 0 };
+	ZSTD_outBuffer output = { GetWriteBlock(), DECOMPRESS_BLOCK_SIZE, 0 };
+	size_t nHint = 0;	// 0 once a frame is complete
+	bool bMoreOutput = false;	// a full block may leave output in the context
+	bool bOk = true;
+	for (;;)
+	{
+		if (input.pos == input.size && !bMoreOutput)
+		{
+			input.size = fread(&vInput[0], 1, vInput.size(), m_pFile);
+			input.pos = 0;
+			if (input.size == 0)
+			{
+				if (nHint != 0 || ferror(m_pFile))
+				{
+					SetError("The zstd data ends in the middle of the file");
+					bOk = false;
+				}
+				break;
+			}
+		}
+
+		nHint = ZSTD_decompressStream(pContext, &output, &input);
+		if (ZSTD_isError(nHint))
+		{
+			SetError(std::string("The zstd data is damaged: ") + ZSTD_getErrorName(nHint));
+			bOk = false;
+			break;
+		}
+
+		bMoreOutput = output.pos == output.size;
+		if (bMoreOutput)
+		{
+			if (!EmitBlock(output.pos))
+			{
+				bOk = false;
+				break;
+			}
+			output.dst = GetWriteBlock();
+			output.pos = 0;
+		}
+	}
+	if (bOk)
+		bOk = EmitBlock(output.pos);
+	ZSTD_freeDCtx(pContext);
+	return bOk;
+#else
+	SetError("This build can not read zstd files");
+	return false;
+#endif
+}
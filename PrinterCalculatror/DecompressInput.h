@@ -0,0 +1,89 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compression of a file, found from its first bytes.
+enum class CompressionFormat
+{
+	None = 0,
+	Gzip,   // 1f 8b, read when built with PRINTER_HAVE_ZLIB
+	Zstd    // 28 b5 2f fd, read when built with PRINTER_HAVE_ZSTD
+};
+
+// Size of each of the two blocks a CDecompressStreamBuf decompresses into.
+const static int DECOMPRESS_BLOCK_SIZE = 1 << 20;
+
+// Returns the compression of a file from its magic bytes, None if it is not
+// compressed or can not be read.
+CompressionFormat DetectCompression(const char* szFilename);
+
+// Returns whether this build can decompress eFormat.
+bool IsCompressionSupported(CompressionFormat eFormat);
+
+// The decompressed bytes of a file, read through a std::istream.  A thread
+// decompresses into one block while the reader parses the other, so the
+// decompression overlaps with the parsing.
+class CDecompressStreamBuf : public std::streambuf
+{
+public:
+	CDecompressStreamBuf();
+
+	// Stops the decompression thread.
+	~CDecompressStreamBuf();
+
+	// Opens the file and starts decompressing it.  Returns false if the file
+	// can not be opened or the format is not supported by this build.
+	bool Open(const char* szFilename, CompressionFormat eFormat);
+
+	// Returns why the decompression stopped before the end of the data,
+	// empty if it did not.  Read it once the stream is at its end.
+	std::string GetError();
+
+protected:
+	// Hands the block just read back to the thread and waits for the next.
+	int_type underflow();
+
+private:
+	CDecompressStreamBuf(const CDecompressStreamBuf&);
+	CDecompressStreamBuf& operator=(const CDecompressStreamBuf&);
+
+	// A block of decompressed bytes, full when it waits for the reader
+	struct Block
+	{
+		Block() : m_nSize(0), m_bFull(false) {}
+		std::vector<char> m_vData;
+		size_t m_nSize;
+		bool m_bFull;
+	};
+
+	// The body of the thread.
+	void Decompress();
+	bool DecompressGzip();
+	bool DecompressZstd();
+
+	// Hands the nSize bytes of the block being written to the reader and
+	// waits until the other block is free.  Returns false when stopping.
+	bool EmitBlock(size_t nSize);
+	char* GetWriteBlock() { return &m_aBlocks[m_iWrite].m_vData[0]; }
+
+	// Records why the decompression stopped, under the lock.
+	void SetError(const std::string& strError);
+
+	FILE* m_pFile;
+	CompressionFormat m_eFormat;
+	Block m_aBlocks[2];
+	int m_iWrite;         // block the thread writes, used by the thread only
+	int m_iRead;          // block the reader reads, used by the reader only
+	bool m_bReading;      // the reader holds m_aBlocks[m_iRead]
+	bool m_bDone;         // the thread wrote its last block
+	bool m_bStop;         // the reader is gone
+	std::string m_strError;
+	std::mutex m_mutex;
+	std::condition_variable m_cvChanged;
+	std::thread m_thread;
+};
@@ -0,0 +1,121 @@
+#include "JobGroupTable.h"
+#include <cstring>
+
+// Slots of an empty table, a power of 2
+static const size_t MIN_GROUP_SLOTS = 64;
+
+// FNV-1a, good enough for the short keys of a group
+static uint64_t HashGroupKey(const char* pKey, int nKey)
+{
+	uint64_t nHash = 14695981039346656037ULL;
+	for (int i = 0; i < nKey; i++)
+	{
+		nHash ^= static_cast<unsigned char>(pKey[i]);
+		nHash *= 1099511628211ULL;
+	}
+	return nHash;
+}
+
+static uint32_t GetSlotTag(uint64_t nHash)
+{
+	return static_cast<uint32_t>(nHash >> 32);
+}
+
+CJobGroupTable::CJobGroupTable()
+{
+	Clear();
+}
+
+size_t CJobGroupTable::FindSlot(uint64_t nHash, const char* pKey, int nKey) const
+{
+	size_t nMask = m_vSlots.size() - 1;
+	uint32_t nTag = GetSlotTag(nHash);
+	for (size_t iSlot = static_cast<size_t>(nHash) & nMask;; iSlot = (iSlot + 1) & nMask)
+	{
+		const Slot& slot = m_vSlots[iSlot];
+		if (slot.m_iGroup < 0)
+			return iSlot;
+		if (slot.m_nTag != nTag)
+			continue;
+		const Group& group = m_vGroups[slot.m_iGroup];
+		if (group.m_nHash == nHash && group.m_key.m_nLength == nKey && memcmp(group.m_key.m_pData, pKey, nKey) == 0)
+			return iSlot;
+	}
+}
+
+int CJobGroupTable::FindOrAdd(const char* pKey, int nKey)
+{
+	uint64_t nHash = HashGroupKey(pKey, nKey);
+	size_t iSlot = FindSlot(nHash, pKey, nKey);
+	if (m_vSlots[iSlot].m_iGroup >= 0)
+		return m_vSlots[iSlot].m_iGroup;
+
+	// keep at least half of the slots free, so the probes stay short
+	if ((m_vGroups.size() + 1) * 2 > m_vSlots.size())
+	{
+		Rehash(m_vSlots.size() * 2);
+		iSlot = FindSlot(nHash, pKey, nKey);
+	}
+
+	Group group;
+	group.m_key = m_keys.Store(pKey, nKey);
+	group.m_nHash = nHash;
+	m_vGroups.push_back(group);
+	m_vSlots[iSlot].m_nTag = GetSlotTag(nHash);
+	m_vSlots[iSlot].m_iGroup = static_cast<int32_t>(m_vGroups.size() - 1);
+	return m_vSlots[iSlot].m_iGroup;
+}
+
+void CJobGroupTable::Rehash(size_t nSlots)
+{
+	Slot free = { 0, -1 };
+	m_vSlots.assign(nSlots, free);
+	size_t nMask = nSlots - 1;
+	for (size_t iGroup = 0; iGroup < m_vGroups.size(); iGroup++)
+	{
+		size_t iSlot = static_cast<size_t>(m_vGroups[iGroup].m_nHash) & nMask;
+		while (m_vSlots[iSlot].m_iGroup >= 0)
+			iSlot = (iSlot + 1) & nMask;
+		m_vSlots[iSlot].m_nTag = GetSlotTag(m_vGroups[iGroup].m_nHash);
+		m_vSlots[iSlot].m_iGroup = static_cast<int32_t>(iGroup);
+	}
+}
+
+void CJobGroupTable::Merge(const CJobGroupTable& other)
+{
+	for (int i = 0; i < other.Size(); i++)
+	{
+		const CsvFieldView& key = other.GetKey(i);
+		GetCounts(FindOrAdd(key.m_pData, key.m_nLength)).Add(other.GetCounts(i));
+	}
+}
+
+void CJobGroupTable::Clear()
+{
+	Slot free = { 0, -1 };
+	m_vSlots.assign(MIN_GROUP_SLOTS, free);
+	m_vGroups.clear();
+	m_keys.Reset();
+}
+
+void AppendGroupKey(std::string& strKey, const char* pValue, int nLength)
+{
+	uint32_t nValueLength = static_cast<uint32_t>(nLength);
+	strKey.append(reinterpret_cast<const char*>(&nValueLength), sizeof(nValueLength));
+	strKey.append(pValue, nLength);
+}
+
+void SplitGroupKey(const CsvFieldView& key, std::vector<std::string>& vstrValues)
+{
+	vstrValues.clear();
+	const char* p = key.m_pData;
+	const char* pEnd = key.m_pData + key.m_nLength;
+	while (p + sizeof(uint32_t) <= pEnd)
+	{
+		uint32_t nValueLength;
+		memcpy(&nValueLength, p, sizeof(nValueLength));
+		p += sizeof(nValueLength);
+		vstrValues.push_back(std::string(p, nValueLength));
+		p += nValueLength;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CsvArena.h"
+#include "PrintJob.h"
+
+// The jobs and pages of one group of print jobs.  Only integers are added,
+// so the counts of a group are the same in whatever order its jobs come.
+struct JobGroupCounts
+{
+	JobGroupCounts() : m_nJobs(0)
+	{
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+			m_anNoneColorPages[k] = m_anColorPages[k] = 0;
+	}
+
+	void Add(const JobGroupCounts& other)
+	{
+		m_nJobs += other.m_nJobs;
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		{
+			m_anNoneColorPages[k] += other.m_anNoneColorPages[k];
+			m_anColorPages[k] += other.m_anColorPages[k];
+		}
+	}
+
+	int64_t m_nJobs;
+	int64_t m_anNoneColorPages[JOB_TYPE_COUNT];
+	int64_t m_anColorPages[JOB_TYPE_COUNT];
+};
+
+// Groups print jobs by a key, the values of the group columns of their row
+// as built by AppendGroupKey().  The groups are found through an open
+// addressing table of 8-byte slots probed linearly, and the keys are copied
+// into an arena, so adding a job to a known group allocates nothing.
+class CJobGroupTable
+{
+public:
+	CJobGroupTable();
+
+	// Returns the index of the group of the key, adding the group if new.
+	int FindOrAdd(const char* pKey, int nKey);
+
+	// Returns the counts of a group returned by FindOrAdd().
+	JobGroupCounts& GetCounts(int iGroup) { return m_vGroups[iGroup].m_counts; }
+	const JobGroupCounts& GetCounts(int iGroup) const { return m_vGroups[iGroup].m_counts; }
+
+	// Returns the key of a group.
+	const CsvFieldView& GetKey(int iGroup) const { return m_vGroups[iGroup].m_key; }
+
+	int Size() const { return static_cast<int>(m_vGroups.size()); }
+
+	// Adds the groups of another table, e.g. of another thread.
+	void Merge(const CJobGroupTable& other);
+
+	// Drops every group.
+	void Clear();
+
+private:
+	// The table is filled by one thread and can not be copied.
+	CJobGroupTable(const CJobGroupTable&);
+	CJobGroupTable& operator=(const CJobGroupTable&);
+
+	struct Group
+	{
+		CsvFieldView m_key;
+		uint64_t m_nHash;
+		JobGroupCounts m_counts;
+	};
+
+	// A slot of the table: the top bits of the hash, to skip most other keys
+	// without reading them, and the index of the group, -1 if the slot is free
+	struct Slot
+	{
+		uint32_t m_nTag;
+		int32_t m_iGroup;
+	};
+
+	// Finds the slot of a key, the free slot where it goes if it is new
+	size_t FindSlot(uint64_t nHash, const char* pKey, int nKey) const;
+
+	// Moves the groups to a table of nSlots slots, a power of 2
+	void Rehash(size_t nSlots);
+
+	std::vector<Slot> m_vSlots;
+	std::vector<Group> m_vGroups;
+	CCsvArena m_keys;
+};
+
+// Appends a value of a group column to a group key.  The value is prefixed
+// by its length, so no two lists of values give the same key.
+void AppendGroupKey(std::string& strKey, const char* pValue, int nLength);
+
+// Splits a key built by AppendGroupKey() into its values.
+void SplitGroupKey(const CsvFieldView& key, std::vector<std::string>& vstrValues);
@@ -0,0 +1,280 @@
+#include "stdafx.h"
+#include "JobLogFollower.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// The float totals are saved as their bits, so they resume exactly
+static uint32_t FloatBits(float fValue)
+{
+	uint32_t nBits;
+	memcpy(&nBits, &fValue, sizeof(nBits));
+	return nBits;
+}
+
+static float BitsFloat(uint32_t nBits)
+{
+	float fValue;
+	memcpy(&fValue, &nBits, sizeof(fValue));
+	return fValue;
+}
+
+bool LoadCheckpoint(const char* szFileName, JobLogCheckpoint& checkpoint, std::string& strError)
+{
+	checkpoint = JobLogCheckpoint();
+	FILE* pFile = fopen(szFileName, "r");
+	if (pFile == NULL)
+		return true;
+
+	char szKey[64];
+	long long nValue;
+	int nFields = 0;
+	while (fscanf(pFile, "%63s %lld", szKey, &nValue) == 2)
+	{
+		nFields++;
+		if (strcmp(szKey, "offset") == 0)
+			checkpoint.m_nOffset = nValue;
+		else if (strcmp(szKey, "rows") == 0)
+			checkpoint.m_nRows = nValue;
+		else if (strcmp(szKey, "blackAndWhiteBits") == 0)
+			checkpoint.m_totals.m_fBlackAndWhite = BitsFloat(static_cast<uint32_t>(nValue));
+		else if (strcmp(szKey, "colorBits") == 0)
+			checkpoint.m_totals.m_fColor = BitsFloat(static_cast<uint32_t>(nValue));
+		else if (strncmp(szKey, "noneColorPages", 14) == 0 && szKey[14] >= '0' && szKey[14] < '0' + JOB_TYPE_COUNT)
+			checkpoint.m_totals.m_anNoneColorPages[szKey[14] - '0'] = nValue;
+		else if (strncmp(szKey, "colorPages", 10) == 0 && szKey[10] >= '0' && szKey[10] < '0' + JOB_TYPE_COUNT)
+			checkpoint.m_totals.m_anColorPages[szKey[10] - '0'] = nValue;
+		else
+			nFields--;
+	}
+	fclose(pFile);
+
+	if (nFields != 4 + 2 * JOB_TYPE_COUNT || checkpoint.m_nOffset < 0)
+	{
+		checkpoint = JobLogCheckpoint();
+		strError = std::string("Meet error when loading the checkpoint: ") + szFileName;
+		return false;
+	}
+	return true;
+}
+
+bool SaveCheckpoint(const char* szFileName, const JobLogCheckpoint& checkpoint, std::string& strError)
+{
+	std::string strTempName = std::string(szFileName) + ".tmp";
+	FILE* pFile = fopen(strTempName.c_str(), "w");
+	if (pFile == NULL)
+	{
+		strError = "Meet error when saving the checkpoint: " + strTempName;
+		return false;
+	}
+
+	fprintf(pFile, "offset %lld\n", static_cast<long long>(checkpoint.m_nOffset));
+	fprintf(pFile, "rows %lld\n", static_cast<long long>(checkpoint.m_nRows));
+	fprintf(pFile, "blackAndWhiteBits %lld\n", static_cast<long long>(FloatBits(checkpoint.m_totals.m_fBlackAndWhite)));
+	fprintf(pFile, "colorBits %lld\n", static_cast<long long>(FloatBits(checkpoint.m_totals.m_fColor)));
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		fprintf(pFile, "noneColorPages%d %lld\n", k, static_cast<long long>(checkpoint.m_totals.m_anNoneColorPages[k]));
+		fprintf(pFile, "colorPages%d %lld\n", k, static_cast<long long>(checkpoint.m_totals.m_anColorPages[k]));
+	}
+
+	// the new checkpoint must be on disk before it replaces the old one
+	bool bWritten = fflush(pFile) == 0;
+#ifdef _WIN32
+	bWritten = bWritten && _commit(_fileno(pFile)) == 0;
+#else
+	bWritten = bWritten && fsync(fileno(pFile)) == 0;
+#endif
+	bWritten = fclose(pFile) == 0 && bWritten;
+
+#ifdef _WIN32
+	bWritten = bWritten && ::MoveFileExA(strTempName.c_str(), szFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bWritten = bWritten && rename(strTempName.c_str(), szFileName) == 0;
+#endif
+	if (!bWritten)
+	{
+		strError = std::string("Meet error when saving the checkpoint: ") + szFileName;
+		return false;
+	}
+	return true;
+}
+
+// Returns the length of the complete rows at the start of the data, up to
+// and with the last line end outside quotes.  A line end inside quotes is
+// part of a quoted field, which is only complete once its quote is closed.
+// A quote which is escaped by doubling it is counted twice, so the line
+// ends inside quotes are those after an odd number of quotes.
+static size_t FindCompleteRowsEnd(const std::string& strData)
+{
+	size_t nComplete = 0;
+	bool bQuoted = false;
+	for (size_t i = 0; i < strData.size(); i++)
+	{
+		if (strData[i] == '"')
+			bQuoted = !bQuoted;
+		else if (strData[i] == '\n' && !bQuoted)
+			nComplete = i + 1;
+	}
+	return nComplete;
+}
+
+CJobLogFollower::CJobLogFollower(const std::string& strLogName, const std::string& strCheckpointName)
+	: m_strLogName(strLogName)
+	, m_strCheckpointName(strCheckpointName)
+	, m_bContinueOnError(false)
+	, m_eReportMode(ReportMode::None)
+	, m_nMaxReadBytes(MAX_FOLLOW_READ_BYTES)
+	, m_nNotify(-1)
+{
+}
+
+CJobLogFollower::~CJobLogFollower()
+{
+#ifdef __linux__
+	if (m_nNotify != -1)
+		close(m_nNotify);
+#endif
+}
+
+bool CJobLogFollower::Open(const PrintTariff& tariff, bool bContinueOnError, ReportMode eReportMode, std::string& strError)
+{
+	m_tariff = tariff;
+	m_bContinueOnError = bContinueOnError;
+	m_eReportMode = eReportMode;
+	bool bLoaded = LoadCheckpoint(m_strCheckpointName.c_str(), m_checkpoint, strError);
+	ResetTask();
+	return bLoaded;
+}
+
+void CJobLogFollower::ResetTask()
+{
+	m_ptrTask = std::make_unique<PrinterTask>();
+	m_ptrTask->SetTariff(m_tariff);
+	m_ptrTask->SetContinueOnError(m_bContinueOnError);
+	m_ptrTask->SetReportWriter(std::make_unique<CReportWriter>(m_eReportMode));
+	m_ptrTask->SetTotals(m_checkpoint.m_totals);
+}
+
+bool CJobLogFollower::Update(int& nNewRows, std::string& strError)
+{
+	nNewRows = 0;
+	std::ifstream logFile(m_strLogName.c_str(), std::ifstream::binary | std::ifstream::in);
+	if (!logFile.is_open())
+	{
+		strError = "Meet error when loading the file: " + m_strLogName;
+		return false;
+	}
+
+	// The header is read again from the start of the log every time
+	std::string strHeader;
+	if (!std::getline(logFile, strHeader) || logFile.eof())
+		return true;	// no complete header yet
+	strHeader += '\n';
+	int64_t nHeaderEnd = static_cast<int64_t>(strHeader.size());
+
+	logFile.seekg(0, std::ios::end);
+	int64_t nSize = static_cast<int64_t>(logFile.tellg());
+	if (nSize < m_checkpoint.m_nOffset)
+	{
+		strError = "The log is shorter than the checkpoint, it was not only appended to: " + m_strLogName;
+		return false;
+	}
+
+	// The new rows are priced a window of at most m_nMaxReadBytes at a time,
+	// saving the checkpoint after each one
+	int64_t nBegin = m_checkpoint.m_nOffset > nHeaderEnd ? m_checkpoint.m_nOffset : nHeaderEnd;
+	while (nBegin < nSize)
+	{
+		int64_t nLength = nSize - nBegin < m_nMaxReadBytes ? nSize - nBegin : m_nMaxReadBytes;
+		std::string strData;
+		size_t nComplete = 0;
+		for (;;)
+		{
+			strData.assign(static_cast<size_t>(nLength), '\0');
+			logFile.clear();
+			logFile.seekg(nBegin, std::ios::beg);
+			if (!logFile.read(&strData[0], nLength))
+			{
+				strError = "Meet error when loading the file: " + m_strLogName;
+				return false;
+			}
+
+			// Only the complete rows count, the last one may still be written.
+			// A row longer than the window is read with a window twice as long
+			nComplete = FindCompleteRowsEnd(strData);
+			if (nComplete > 0 || nLength == nSize - nBegin)
+				break;
+			nLength = nSize - nBegin < 2 * nLength ? nSize - nBegin : 2 * nLength;
+		}
+		if (nComplete == 0)
+			return true;
+		strData.resize(nComplete);
+
+		std::istringstream stream(strHeader + strData);
+		if (!m_ptrTask->DoCalculateStream(stream, DEFAULT_STREAM_BATCH_ROWS, static_cast<int>(m_checkpoint.m_nRows)))
+		{
+			strError = "Meet error when pricing the rows appended to: " + m_strLogName;
+			ResetTask();
+			return false;
+		}
+
+		JobLogCheckpoint checkpoint;
+		checkpoint.m_nOffset = nBegin + static_cast<int64_t>(strData.size());
+		int nRows = m_ptrTask->GetNumberOfStreamedRows();
+		checkpoint.m_nRows = m_checkpoint.m_nRows + nRows;
+		checkpoint.m_totals = m_ptrTask->GetTotals();
+		if (!SaveCheckpoint(m_strCheckpointName.c_str(), checkpoint, strError))
+		{
+			ResetTask();
+			return false;
+		}
+		m_checkpoint = checkpoint;
+		ResetTask();
+		nNewRows += nRows;
+		nBegin = checkpoint.m_nOffset;
+	}
+	return true;
+}
+
+void CJobLogFollower::WaitForChange(int nTimeoutMs)
+{
+#ifdef __linux__
+	if (m_nNotify == -1)
+	{
+		m_nNotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+		if (m_nNotify != -1 && inotify_add_watch(m_nNotify, m_strLogName.c_str(), IN_MODIFY | IN_CLOSE_WRITE) == -1)
+		{
+			close(m_nNotify);
+			m_nNotify = -1;
+		}
+	}
+	if (m_nNotify != -1)
+	{
+		pollfd pollFd = { m_nNotify, POLLIN, 0 };
+		if (poll(&pollFd, 1, nTimeoutMs) > 0)
+		{
+			char buff[4096];
+			while (read(m_nNotify, buff, sizeof(buff)) > 0)
+			{
+			}
+		}
+		return;
+	}
+#endif
+	std::this_thread::sleep_for(std::chrono::milliseconds(nTimeoutMs));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "PrintJob.h"
+#include "ReportWriter.h"
+
+// Largest number of new bytes of the log read and priced at once, an Update
+// prices a longer tail of the log in several windows
+const static int64_t MAX_FOLLOW_READ_BYTES = 64 << 20;
+
+// Where a job log was priced up to, and the totals of what was priced
+struct JobLogCheckpoint
+{
+	JobLogCheckpoint() : m_nOffset(0), m_nRows(0) {}
+
+	int64_t m_nOffset;   // byte after the last complete row priced, 0 for a new log
+	int64_t m_nRows;     // rows priced, used to number the next ones
+	PrinterTaskTotals m_totals;
+};
+
+// Reads a checkpoint file.  A missing file is a new checkpoint, false is
+// returned with strError only for an unreadable one.
+bool LoadCheckpoint(const char* szFileName, JobLogCheckpoint& checkpoint, std::string& strError);
+
+// Writes a checkpoint file through a temporary file which replaces it, so
+// a crash leaves either the old checkpoint or the new one.
+bool SaveCheckpoint(const char* szFileName, const JobLogCheckpoint& checkpoint, std::string& strError);
+
+// Prices a CSV job log which is only ever appended to.  Each Update prices
+// the complete rows written since the checkpoint, adds them to its totals
+// and saves the checkpoint.  A partially written last row, including one
+// whose quoted field is still open, is left for the next Update, so
+// resuming after a crash never counts a row twice.
+class CJobLogFollower
+{
+public:
+	CJobLogFollower(const std::string& strLogName, const std::string& strCheckpointName);
+	~CJobLogFollower();
+
+	// Loads the checkpoint.  bContinueOnError and the tariff are those of the
+	// PrinterTask pricing the new rows, which reports them with eReportMode.
+	bool Open(const PrintTariff& tariff, bool bContinueOnError, ReportMode eReportMode, std::string& strError);
+
+	// Prices all the rows appended since the checkpoint, a window of the log
+	// at a time, and saves the checkpoint after each window.  Returns
+	// false with strError, and the checkpoint of the windows priced before,
+	// if the rows could not be priced.
+	bool Update(int& nNewRows, std::string& strError);
+
+	// Sets how many bytes of the log are read and priced at once
+	void SetMaxReadBytes(int64_t nMaxReadBytes) { m_nMaxReadBytes = nMaxReadBytes; }
+
+	// Waits until the log changes or nTimeoutMs passes.  Uses inotify on
+	// Linux and simply sleeps elsewhere.
+	void WaitForChange(int nTimeoutMs);
+
+	const JobLogCheckpoint& GetCheckpoint() const { return m_checkpoint; }
+
+	// Writes the totals of the checkpoint to the report
+	void WriteSummary(bool bExact) { m_ptrTask->WriteSummary(bExact); }
+
+private:
+	CJobLogFollower(const CJobLogFollower&);
+	CJobLogFollower& operator=(const CJobLogFollower&);
+
+	// Creates the task pricing the next rows, starting from the checkpoint
+	void ResetTask();
+
+	std::string m_strLogName;
+	std::string m_strCheckpointName;
+	JobLogCheckpoint m_checkpoint;
+	PrintTariff m_tariff;
+	bool m_bContinueOnError;
+	ReportMode m_eReportMode;
+	int64_t m_nMaxReadBytes;
+	std::unique_ptr<PrinterTask> m_ptrTask;
+	int m_nNotify;       // inotify descriptor, -1 if none
+};
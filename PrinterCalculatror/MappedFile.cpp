@@ -0,0 +1,123 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile() : m_pData(NULL), m_nSize(0)
+#ifdef _WIN32
+	, m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(NULL)
+#else
+	, m_nFile(-1)
+#endif
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool CMappedFile::Open(const char* szFilename)
+{
+	Close();
+
+	m_hFile = ::CreateFileA(szFilename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0
+		|| static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1))
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = ::CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = static_cast<const char*>(::MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_pData == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	m_nSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (m_pData != NULL)
+		::UnmapViewOfFile(m_pData);
+	if (m_hMapping != NULL)
+		::CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		::CloseHandle(m_hFile);
+
+	m_pData = NULL;
+	m_nSize = 0;
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool CMappedFile::Open(const char* szFilename)
+{
+	Close();
+
+	m_nFile = ::open(szFilename, O_RDONLY);
+	if (m_nFile < 0)
+		return false;
+
+	struct stat st;
+	if (::fstat(m_nFile, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* pData = ::mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_nFile, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	// the parser reads the file front to back exactly once
+	::madvise(pData, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+	m_pData = static_cast<const char*>(pData);
+	m_nSize = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (m_pData != NULL)
+		::munmap(const_cast<char*>(m_pData), m_nSize);
+	if (m_nFile >= 0)
+		::close(m_nFile);
+
+	m_pData = NULL;
+	m_nSize = 0;
+	m_nFile = -1;
+}
+
+#endif
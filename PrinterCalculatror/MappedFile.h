@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+// A read-only view of a whole file mapped into memory.
+// The mapping is released when the object is destroyed.
+class CMappedFile
+{
+public:
+	CMappedFile();
+
+	// Unmaps the file.
+	~CMappedFile();
+
+	// Maps the specified file read-only.
+	// Returns false if the file can not be opened or is empty.
+	bool Open(const char* szFilename);
+
+	// Unmaps the file and closes its handles.
+	void Close();
+
+	// Returns the first byte of the mapped file, NULL if nothing is mapped.
+	const char* GetData() const { return m_pData; }
+
+	// Returns the number of bytes mapped.
+	size_t GetSize() const { return m_nSize; }
+
+private:
+	// The mapping is owned by this object and can not be copied.
+	CMappedFile(const CMappedFile&);
+	CMappedFile& operator=(const CMappedFile&);
+
+	const char* m_pData;
+	size_t m_nSize;
+#ifdef _WIN32
+	void* m_hFile;
+	void* m_hMapping;
+#else
+	int m_nFile;
+#endif
+};
@@ -1,78 +1,1047 @@
-#include "stdafx.h"
-#include "PrintJob.h"
-
-//Constructor to start loading the CSV file by file name
-PrinterTask::PrinterTask(const std::string& strFileName)
-{
-	m_ptrCsvFile = std::make_unique<CCsvDataFile>(strFileName.c_str());
-	m_totalPriceColor = 0;
-	m_totalPriceBlackAndWhite = 0;
-	m_mapRowPrintJobs.clear();
-	m_mapExceptionRows.clear();
-}
-
-//Constructor to start loading the CSV file by the file reference
-PrinterTask::PrinterTask(std::unique_ptr<CCsvDataFile> df)
-{
-	m_ptrCsvFile = std::move(df);
-	m_totalPriceColor = 0;
-	m_totalPriceBlackAndWhite = 0;
-	m_mapRowPrintJobs.clear();
-	m_mapExceptionRows.clear();
-}
-
-//Actual function to start calculating the printer job
-// return true if the task is done
-// return false if the task is terminated because of wrong data
-bool PrinterTask::DoCalculate()
-{
-	assert(m_ptrCsvFile);
-	if (m_ptrCsvFile->GetLastError()[0] != '\0')
-	{
-		printf("Meet error when loading the file: %s", m_ptrCsvFile->GetLastError());
-		return false;
-	}
-	int totalRows = m_ptrCsvFile->GetNumberOfSamples(0);
-	for (int i = 0; i < totalRows; i++)
-	{
-		int nTotalPages, nColorPages;
-		bool bIsDoulbeSide;
-		if (m_ptrCsvFile->GetData("Total Pages", i, nTotalPages)
-			&& m_ptrCsvFile->GetData("Color Pages", i, nColorPages)
-			&& m_ptrCsvFile->GetData("Double Sided", i, bIsDoulbeSide))
-		{
-			PrintJob job(nTotalPages, nColorPages, (JobType)bIsDoulbeSide);
-			if (job.IsValidJob())
-			{
-				std::printf("Add Print Job No. %i - Type: %s\n Black and White Printing Pages: %i, cost: %.2f\n Color Printing Pages: %i, cost: %.2f\n\n ",
-					i,
-					job.GetPrintType() == JobType::SinglePage ? "single Side" : "Double Side",
-					job.GetBlackWhitePages(),
-					job.GetBlackAndWhitePrice(),
-					job.GetColorPages(),
-					job.GetColorPrice());
-				m_totalPriceBlackAndWhite += job.GetBlackAndWhitePrice();
-				m_totalPriceColor += job.GetColorPrice();
-
-				m_mapRowPrintJobs.insert(std::pair<int, PrintJob>(i, PrintJob(nTotalPages, nColorPages, (JobType)bIsDoulbeSide)));
-			}
-		}
-		else
-		{
-			m_mapExceptionRows.insert(std::pair<int, std::string>(i, m_ptrCsvFile->GetLastError()));
-			return false;
-		}
-	}
-	return true;
-}
-
-float PrinterTask::GetTotalPriceForBlackAndWhite()
-{
-	return m_totalPriceBlackAndWhite;
-}
-
-float PrinterTask::GetTotalPriceForColor()
-{
-	return m_totalPriceColor;
-}
-
+#include "stdafx.h"
+#include "PrintJob.h"
+#include "PrintJobBatch.h"
+#include "ReportWriter.h"
+#include "JobGroupTable.h"
+#include "CsvFieldConvert.h"
+#include "WorkerThreads.h"
+#include "ReadAheadInput.h"
+#include "DecompressInput.h"
+#include "SpscQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// The columns of a print job file
+static const char* TOTAL_PAGES_COLUMN = "Total Pages";
+static const char* COLOR_PAGES_COLUMN = "Color Pages";
+static const char* DOUBLE_SIDED_COLUMN = "Double Sided";
+
+// The columns of a tariff file
+static const char* TARIFF_JOB_TYPE_COLUMN = "Job Type";
+static const char* TARIFF_NONE_COLOR_COLUMN = "Black And White Price";
+static const char* TARIFF_COLOR_COLUMN = "Color Price";
+
+const char* JOB_TYPE_NAMES[JOB_TYPE_COUNT] = { "Single Side", "Double Side" };
+
+const std::unordered_map<JobType, JobTypePrice> sMapPrintJobPrice = {
+	{ JobType::SinglePage, JobTypePrice(JobTypeTariff<JobType::SinglePage>::NonColorPrice(), JobTypeTariff<JobType::SinglePage>::ColorPrice()) },
+	{ JobType::DoublePage, JobTypePrice(JobTypeTariff<JobType::DoublePage>::NonColorPrice(), JobTypeTariff<JobType::DoublePage>::ColorPrice()) }
+};
+
+static const PrintTariff sDefaultTariff;
+
+// Batches of DoCalculatePipeline: one parsed, one priced and one waiting
+static const int PIPELINE_BATCHES = 3;
+
+// The print job columns, the only ones a task needs besides the group columns
+static std::vector<std::string> GetPrintJobColumns(const std::vector<std::string>& vstrExtraColumns)
+{
+	std::vector<std::string> vstrColumns;
+	vstrColumns.push_back(TOTAL_PAGES_COLUMN);
+	vstrColumns.push_back(COLOR_PAGES_COLUMN);
+	vstrColumns.push_back(DOUBLE_SIDED_COLUMN);
+	vstrColumns.insert(vstrColumns.end(), vstrExtraColumns.begin(), vstrExtraColumns.end());
+	return vstrColumns;
+}
+
+// Options converting the print job columns once while the file is loaded,
+// and skipping every column but those and vstrExtraColumns
+static CsvReadOptions GetPrintJobReadOptions(int nParseThreads, bool bUseCache, const std::vector<std::string>& vstrExtraColumns)
+{
+	CsvReadOptions options;
+	options.m_nParseThreads = nParseThreads;
+	options.m_bUseCache = bUseCache;
+	options.m_vTypedColumns.push_back(CsvColumnSpec(TOTAL_PAGES_COLUMN, CsvColumnType::Int32));
+	options.m_vTypedColumns.push_back(CsvColumnSpec(COLOR_PAGES_COLUMN, CsvColumnType::Int32));
+	options.m_vTypedColumns.push_back(CsvColumnSpec(DOUBLE_SIDED_COLUMN, CsvColumnType::Bool));
+	options.m_vstrProjectedColumns = GetPrintJobColumns(vstrExtraColumns);
+	return options;
+}
+
+//Sums of one block of rows priced by DoCalculateParallel
+struct PrintBlockResult
+{
+	PrintBlockResult() : m_iExceptionRow(-1), m_iThread(0) {}
+
+	PrintBatchCost m_cost;
+	int m_iExceptionRow;	//first row which is not a print job, -1 if none
+	std::vector<std::pair<int, RowError> > m_vErrors;	//every such row when continuing on error
+	std::vector<int> m_vnRows;	//rows of the valid jobs
+	std::vector<PackedPrintJob> m_vJobs;
+	std::vector<float> m_vfBlackAndWhite;	//costs of the jobs in m_vJobs
+	std::vector<float> m_vfColor;
+	int m_iThread;	//the thread which priced the block
+	std::vector<int> m_vnGroups;	//groups of the jobs in the table of m_iThread
+};
+
+//Count a valid job in the totals of its group
+static void AddJobToGroup(JobGroupCounts& counts, const PackedPrintJob& job)
+{
+	int k = static_cast<int>(job.GetPrintType());
+	counts.m_nJobs++;
+	counts.m_anNoneColorPages[k] += job.GetBlackWhitePages();
+	counts.m_anColorPages[k] += job.GetColorPages();
+}
+
+//Add the values pairwise, neighbours first, and return the sum.  The order
+//of the additions only depends on the number of values
+static double SumPairwise(std::vector<double> vValues)
+{
+	if (vValues.empty())
+		return 0;
+	while (vValues.size() > 1)
+	{
+		size_t nHalf = vValues.size() / 2;
+		for (size_t i = 0; i < nHalf; i++)
+			vValues[i] = vValues[2 * i] + vValues[2 * i + 1];
+		if (vValues.size() % 2 != 0)
+			vValues[nHalf++] = vValues.back();
+		vValues.resize(nHalf);
+	}
+	return vValues[0];
+}
+
+PrintTariff::PrintTariff()
+{
+	SetPrice(JobType::SinglePage, JobTypePrice(JobTypeTariff<JobType::SinglePage>::NonColorPrice(), JobTypeTariff<JobType::SinglePage>::ColorPrice()));
+	SetPrice(JobType::DoublePage, JobTypePrice(JobTypeTariff<JobType::DoublePage>::NonColorPrice(), JobTypeTariff<JobType::DoublePage>::ColorPrice()));
+}
+
+const PrintTariff& GetDefaultTariff()
+{
+	return sDefaultTariff;
+}
+
+std::string FormatMilliCents(int64_t nMilliCents)
+{
+	std::string strSign = nMilliCents < 0 ? "-" : "";
+	uint64_t nAbs = nMilliCents < 0 ? 0 - static_cast<uint64_t>(nMilliCents) : static_cast<uint64_t>(nMilliCents);
+	std::string strFraction = std::to_string(nAbs % MILLICENTS_PER_UNIT);
+	strFraction.insert(0, 5 - strFraction.length(), '0');
+	//drop the zeros after the cents
+	strFraction.erase(std::max<size_t>(2, strFraction.find_last_not_of('0') + 1));
+	return strSign + std::to_string(nAbs / MILLICENTS_PER_UNIT) + "." + strFraction;
+}
+
+//Find the job type named szName, ignoring case and surrounding space
+//return -1 if there is no such job type
+static int FindJobType(std::string strName)
+{
+	strName.erase(0, strName.find_first_not_of(" \t"));
+	strName.erase(strName.find_last_not_of(" \t") + 1);
+	for (int i = 0; i < JOB_TYPE_COUNT; i++)
+	{
+		if (_stricmp(strName.c_str(), JOB_TYPE_NAMES[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+//A rate of a tariff is a number from 0 to MAX_TARIFF_PRICE, which also
+//leaves out nan and inf
+static bool IsValidTariffPrice(float fPrice)
+{
+	return fPrice >= 0 && fPrice <= MAX_TARIFF_PRICE;
+}
+
+//Read the rates of the tariff file, the tariff is only changed if all
+//rows are valid
+bool PrintTariff::LoadFromFile(const char* szFileName, std::string& strError)
+{
+	CCsvDataFile tariffFile(szFileName);
+	if (tariffFile.GetLastError()[0] != '\0')
+	{
+		strError = tariffFile.GetLastError();
+		return false;
+	}
+
+	CsvColumnHandle hJobType = tariffFile.ResolveColumn(TARIFF_JOB_TYPE_COLUMN);
+	CsvColumnHandle hNoneColorPrice = tariffFile.ResolveColumn(TARIFF_NONE_COLOR_COLUMN);
+	CsvColumnHandle hColorPrice = tariffFile.ResolveColumn(TARIFF_COLOR_COLUMN);
+	if (!hJobType.IsValid() || !hNoneColorPrice.IsValid() || !hColorPrice.IsValid())
+	{
+		strError = std::string("The tariff needs the columns ") + TARIFF_JOB_TYPE_COLUMN + ", " + TARIFF_NONE_COLOR_COLUMN + " and " + TARIFF_COLOR_COLUMN;
+		return false;
+	}
+
+	PrintTariff tariff = *this;
+	for (int i = 0; i < tariffFile.GetNumberOfSamples(hJobType.m_iVariable); i++)
+	{
+		std::string strJobType, strNoneColorPrice, strColorPrice;
+		tariffFile.GetData(hJobType, i, strJobType);
+		tariffFile.GetData(hNoneColorPrice, i, strNoneColorPrice);
+		tariffFile.GetData(hColorPrice, i, strColorPrice);
+
+		float fNoneColorPrice, fColorPrice;
+		int iJobType = FindJobType(strJobType);
+		if (iJobType < 0
+			|| !ConvertCsvFloat(strNoneColorPrice.c_str(), static_cast<int>(strNoneColorPrice.length()), fNoneColorPrice)
+			|| !ConvertCsvFloat(strColorPrice.c_str(), static_cast<int>(strColorPrice.length()), fColorPrice)
+			|| !IsValidTariffPrice(fNoneColorPrice) || !IsValidTariffPrice(fColorPrice))
+		{
+			strError = "Invalid tariff in row " + std::to_string(i) + ": " + strJobType;
+			return false;
+		}
+		tariff.SetPrice(static_cast<JobType>(iJobType), JobTypePrice(fNoneColorPrice, fColorPrice));
+	}
+
+	*this = tariff;
+	return true;
+}
+
+//Constructor for a task which reads its jobs with DoCalculateStream
+PrinterTask::PrinterTask()
+{
+	GetProcessStats(m_statsStart);
+	m_ptrCsvFile = std::make_shared<CCsvDataFile>();
+	m_ptrCsvFile->SetProjectedColumns(GetPrintJobColumns(std::vector<std::string>()));
+	m_ptrDataset = m_ptrCsvFile;
+	AddTypedColumns();
+	ResetTotals();
+	m_eAccountingMode = AccountingMode::Float;
+	m_ptrReport = std::make_unique<CReportWriter>();
+	m_bContinueOnError = false;
+	m_bRetainJobs = true;
+	m_nStreamedRows = 0;
+	m_mapExceptionRows.clear();
+}
+
+//Constructor to start loading the CSV file by file name
+PrinterTask::PrinterTask(const std::string& strFileName, int nParseThreads, bool bUseCache, const std::vector<std::string>& vstrExtraColumns)
+{
+	GetProcessStats(m_statsStart);
+	m_ptrCsvFile = std::make_shared<CCsvDataFile>(strFileName.c_str(), GetPrintJobReadOptions(nParseThreads, bUseCache, vstrExtraColumns));
+	m_ptrDataset = m_ptrCsvFile;
+	ResetTotals();
+	m_eAccountingMode = AccountingMode::Float;
+	m_ptrReport = std::make_unique<CReportWriter>();
+	m_bContinueOnError = false;
+	m_bRetainJobs = true;
+	m_nStreamedRows = 0;
+	m_mapExceptionRows.clear();
+}
+
+//Constructor to start loading the CSV file by the file reference
+PrinterTask::PrinterTask(std::unique_ptr<CCsvDataFile> df)
+{
+	GetProcessStats(m_statsStart);
+	m_ptrCsvFile = std::move(df);
+	m_ptrDataset = m_ptrCsvFile;
+	AddTypedColumns();
+	ResetTotals();
+	m_eAccountingMode = AccountingMode::Float;
+	m_ptrReport = std::make_unique<CReportWriter>();
+	m_bContinueOnError = false;
+	m_bRetainJobs = true;
+	m_nStreamedRows = 0;
+	m_mapExceptionRows.clear();
+}
+
+//Constructor to price a data set shared with other tasks
+PrinterTask::PrinterTask(std::shared_ptr<const CCsvDataFile> ptrDataset)
+{
+	GetProcessStats(m_statsStart);
+	m_ptrDataset = ptrDataset;
+	ResetTotals();
+	m_eAccountingMode = AccountingMode::Float;
+	m_ptrReport = std::make_unique<CReportWriter>();
+	m_bContinueOnError = false;
+	m_bRetainJobs = true;
+	m_nStreamedRows = 0;
+	m_mapExceptionRows.clear();
+}
+
+std::shared_ptr<const CCsvDataFile> LoadPrintJobDataset(const std::string& strFileName, int nParseThreads, bool bUseCache)
+{
+	return std::make_shared<CCsvDataFile>(strFileName.c_str(), GetPrintJobReadOptions(nParseThreads, bUseCache, std::vector<std::string>()));
+}
+
+void CPrintJobStore::Clear()
+{
+	m_vJobs.clear();
+	m_bvRows.Clear();
+	m_vnRankSamples.clear();
+}
+
+//The job of a row is after the jobs of the rows before it, counted from the
+//last sample
+bool CPrintJobStore::Find(int iRow, PackedPrintJob& job) const
+{
+	if (iRow < 0 || iRow >= m_bvRows.Size() || !m_bvRows.Get(iRow))
+		return false;
+
+	const uint32_t* pWords = m_bvRows.GetWords();
+	int iSample = iRow / JOB_STORE_RANK_ROWS;
+	int iJob = m_vnRankSamples[iSample];
+	for (int iWord = iSample * JOB_STORE_RANK_ROWS / 32; iWord < (iRow >> 5); iWord++)
+	{
+		for (uint32_t nWord = pWords[iWord]; nWord != 0; nWord &= nWord - 1)
+			iJob++;
+	}
+	for (uint32_t nWord = pWords[iRow >> 5] & ((1u << (iRow & 31)) - 1); nWord != 0; nWord &= nWord - 1)
+		iJob++;
+	job = m_vJobs[iJob];
+	return true;
+}
+
+size_t CPrintJobStore::GetMemoryUsage() const
+{
+	return m_vJobs.capacity() * sizeof(PackedPrintJob) + (m_bvRows.Size() + 31) / 32 * sizeof(uint32_t)
+		+ m_vnRankSamples.capacity() * sizeof(int);
+}
+
+const char* GetRowErrorText(RowError eError)
+{
+	switch (eError)
+	{
+	case RowError::None: return "No error";
+	case RowError::MissingColumn: return "A print job column is missing";
+	case RowError::TotalPages: return "Total Pages is not an int";
+	case RowError::ColorPages: return "Color Pages is not an int";
+	case RowError::DoubleSided: return "Double Sided is not a bool";
+	}
+	return "Unknown error";
+}
+
+PrinterTask::~PrinterTask()
+{
+}
+
+void PrinterTask::SetReportWriter(std::unique_ptr<CReportWriter> ptrReport)
+{
+	m_ptrReport = std::move(ptrReport);
+}
+
+void PrinterTask::WriteSummary(bool bExact)
+{
+	if (bExact)
+	{
+		m_ptrReport->WriteSummary(GetExactTotalForBlackAndWhite(), GetExactTotalForColor());
+		return;
+	}
+	char szBlackAndWhite[REPORT_NUMBER_SIZE], szColor[REPORT_NUMBER_SIZE];
+	FormatPrice(GetTotalPriceForBlackAndWhite(), szBlackAndWhite);
+	FormatPrice(GetTotalPriceForColor(), szColor);
+	m_ptrReport->WriteSummary(szBlackAndWhite, szColor);
+}
+
+//Actual function to start calculating the printer job
+// return true if the task is done
+// return false if the task is terminated because of wrong data
+bool PrinterTask::DoCalculate()
+{
+	assert(m_ptrDataset);
+	if (m_ptrDataset->GetLastError()[0] != '\0')
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	ResolveColumns();
+	ClearResults();
+	bool bDone = CalculateRows(m_bRetainJobs);
+	m_ptrReport->Flush();
+	return bDone;
+}
+
+//Price the rows in blocks of CALCULATE_BLOCK_ROWS on nThreads threads.
+//Like DoCalculate, the rows after the first invalid one are not added
+bool PrinterTask::DoCalculateParallel(int nThreads)
+{
+	assert(m_ptrDataset);
+	if (m_ptrDataset->GetLastError()[0] != '\0')
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	ResolveColumns();
+	ClearResults();
+
+	int firstRow = m_ptrDataset->GetFirstSampleRow();
+	int totalRows = m_ptrDataset->GetNumberOfRows();
+	PrintJobColumns columns;
+	if (!GetColumns(columns))
+		return totalRows == 0 || AddExceptionRow(0, RowError::MissingColumn);
+
+	int nBlocks = (totalRows + CALCULATE_BLOCK_ROWS - 1) / CALCULATE_BLOCK_ROWS;
+	std::vector<PrintBlockResult> vBlocks(nBlocks);
+
+	//Every thread finds the groups of its jobs in its own table
+	std::vector<std::unique_ptr<CJobGroupTable> > vptrGroupTables;
+	std::vector<std::string> vstrGroupKeys(std::max(nThreads, 1));
+	if (m_ptrGroups)
+	{
+		for (int i = 0; i < std::max(nThreads, 1); i++)
+			vptrGroupTables.push_back(std::make_unique<CJobGroupTable>());
+	}
+
+	RunParallelOnThreads(nBlocks, nThreads, [&](int iBlock, int iThread)
+	{
+		PRINTER_STATS_SCOPE(Calculate);
+		PrintBlockResult& block = vBlocks[iBlock];
+		block.m_iThread = iThread;
+		int iBegin = iBlock * CALCULATE_BLOCK_ROWS;
+		int iEnd = std::min(totalRows, iBegin + CALCULATE_BLOCK_ROWS);
+		const int* pnTotalPages = columns.m_totalPages.m_pValues + iBegin;
+		const int* pnColorPages = columns.m_colorPages.m_pValues + iBegin;
+		std::vector<int> vnTotalPages, vnColorPages;
+		for (int i = iBegin; i < iEnd; i++)
+		{
+			RowError eError = CheckRow(columns, i);
+			if (eError == RowError::None)
+				continue;
+			if (!m_bContinueOnError)
+			{
+				block.m_iExceptionRow = i;
+				iEnd = i;
+				break;
+			}
+
+			//A bad row is priced as a job without pages
+			if (vnTotalPages.empty())
+			{
+				vnTotalPages.assign(pnTotalPages, pnTotalPages + (iEnd - iBegin));
+				vnColorPages.assign(pnColorPages, pnColorPages + (iEnd - iBegin));
+				pnTotalPages = &vnTotalPages[0];
+				pnColorPages = &vnColorPages[0];
+			}
+			vnTotalPages[i - iBegin] = 0;
+			vnColorPages[i - iBegin] = 0;
+			block.m_vErrors.push_back(std::pair<int, RowError>(i, eError));
+		}
+		if (iEnd == iBegin)
+			return;
+
+		//Price the whole block at once, then keep the valid jobs
+		int nJobs = iEnd - iBegin;
+		std::vector<uint8_t> vnJobTypes(nJobs);
+		for (int i = 0; i < nJobs; i++)
+			vnJobTypes[i] = columns.m_doubleSided.GetValue(iBegin + i) ? 1 : 0;
+		std::vector<float> vfBlackAndWhite(nJobs), vfColor(nJobs);
+		PricePrintJobs(pnTotalPages, pnColorPages, &vnJobTypes[0], nJobs,
+			m_tariff.GetPrice(JobType::SinglePage), m_tariff.GetPrice(JobType::DoublePage),
+			block.m_cost, &vfBlackAndWhite[0], &vfColor[0]);
+
+		size_t iError = 0;
+		for (int i = 0; i < nJobs; i++)
+		{
+			if (iError < block.m_vErrors.size() && block.m_vErrors[iError].first == iBegin + i)
+			{
+				iError++;
+				continue;
+			}
+			int nBlackWhitePages = pnTotalPages[i] - pnColorPages[i];
+			if (nBlackWhitePages >= 0 && pnColorPages[i] >= 0)
+			{
+				block.m_vnRows.push_back(firstRow + iBegin + i);
+				block.m_vJobs.push_back(PackedPrintJob(nBlackWhitePages, pnColorPages[i], (JobType)vnJobTypes[i]));
+				block.m_vfBlackAndWhite.push_back(vfBlackAndWhite[i]);
+				block.m_vfColor.push_back(vfColor[i]);
+				if (m_ptrGroups)
+					block.m_vnGroups.push_back(FindGroup(*vptrGroupTables[iThread], vstrGroupKeys[iThread], iBegin + i));
+			}
+		}
+		PRINTER_STATS_ADD(Jobs, block.m_vJobs.size());
+	});
+
+	PRINTER_STATS_SCOPE(Calculate);
+
+	//Only the blocks up to the first invalid row count
+	std::vector<double> vBlackAndWhite, vColor;
+	int iExceptionRow = -1;
+	for (int iBlock = 0; iBlock < nBlocks && iExceptionRow == -1; iBlock++)
+	{
+		PrintBlockResult& block = vBlocks[iBlock];
+		vBlackAndWhite.push_back(block.m_cost.m_dBlackAndWhite);
+		vColor.push_back(block.m_cost.m_dColor);
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		{
+			m_anNoneColorPages[k] += block.m_cost.m_anNoneColorPages[k];
+			m_anColorPages[k] += block.m_cost.m_anColorPages[k];
+		}
+		iExceptionRow = block.m_iExceptionRow;
+
+		//Report the jobs and the bad rows in row order
+		size_t iError = 0;
+		for (size_t i = 0; i < block.m_vJobs.size() || iError < block.m_vErrors.size(); )
+		{
+			if (iError < block.m_vErrors.size() && (i == block.m_vJobs.size() || firstRow + block.m_vErrors[iError].first < block.m_vnRows[i]))
+			{
+				RecordRowError(firstRow + block.m_vErrors[iError].first, block.m_vErrors[iError].second);
+				m_ptrReport->WriteRowError(firstRow + block.m_vErrors[iError].first, GetRowErrorText(block.m_vErrors[iError].second));
+				iError++;
+				continue;
+			}
+			const PackedPrintJob& job = block.m_vJobs[i];
+			m_ptrReport->WriteJob(block.m_vnRows[i], job.GetPrintType(), job.GetBlackWhitePages(), block.m_vfBlackAndWhite[i], job.GetColorPages(), block.m_vfColor[i]);
+			if (m_bRetainJobs)
+				m_jobs.Add(block.m_vnRows[i], job);
+			//counted here, so the jobs after a row stopping the calculation are not
+			if (m_ptrGroups)
+				AddJobToGroup(vptrGroupTables[block.m_iThread]->GetCounts(block.m_vnGroups[i]), job);
+			i++;
+		}
+	}
+	for (size_t i = 0; i < vptrGroupTables.size(); i++)
+		m_ptrGroups->Merge(*vptrGroupTables[i]);
+	m_totalPriceBlackAndWhite += static_cast<float>(SumPairwise(vBlackAndWhite));
+	m_totalPriceColor += static_cast<float>(SumPairwise(vColor));
+	m_ptrReport->Flush();
+
+	return iExceptionRow == -1 || AddExceptionRow(iExceptionRow, CheckRow(columns, iExceptionRow));
+}
+
+//Calculate the print jobs while reading them from a stream
+// return true if the task is done
+// return false if the task is terminated because of wrong data
+bool PrinterTask::DoCalculateStream(std::istream& inStream, int nBatchRows, int nFirstRow)
+{
+	if (!m_ptrCsvFile)
+	{
+		printf("Meet error when loading the file: a shared data set can not be streamed into");
+		return false;
+	}
+	if (!m_ptrCsvFile->BeginStream(inStream, nFirstRow))
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	ResolveColumns();
+	// Only the totals are kept, the jobs of a batch are dropped with the batch
+	m_nStreamedRows = 0;
+	int nRows;
+	while ((nRows = m_ptrCsvFile->ReadNextBatch(inStream, nBatchRows)) > 0)
+	{
+		m_nStreamedRows += nRows;
+		if (!CalculateRows(false))
+		{
+			m_ptrReport->Flush();
+			return false;
+		}
+	}
+	m_ptrReport->Flush();
+	if (nRows < 0)
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	return true;
+}
+
+//Read the file on one thread, parse it on another and price the batches
+//on this one.  The batches are copies of the CSV file begun on the header,
+//handed to the parser through one queue and back through the other
+bool PrinterTask::DoCalculatePipeline(const std::string& strFileName, int nBatchRows)
+{
+	if (!m_ptrCsvFile)
+	{
+		printf("Meet error when loading the file: a shared data set can not be streamed into");
+		return false;
+	}
+
+	// the stage reading the file
+	CReadAheadStreamBuf readAhead;
+	CDecompressStreamBuf decompress;
+	CompressionFormat eCompression = DetectCompression(strFileName.c_str());
+	bool bOpened = eCompression == CompressionFormat::None ? readAhead.Open(strFileName.c_str())
+		: decompress.Open(strFileName.c_str(), eCompression);
+	if (!bOpened)
+	{
+		printf("Meet error when loading the file: %s", strFileName.c_str());
+		return false;
+	}
+	std::istream inStream(eCompression == CompressionFormat::None ? static_cast<std::streambuf*>(&readAhead) : &decompress);
+
+	if (!m_ptrCsvFile->BeginStream(inStream))
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	ResolveColumns();
+	ClearResults();
+
+	std::shared_ptr<CCsvDataFile> ptrTaskFile = m_ptrCsvFile;
+	std::vector<std::shared_ptr<CCsvDataFile> > vptrBatches(1, ptrTaskFile);
+	for (int i = 1; i < PIPELINE_BATCHES; i++)
+		vptrBatches.push_back(std::make_shared<CCsvDataFile>(*ptrTaskFile));
+	CSpscQueue<int> queueFree(PIPELINE_BATCHES);
+	CSpscQueue<int> queueParsed(PIPELINE_BATCHES);
+	for (int i = 0; i < PIPELINE_BATCHES; i++)
+		queueFree.Push(i);
+
+	// the stage parsing the batches
+	std::string strParseError;
+	std::thread parser([&]()
+	{
+		int nNextRow = 0;
+		int iBatch;
+		while (queueFree.Pop(iBatch))
+		{
+			int nRows = vptrBatches[iBatch]->ReadBatch(inStream, nBatchRows, nNextRow);
+			if (nRows < 0)
+				strParseError = vptrBatches[iBatch]->GetLastError();
+			if (nRows <= 0 || !queueParsed.Push(iBatch))
+				break;
+			nNextRow += nRows;
+		}
+		queueParsed.Close();
+	});
+
+	// the stage pricing them, reading a batch like the file of the task
+	bool bDone = true;
+	int iBatch;
+	while (queueParsed.Pop(iBatch))
+	{
+		m_ptrCsvFile = vptrBatches[iBatch];
+		m_ptrDataset = m_ptrCsvFile;
+		if (!CalculateRows(false))
+		{
+			bDone = false;
+			break;
+		}
+		queueFree.Push(iBatch);
+	}
+	// when the pricing stopped early the parser stops once the free batches are parsed
+	queueFree.Close();
+	parser.join();
+	m_ptrCsvFile = ptrTaskFile;
+	m_ptrDataset = m_ptrCsvFile;
+	m_ptrReport->Flush();
+	if (!bDone)
+		return false;
+
+	std::string strError = !strParseError.empty() ? strParseError
+		: eCompression == CompressionFormat::None ? readAhead.GetError() : decompress.GetError();
+	if (!strError.empty())
+	{
+		printf("Meet error when loading the file: %s", strError.c_str());
+		return false;
+	}
+	return true;
+}
+
+//Check and unpack the rows a block at a time, then let every tariff price
+//the jobs of the block.  The float totals of a tariff are added in row
+//order, like DoCalculate does, and the exact totals come from the pages by
+//job type, which are the same for every tariff
+bool PrinterTask::DoCalculateScenarios(const std::vector<PrintTariff>& vTariffs, std::vector<PrinterScenarioTotals>& vTotals,
+	std::vector<std::pair<int, RowError> >& vRowErrors)
+{
+	assert(m_ptrDataset);
+	vTotals.assign(vTariffs.size(), PrinterScenarioTotals());
+	vRowErrors.clear();
+	if (m_ptrDataset->GetLastError()[0] != '\0')
+	{
+		printf("Meet error when loading the file: %s", m_ptrDataset->GetLastError());
+		return false;
+	}
+	ResolveColumns();
+
+	PRINTER_STATS_SCOPE(Calculate);
+	int firstRow = m_ptrDataset->GetFirstSampleRow();
+	int totalRows = m_ptrDataset->GetNumberOfRows();
+	PrintJobColumns columns;
+	if (!GetColumns(columns))
+	{
+		if (totalRows == 0)
+			return true;
+		vRowErrors.push_back(std::make_pair(firstRow, RowError::MissingColumn));
+		return false;
+	}
+
+	int64_t anNoneColorPages[JOB_TYPE_COUNT] = { 0 };
+	int64_t anColorPages[JOB_TYPE_COUNT] = { 0 };
+	std::vector<int> vnBlackWhitePages, vnColorPages;
+	std::vector<uint8_t> vnJobTypes;
+	bool bDone = true;
+	for (int iBegin = 0; iBegin < totalRows && bDone; iBegin += CALCULATE_BLOCK_ROWS)
+	{
+		int iEnd = std::min(totalRows, iBegin + CALCULATE_BLOCK_ROWS);
+		vnBlackWhitePages.clear();
+		vnColorPages.clear();
+		vnJobTypes.clear();
+		for (int i = iBegin; i < iEnd; i++)
+		{
+			RowError eError = CheckRow(columns, i);
+			if (eError != RowError::None)
+			{
+				vRowErrors.push_back(std::make_pair(firstRow + i, eError));
+				if (m_bContinueOnError)
+					continue;
+				//the jobs of the block before the row still count
+				bDone = false;
+				break;
+			}
+			int nColorPages = columns.m_colorPages.m_pValues[i];
+			int nBlackWhitePages = columns.m_totalPages.m_pValues[i] - nColorPages;
+			if (nBlackWhitePages < 0 || nColorPages < 0)
+				continue;
+			int iJobType = columns.m_doubleSided.GetValue(i) ? 1 : 0;
+			vnBlackWhitePages.push_back(nBlackWhitePages);
+			vnColorPages.push_back(nColorPages);
+			vnJobTypes.push_back(static_cast<uint8_t>(iJobType));
+			anNoneColorPages[iJobType] += nBlackWhitePages;
+			anColorPages[iJobType] += nColorPages;
+		}
+
+		for (size_t iTariff = 0; iTariff < vTariffs.size(); iTariff++)
+		{
+			const PrintTariff& tariff = vTariffs[iTariff];
+			float fBlackAndWhite = vTotals[iTariff].m_fBlackAndWhite;
+			float fColor = vTotals[iTariff].m_fColor;
+			for (size_t j = 0; j < vnJobTypes.size(); j++)
+			{
+				const JobTypePrice& price = tariff.m_aPrices[vnJobTypes[j]];
+				fBlackAndWhite += price.m_fNonColorPrice * vnBlackWhitePages[j];
+				fColor += price.m_fColorPrice * vnColorPages[j];
+			}
+			vTotals[iTariff].m_fBlackAndWhite = fBlackAndWhite;
+			vTotals[iTariff].m_fColor = fColor;
+		}
+		PRINTER_STATS_ADD(Jobs, vnJobTypes.size() * vTariffs.size());
+	}
+
+	for (size_t iTariff = 0; iTariff < vTariffs.size(); iTariff++)
+	{
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		{
+			const JobTypePrice& price = vTariffs[iTariff].m_aPrices[k];
+			vTotals[iTariff].m_nBlackAndWhiteMilliCents += anNoneColorPages[k] * price.m_nNonColorMilliCents;
+			vTotals[iTariff].m_nColorMilliCents += anColorPages[k] * price.m_nColorMilliCents;
+		}
+	}
+	return bDone;
+}
+
+//Calculate the rows currently loaded, numbering them from the first row of the batch
+bool PrinterTask::CalculateRows(bool bKeepPrintJobs)
+{
+	PRINTER_STATS_SCOPE(Calculate);
+	int firstRow = m_ptrDataset->GetFirstSampleRow();
+	int totalRows = m_ptrDataset->GetNumberOfRows();
+
+	// The columns were converted while loading, so the loop only reads arrays
+	PrintJobColumns columns;
+	if (!GetColumns(columns))
+		return totalRows == 0 || AddExceptionRow(0, RowError::MissingColumn);
+	CsvIntColumn& totalPages = columns.m_totalPages;
+	CsvIntColumn& colorPages = columns.m_colorPages;
+	CsvBoolColumn& doubleSided = columns.m_doubleSided;
+
+	for (int i = 0; i < totalRows; i++)
+	{
+		RowError eError = CheckRow(columns, i);
+		if (eError == RowError::None)
+		{
+			int nTotalPages = totalPages.m_pValues[i];
+			int nColorPages = colorPages.m_pValues[i];
+			bool bIsDoulbeSide = doubleSided.GetValue(i);
+			PrintJob job(nTotalPages, nColorPages, (JobType)bIsDoulbeSide, m_tariff);
+			if (job.IsValidJob())
+			{
+				float fBlackAndWhitePrice = job.GetBlackAndWhitePrice();
+				float fColorPrice = job.GetColorPrice();
+				m_ptrReport->WriteJob(firstRow + i, job.GetPrintType(), job.GetBlackWhitePages(), fBlackAndWhitePrice, job.GetColorPages(), fColorPrice);
+				m_totalPriceBlackAndWhite += fBlackAndWhitePrice;
+				m_totalPriceColor += fColorPrice;
+				m_anNoneColorPages[static_cast<int>(job.GetPrintType())] += job.GetBlackWhitePages();
+				m_anColorPages[static_cast<int>(job.GetPrintType())] += job.GetColorPages();
+
+				if (bKeepPrintJobs)
+					m_jobs.Add(firstRow + i, PackedPrintJob(job.GetBlackWhitePages(), job.GetColorPages(), job.GetPrintType()));
+				if (m_ptrGroups)
+					AddJobToGroup(m_ptrGroups->GetCounts(FindGroup(*m_ptrGroups, m_strGroupKey, i)), PackedPrintJob(job.GetBlackWhitePages(), job.GetColorPages(), job.GetPrintType()));
+				PRINTER_STATS_ADD(Jobs, 1);
+			}
+		}
+		else if (m_bContinueOnError)
+		{
+			RecordRowError(firstRow + i, eError);
+			m_ptrReport->WriteRowError(firstRow + i, GetRowErrorText(eError));
+		}
+		else
+		{
+			return AddExceptionRow(i, eError);
+		}
+	}
+	return true;
+}
+
+//Check the columns of a row from the validity bits, without reading the fields
+RowError PrinterTask::CheckRow(const PrintJobColumns& columns, int i)
+{
+	if (!columns.m_totalPages.IsValid(i))
+		return RowError::TotalPages;
+	if (!columns.m_colorPages.IsValid(i))
+		return RowError::ColorPages;
+	if (!columns.m_doubleSided.IsValid(i))
+		return RowError::DoubleSided;
+	return RowError::None;
+}
+
+void PrinterTask::RecordRowError(int iRow, RowError eError)
+{
+	//a row read again, e.g. by a stream started over, keeps its first reason
+	if (iRow < m_bvExceptionRows.Size() && m_bvExceptionRows.Get(iRow))
+		return;
+	if (iRow >= m_bvExceptionRows.Size())
+		m_bvExceptionRows.Resize(iRow + 1);
+	m_bvExceptionRows.Set(iRow, true);
+	m_veRowErrors.push_back(eError);
+	PRINTER_STATS_ADD(RowErrors, 1);
+}
+
+void PrinterTask::ClearResults()
+{
+	ResetTotals();
+	if (m_ptrGroups)
+		m_ptrGroups->Clear();
+	m_jobs.Clear();
+	m_bvExceptionRows.Clear();
+	m_veRowErrors.clear();
+	m_mapExceptionRows.clear();
+}
+
+//The set bits of the exception bitmap, skipping the words without any
+std::vector<int> PrinterTask::GetExceptionLines()
+{
+	std::vector<int> vnRows;
+	vnRows.reserve(m_veRowErrors.size());
+	const uint32_t* pWords = m_bvExceptionRows.GetWords();
+	for (int iWord = 0; iWord * 32 < m_bvExceptionRows.Size(); iWord++)
+	{
+		if (pWords[iWord] == 0)
+			continue;
+		for (int iBit = 0; iBit < 32; iBit++)
+		{
+			if ((pWords[iWord] >> iBit) & 1)
+				vnRows.push_back(iWord * 32 + iBit);
+		}
+	}
+	return vnRows;
+}
+
+//The reasons are stored in row order, so the reason of a row is at the
+//number of bad rows before it
+RowError PrinterTask::GetRowError(int iRow) const
+{
+	if (iRow < 0 || iRow >= m_bvExceptionRows.Size() || !m_bvExceptionRows.Get(iRow))
+		return RowError::None;
+
+	const uint32_t* pWords = m_bvExceptionRows.GetWords();
+	int nBefore = 0;
+	for (int iWord = 0; iWord < (iRow >> 5); iWord++)
+	{
+		for (uint32_t nWord = pWords[iWord]; nWord != 0; nWord &= nWord - 1)
+			nBefore++;
+	}
+	for (uint32_t nWord = pWords[iRow >> 5] & ((1u << (iRow & 31)) - 1); nWord != 0; nWord &= nWord - 1)
+		nBefore++;
+	return m_veRowErrors[nBefore];
+}
+
+//Get the typed print job columns of the rows currently loaded
+//return false if a column is missing from the file
+bool PrinterTask::GetColumns(PrintJobColumns& columns)
+{
+	return m_ptrDataset->GetIntColumn(m_hTotalPages, columns.m_totalPages)
+		&& m_ptrDataset->GetIntColumn(m_hColorPages, columns.m_colorPages)
+		&& m_ptrDataset->GetBoolColumn(m_hDoubleSided, columns.m_doubleSided);
+}
+
+//Record the row i of the loaded rows as an exception.  The row is read
+//again through GetData to keep the error of the field which failed, a
+//shared data set is not changed and keeps the text of the RowError instead.
+//Always return false so that the calculation stops
+bool PrinterTask::AddExceptionRow(int i, RowError eError)
+{
+	int iRow = m_ptrDataset->GetFirstSampleRow() + i;
+	RecordRowError(iRow, eError);
+	if (!m_ptrCsvFile)
+	{
+		m_mapExceptionRows.insert(std::pair<int, std::string>(iRow, GetRowErrorText(eError)));
+		return false;
+	}
+	int nTotalPages, nColorPages;
+	bool bIsDoulbeSide;
+	if (m_ptrCsvFile->GetData(TOTAL_PAGES_COLUMN, i, nTotalPages)
+		&& m_ptrCsvFile->GetData(COLOR_PAGES_COLUMN, i, nColorPages))
+		m_ptrCsvFile->GetData(DOUBLE_SIDED_COLUMN, i, bIsDoulbeSide);
+	m_mapExceptionRows.insert(std::pair<int, std::string>(iRow, m_ptrCsvFile->GetLastError()));
+	return false;
+}
+
+//Resolve the print job and group columns once the header of the CSV file is read
+void PrinterTask::ResolveColumns()
+{
+	m_hTotalPages = m_ptrDataset->ResolveColumn(TOTAL_PAGES_COLUMN);
+	m_hColorPages = m_ptrDataset->ResolveColumn(COLOR_PAGES_COLUMN);
+	m_hDoubleSided = m_ptrDataset->ResolveColumn(DOUBLE_SIDED_COLUMN);
+	m_vhGroupColumns.clear();
+	for (size_t i = 0; i < m_vstrGroupColumns.size(); i++)
+		m_vhGroupColumns.push_back(m_ptrDataset->ResolveColumn(m_vstrGroupColumns[i].c_str()));
+}
+
+void PrinterTask::SetGroupBy(const std::vector<std::string>& vstrColumns)
+{
+	m_vstrGroupColumns = vstrColumns;
+	//a file skipping columns keeps the group columns of the rows read from now on
+	if (m_ptrCsvFile && !m_ptrCsvFile->GetProjectedColumns().empty())
+		m_ptrCsvFile->SetProjectedColumns(GetPrintJobColumns(vstrColumns));
+	if (vstrColumns.empty())
+		m_ptrGroups.reset();
+	else
+		m_ptrGroups = std::make_unique<CJobGroupTable>();
+}
+
+//The key of a row is the values of its group columns, read in place
+int PrinterTask::FindGroup(CJobGroupTable& table, std::string& strKey, int i) const
+{
+	strKey.clear();
+	for (size_t iColumn = 0; iColumn < m_vhGroupColumns.size(); iColumn++)
+	{
+		const char* pValue = "";
+		int nLength = 0;
+		if (!m_ptrDataset->GetField(m_vhGroupColumns[iColumn], i, pValue, nLength))
+		{
+			pValue = "";
+			nLength = 0;
+		}
+		AppendGroupKey(strKey, pValue, nLength);
+	}
+	return table.FindOrAdd(strKey.data(), static_cast<int>(strKey.length()));
+}
+
+void PrinterTask::GetGroups(std::vector<PrintJobGroup>& vGroups) const
+{
+	vGroups.clear();
+	if (!m_ptrGroups)
+		return;
+	for (int iGroup = 0; iGroup < m_ptrGroups->Size(); iGroup++)
+	{
+		//a group found only by the jobs after a row stopping the calculation has none
+		const JobGroupCounts& counts = m_ptrGroups->GetCounts(iGroup);
+		if (counts.m_nJobs == 0)
+			continue;
+		vGroups.push_back(PrintJobGroup());
+		PrintJobGroup& group = vGroups.back();
+		SplitGroupKey(m_ptrGroups->GetKey(iGroup), group.m_vstrValues);
+		group.m_nJobs = counts.m_nJobs;
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		{
+			const JobTypePrice& price = m_tariff.GetPrice(static_cast<JobType>(k));
+			group.m_nBlackWhitePages += counts.m_anNoneColorPages[k];
+			group.m_nColorPages += counts.m_anColorPages[k];
+			group.m_nBlackAndWhiteMilliCents += counts.m_anNoneColorPages[k] * price.m_nNonColorMilliCents;
+			group.m_nColorMilliCents += counts.m_anColorPages[k] * price.m_nColorMilliCents;
+		}
+	}
+	std::sort(vGroups.begin(), vGroups.end(), [](const PrintJobGroup& a, const PrintJobGroup& b)
+	{
+		return a.m_vstrValues < b.m_vstrValues;
+	});
+}
+
+//The costs of a group are its exact totals, rounded to cents unless bExact
+void PrinterTask::WriteGroups(bool bExact)
+{
+	std::vector<PrintJobGroup> vGroups;
+	GetGroups(vGroups);
+	char szBlackAndWhite[REPORT_NUMBER_SIZE], szColor[REPORT_NUMBER_SIZE];
+	for (size_t i = 0; i < vGroups.size(); i++)
+	{
+		const PrintJobGroup& group = vGroups[i];
+		if (bExact)
+		{
+			m_ptrReport->WriteGroup(m_vstrGroupColumns, group.m_vstrValues, group.m_nJobs,
+				FormatMilliCents(group.m_nBlackAndWhiteMilliCents), FormatMilliCents(group.m_nColorMilliCents));
+			continue;
+		}
+		FormatPrice(static_cast<float>(static_cast<double>(group.m_nBlackAndWhiteMilliCents) / MILLICENTS_PER_UNIT), szBlackAndWhite);
+		FormatPrice(static_cast<float>(static_cast<double>(group.m_nColorMilliCents) / MILLICENTS_PER_UNIT), szColor);
+		m_ptrReport->WriteGroup(m_vstrGroupColumns, group.m_vstrValues, group.m_nJobs, szBlackAndWhite, szColor);
+	}
+	m_ptrReport->Flush();
+}
+
+//Convert the print job columns of the CSV file to typed arrays
+void PrinterTask::AddTypedColumns()
+{
+	m_ptrCsvFile->AddTypedColumn(TOTAL_PAGES_COLUMN, CsvColumnType::Int32);
+	m_ptrCsvFile->AddTypedColumn(COLOR_PAGES_COLUMN, CsvColumnType::Int32);
+	m_ptrCsvFile->AddTypedColumn(DOUBLE_SIDED_COLUMN, CsvColumnType::Bool);
+}
+
+//Start the totals of a new task from 0
+void PrinterTask::ResetTotals()
+{
+	m_totalPriceColor = 0;
+	m_totalPriceBlackAndWhite = 0;
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		m_anNoneColorPages[k] = 0;
+		m_anColorPages[k] = 0;
+	}
+}
+
+float PrinterTask::GetTotalPriceForBlackAndWhite()
+{
+	if (m_eAccountingMode == AccountingMode::MilliCents)
+		return static_cast<float>(static_cast<double>(GetTotalMilliCentsForBlackAndWhite()) / MILLICENTS_PER_UNIT);
+	return m_totalPriceBlackAndWhite;
+}
+
+float PrinterTask::GetTotalPriceForColor()
+{
+	if (m_eAccountingMode == AccountingMode::MilliCents)
+		return static_cast<float>(static_cast<double>(GetTotalMilliCentsForColor()) / MILLICENTS_PER_UNIT);
+	return m_totalPriceColor;
+}
+
+//The pages of every job type priced by the integer rates of the tariff
+PrinterTaskTotals PrinterTask::GetTotals() const
+{
+	PrinterTaskTotals totals;
+	totals.m_fBlackAndWhite = m_totalPriceBlackAndWhite;
+	totals.m_fColor = m_totalPriceColor;
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		totals.m_anNoneColorPages[k] = m_anNoneColorPages[k];
+		totals.m_anColorPages[k] = m_anColorPages[k];
+	}
+	return totals;
+}
+
+void PrinterTask::SetTotals(const PrinterTaskTotals& totals)
+{
+	m_totalPriceBlackAndWhite = totals.m_fBlackAndWhite;
+	m_totalPriceColor = totals.m_fColor;
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		m_anNoneColorPages[k] = totals.m_anNoneColorPages[k];
+		m_anColorPages[k] = totals.m_anColorPages[k];
+	}
+}
+
+int64_t PrinterTask::GetTotalMilliCentsForBlackAndWhite() const
+{
+	int64_t nTotal = 0;
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		nTotal += m_anNoneColorPages[k] * m_tariff.GetPrice(static_cast<JobType>(k)).m_nNonColorMilliCents;
+	return nTotal;
+}
+
+int64_t PrinterTask::GetTotalMilliCentsForColor() const
+{
+	int64_t nTotal = 0;
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		nTotal += m_anColorPages[k] * m_tariff.GetPrice(static_cast<JobType>(k)).m_nColorMilliCents;
+	return nTotal;
+}
+
+
+void PrinterTask::GetStats(PrinterStats& stats) const
+{
+	GetProcessStats(stats);
+	stats.Subtract(m_statsStart);
+}
@@ -1,86 +1,480 @@
-#include <unordered_map>
-#include <map>
-#include "CSVDataFile.h"
-
-enum class JobType
-{
-	SinglePage = 0,  // Map to false by default
-	DoublePage       // Map to true
-};
-
-struct JobTypePrice
-{
-	JobTypePrice(float nonColorPrice, float colorPrice) : m_fNonColorPrice(nonColorPrice), m_fColorPrice(colorPrice) {};
-	float m_fNonColorPrice;
-	float m_fColorPrice;
-};
-
-const static std::unordered_map<JobType, JobTypePrice> sMapPrintJobPrice = { 
-	{ JobType::SinglePage, JobTypePrice(0.15f, 0.25f) },
-	{ JobType::DoublePage, JobTypePrice(0.1f, 0.2f) }
-};
-
-//The class to add separate printJob
-class PrintJob
-{
-public:
-	PrintJob(int nTotalPages, int nColorPages, JobType eJobType) : m_nNoneColorPages(nTotalPages - nColorPages)
-		, m_nColorPages(nColorPages)
-		, m_eJobType(eJobType)
-	{
-		m_isValidJob = (m_nNoneColorPages < 0 || m_nColorPages < 0) ? false : true;
-	}
-
-	bool IsValidJob() { return m_isValidJob; }
-
-	float GetBlackAndWhitePrice() 
-	{ 
-		if (IsValidJob())
-			return sMapPrintJobPrice.at(m_eJobType).m_fNonColorPrice * m_nNoneColorPages;
-		else
-			return 0.0;
-	};
-
-	float GetColorPrice()
-	{
-		if (IsValidJob())
-			return sMapPrintJobPrice.at(m_eJobType).m_fColorPrice * m_nColorPages;
-		else
-			return 0.0;
-	}
-
-	int GetBlackWhitePages() { return m_nNoneColorPages; }
-	int GetColorPages() { return m_nColorPages; }
-	JobType GetPrintType() { return m_eJobType; }
-
-private:
-	int m_nNoneColorPages;
-	int m_nColorPages;
-	bool m_isValidJob;
-	JobType m_eJobType;
-};
-
-//The class to create the printer task
-class PrinterTask
-{
-public:
-	//Load all print job from a file name
-	PrinterTask(const std::string& strFileName);
-	PrinterTask(std::unique_ptr<CCsvDataFile> df);
-
-	bool DoCalculate();
-
-	float GetTotalPriceForBlackAndWhite();
-	float GetTotalPriceForColor();
-
-	// Return all invalid rows of records
-	std::vector<int> GetExceptionLines();
-
-private:
-	std::map<int, PrintJob> m_mapRowPrintJobs;
-	//Store the print job which has error reading the data
-	std::map<int, std::string> m_mapExceptionRows;
-	float m_totalPriceBlackAndWhite;
-	float m_totalPriceColor;
-	std::unique_ptr<CCsvDataFile> m_ptrCsvFile;
+#pragma once
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <istream>
+#include <cmath>
+#include <cstdint>
+#include "CSVDataFile.h"
+#include "PrinterStats.h"
+
+class CReportWriter;
+class CJobGroupTable;
+
+// Number of rows held in memory at a time by PrinterTask::DoCalculateStream
+const static int DEFAULT_STREAM_BATCH_ROWS = 4096;
+
+// Number of rows summed together by PrinterTask::DoCalculateParallel.  The
+// blocks, not the threads, decide the order of the additions.
+const static int CALCULATE_BLOCK_ROWS = 4096;
+
+enum class JobType
+{
+	SinglePage = 0,  // Map to false by default
+	DoublePage       // Map to true
+};
+
+// Number of values of JobType, the size of the price tables indexed by it
+const static int JOB_TYPE_COUNT = 2;
+
+// Prices are also kept as integers in milli-cents, 1/1000 of a cent, so
+// that totals are added exactly and in any order
+const static int64_t MILLICENTS_PER_UNIT = 100000;
+
+// Highest rate of a page in a tariff.  Its milli-cents times the most pages
+// of a job, INT_MAX, still fit in an int64_t
+const static float MAX_TARIFF_PRICE = 10000;
+
+// Rounds a price to milli-cents
+inline int64_t PriceToMilliCents(float fPrice)
+{
+	return static_cast<int64_t>(std::floor(fPrice * static_cast<double>(MILLICENTS_PER_UNIT) + 0.5));
+}
+
+// Formats milli-cents as an exact decimal with at least two decimals,
+// e.g. "54.60" or "0.00125"
+std::string FormatMilliCents(int64_t nMilliCents);
+
+struct JobTypePrice
+{
+	JobTypePrice() : m_fNonColorPrice(0), m_fColorPrice(0), m_nNonColorMilliCents(0), m_nColorMilliCents(0) {};
+	JobTypePrice(float nonColorPrice, float colorPrice) : m_fNonColorPrice(nonColorPrice), m_fColorPrice(colorPrice)
+		, m_nNonColorMilliCents(PriceToMilliCents(nonColorPrice)), m_nColorMilliCents(PriceToMilliCents(colorPrice)) {};
+	float m_fNonColorPrice;
+	float m_fColorPrice;
+	int64_t m_nNonColorMilliCents;
+	int64_t m_nColorMilliCents;
+};
+
+// Why a row of a print job file is not a print job
+enum class RowError : uint8_t
+{
+	None = 0,
+	MissingColumn,   // the file has no such column
+	TotalPages,      // Total Pages is not an int
+	ColorPages,      // Color Pages is not an int
+	DoubleSided      // Double Sided is not a bool
+};
+
+// Describes a RowError
+const char* GetRowErrorText(RowError eError);
+
+// The running totals of a PrinterTask, saved to resume it later
+struct PrinterTaskTotals
+{
+	PrinterTaskTotals() : m_fBlackAndWhite(0), m_fColor(0)
+	{
+		for (int k = 0; k < JOB_TYPE_COUNT; k++)
+		{
+			m_anNoneColorPages[k] = 0;
+			m_anColorPages[k] = 0;
+		}
+	}
+
+	float m_fBlackAndWhite;
+	float m_fColor;
+	int64_t m_anNoneColorPages[JOB_TYPE_COUNT];
+	int64_t m_anColorPages[JOB_TYPE_COUNT];
+};
+
+// How PrinterTask reports its totals
+enum class AccountingMode
+{
+	Float = 0,    // float totals added job by job
+	MilliCents    // exact totals, converted to float when read as float
+};
+
+//The built-in rates of a job type, known at compile time so that code
+//written for one job type prices it with a single multiply
+template <JobType eJobType> struct JobTypeTariff;
+
+template <> struct JobTypeTariff<JobType::SinglePage>
+{
+	static float NonColorPrice() { return 0.15f; }
+	static float ColorPrice() { return 0.25f; }
+};
+
+template <> struct JobTypeTariff<JobType::DoublePage>
+{
+	static float NonColorPrice() { return 0.1f; }
+	static float ColorPrice() { return 0.2f; }
+};
+
+//The rates of every job type, indexed by the value of the JobType.  A new
+//job type, or a combination like job type and paper size flattened into one
+//index, only makes the table longer, a lookup stays one array access
+struct PrintTariff
+{
+	//The built-in rates of JobTypeTariff
+	PrintTariff();
+
+	const JobTypePrice& GetPrice(JobType eJobType) const { return m_aPrices[static_cast<int>(eJobType)]; }
+	void SetPrice(JobType eJobType, const JobTypePrice& price) { m_aPrices[static_cast<int>(eJobType)] = price; }
+
+	//Read the rates from a CSV file with the columns "Job Type",
+	//"Black And White Price" and "Color Price", one row per job type named
+	//as in JOB_TYPE_NAMES, with rates from 0 to MAX_TARIFF_PRICE.  Job types
+	//without a row keep their rates.
+	//return false and set strError if the file can't be used
+	bool LoadFromFile(const char* szFileName, std::string& strError);
+
+	JobTypePrice m_aPrices[JOB_TYPE_COUNT];
+};
+
+//The name of every job type in a tariff file
+extern const char* JOB_TYPE_NAMES[JOB_TYPE_COUNT];
+
+//The built-in tariff
+const PrintTariff& GetDefaultTariff();
+
+//The built-in rates by job type, kept for callers which look them up by key
+extern const std::unordered_map<JobType, JobTypePrice> sMapPrintJobPrice;
+
+//The class to add separate printJob
+class PrintJob
+{
+public:
+	PrintJob(int nTotalPages, int nColorPages, JobType eJobType, const PrintTariff& tariff = GetDefaultTariff()) : m_nNoneColorPages(nTotalPages - nColorPages)
+		, m_nColorPages(nColorPages)
+		, m_eJobType(eJobType)
+		, m_price(tariff.GetPrice(eJobType))
+	{
+		m_isValidJob = (m_nNoneColorPages < 0 || m_nColorPages < 0) ? false : true;
+	}
+
+	bool IsValidJob() { return m_isValidJob; }
+
+	float GetBlackAndWhitePrice() 
+	{ 
+		if (IsValidJob())
+			return m_price.m_fNonColorPrice * m_nNoneColorPages;
+		else
+			return 0.0;
+	};
+
+	float GetColorPrice()
+	{
+		if (IsValidJob())
+			return m_price.m_fColorPrice * m_nColorPages;
+		else
+			return 0.0;
+	}
+
+	int64_t GetBlackAndWhiteMilliCents() { return IsValidJob() ? m_price.m_nNonColorMilliCents * m_nNoneColorPages : 0; }
+	int64_t GetColorMilliCents() { return IsValidJob() ? m_price.m_nColorMilliCents * m_nColorPages : 0; }
+
+	int GetBlackWhitePages() { return m_nNoneColorPages; }
+	int GetColorPages() { return m_nColorPages; }
+	JobType GetPrintType() { return m_eJobType; }
+
+private:
+	int m_nNoneColorPages;
+	int m_nColorPages;
+	bool m_isValidJob;
+	JobType m_eJobType;
+	JobTypePrice m_price;
+};
+
+//A valid print job packed in 8 bytes.  Its pages are never negative, so the
+//top bit of the black and white pages holds the job type
+struct PackedPrintJob
+{
+	PackedPrintJob() : m_nBlackWhitePagesAndType(0), m_nColorPages(0) {}
+	PackedPrintJob(int nBlackWhitePages, int nColorPages, JobType eJobType)
+		: m_nBlackWhitePagesAndType(static_cast<uint32_t>(nBlackWhitePages) | (static_cast<uint32_t>(eJobType) << 31))
+		, m_nColorPages(static_cast<uint32_t>(nColorPages))
+	{
+	}
+
+	int GetBlackWhitePages() const { return static_cast<int>(m_nBlackWhitePagesAndType & 0x7fffffff); }
+	int GetColorPages() const { return static_cast<int>(m_nColorPages); }
+	JobType GetPrintType() const { return static_cast<JobType>(m_nBlackWhitePagesAndType >> 31); }
+	//Unpack the job to price it with a tariff
+	PrintJob ToPrintJob(const PrintTariff& tariff = GetDefaultTariff()) const
+	{
+		return PrintJob(GetBlackWhitePages() + GetColorPages(), GetColorPages(), GetPrintType(), tariff);
+	}
+
+	uint32_t m_nBlackWhitePagesAndType;
+	uint32_t m_nColorPages;
+};
+
+//Number of rows between two samples of the job count in CPrintJobStore
+const static int JOB_STORE_RANK_ROWS = 512;
+
+//The valid print jobs of a task in row order.  The jobs are packed one after
+//the other in an array and a bit per row tells the rows which hold a job, so
+//a job costs a little more than 8 bytes
+class CPrintJobStore
+{
+public:
+	//Add the job of row iRow, after the jobs of the earlier rows
+	void Add(int iRow, const PackedPrintJob& job)
+	{
+		while (static_cast<int>(m_vnRankSamples.size()) * JOB_STORE_RANK_ROWS <= iRow)
+			m_vnRankSamples.push_back(static_cast<int>(m_vJobs.size()));
+		if (iRow >= m_bvRows.Size())
+			m_bvRows.Resize(iRow + 1);
+		m_bvRows.Set(iRow, true);
+		m_vJobs.push_back(job);
+	}
+
+	void Clear();
+	int Size() const { return static_cast<int>(m_vJobs.size()); }
+	bool Empty() const { return m_vJobs.empty(); }
+
+	//The i-th job in row order
+	const PackedPrintJob& GetJob(int i) const { return m_vJobs[i]; }
+	//Find the job of row iRow, return false if the row has none
+	bool Find(int iRow, PackedPrintJob& job) const;
+	//Bytes allocated by the store
+	size_t GetMemoryUsage() const;
+
+	//Call fn(iRow, job) for every job in row order
+	template<class Fn>
+	void ForEach(Fn fn) const
+	{
+		const uint32_t* pWords = m_bvRows.GetWords();
+		int iJob = 0;
+		for (int iWord = 0; iWord * 32 < m_bvRows.Size(); iWord++)
+		{
+			int iBit = 0;
+			for (uint32_t nWord = pWords[iWord]; nWord != 0; nWord >>= 1, iBit++)
+			{
+				if (nWord & 1)
+					fn(iWord * 32 + iBit, m_vJobs[iJob++]);
+			}
+		}
+	}
+
+private:
+	std::vector<PackedPrintJob> m_vJobs;
+	//The bit of every row holding a job is set
+	CBitVector m_bvRows;
+	//The number of jobs before every JOB_STORE_RANK_ROWS rows
+	std::vector<int> m_vnRankSamples;
+};
+
+//The totals of one tariff priced by PrinterTask::DoCalculateScenarios
+struct PrinterScenarioTotals
+{
+	PrinterScenarioTotals() : m_fBlackAndWhite(0), m_fColor(0), m_nBlackAndWhiteMilliCents(0), m_nColorMilliCents(0) {}
+
+	//Added job by job, the same as the totals of DoCalculate with the tariff
+	float m_fBlackAndWhite;
+	float m_fColor;
+	//Exact, the pages by job type priced by the integer rates
+	int64_t m_nBlackAndWhiteMilliCents;
+	int64_t m_nColorMilliCents;
+};
+
+//The totals of one group of jobs priced by a PrinterTask with SetGroupBy
+struct PrintJobGroup
+{
+	PrintJobGroup() : m_nJobs(0), m_nBlackWhitePages(0), m_nColorPages(0), m_nBlackAndWhiteMilliCents(0), m_nColorMilliCents(0) {}
+
+	//The value of every group column, in the order of SetGroupBy
+	std::vector<std::string> m_vstrValues;
+	int64_t m_nJobs;
+	int64_t m_nBlackWhitePages;
+	int64_t m_nColorPages;
+	//Exact, the pages by job type priced by the integer rates
+	int64_t m_nBlackAndWhiteMilliCents;
+	int64_t m_nColorMilliCents;
+};
+
+//Load a print job file as a data set which is never changed, so several
+//tasks can price it at the same time.  The print job columns are converted
+//once, while the file is loaded, and the other columns are skipped
+std::shared_ptr<const CCsvDataFile> LoadPrintJobDataset(const std::string& strFileName, int nParseThreads = 1, bool bUseCache = false);
+
+//The class to create the printer task
+class PrinterTask
+{
+public:
+	//Create an empty task, used with DoCalculateStream
+	PrinterTask();
+	//Load all print job from a file name, a large file is parsed by
+	//nParseThreads threads.  With bUseCache the file is loaded from its
+	//column cache if it did not change, and the cache is written otherwise.
+	//Only the print job columns and vstrExtraColumns, e.g. the columns to
+	//group by, are kept, the parser skips the fields of the others
+	PrinterTask(const std::string& strFileName, int nParseThreads = 1, bool bUseCache = false,
+		const std::vector<std::string>& vstrExtraColumns = std::vector<std::string>());
+	PrinterTask(std::unique_ptr<CCsvDataFile> df);
+	//Price a data set shared with other tasks, loaded by LoadPrintJobDataset.
+	//The task only reads it, so it can not be used with DoCalculateStream
+	PrinterTask(std::shared_ptr<const CCsvDataFile> ptrDataset);
+	~PrinterTask();
+
+	bool DoCalculate();
+	//The error met when loading the file, empty if none
+	const char* GetLoadError() const { return m_ptrDataset->GetLastError(); }
+
+	//Same as DoCalculate, pricing blocks of rows on nThreads threads.  The
+	//sums of the blocks are added pairwise in a fixed order, so the totals
+	//are the same for any number of threads
+	bool DoCalculateParallel(int nThreads);
+
+	//Read the print jobs from a stream and calculate them batch by batch,
+	//so the memory used does not grow with the size of the input.  The rows
+	//are numbered from nFirstRow.  The bad rows are added to those of the
+	//calls before, so a stream can be priced in several calls
+	bool DoCalculateStream(std::istream& inStream, int nBatchRows = DEFAULT_STREAM_BATCH_ROWS, int nFirstRow = 0);
+	//The rows the parser read from the stream of the last DoCalculateStream
+	int GetNumberOfStreamedRows() const { return m_nStreamedRows; }
+
+	//Same as DoCalculateStream for a file read, parsed and priced by three
+	//stages at the same time: a thread reads the file ahead in large
+	//blocks, or decompresses it, a thread parses the batches and this thread
+	//prices them.  The stages pass blocks and batches through bounded
+	//queues, so the wall time nears the longest stage instead of the sum
+	bool DoCalculatePipeline(const std::string& strFileName, int nBatchRows = DEFAULT_STREAM_BATCH_ROWS);
+
+	//Price the rows loaded with every tariff of vTariffs in a single pass,
+	//the totals of tariff i in vTotals[i].  The rows are checked like
+	//DoCalculate does, but neither reported nor kept: the rows which are
+	//not print jobs go to vRowErrors, the last one being the row which
+	//stopped the calculation if it returns false.  Neither the totals nor
+	//the bad rows of the task itself change
+	bool DoCalculateScenarios(const std::vector<PrintTariff>& vTariffs, std::vector<PrinterScenarioTotals>& vTotals,
+		std::vector<std::pair<int, RowError> >& vRowErrors);
+
+	//Price the jobs with another tariff than the built-in one
+	void SetTariff(const PrintTariff& tariff) { m_tariff = tariff; }
+
+	//Write the jobs and the summary to another writer than the text one
+	//on stdout, which is used by default
+	void SetReportWriter(std::unique_ptr<CReportWriter> ptrReport);
+
+	//Write the totals to the report writer, as exact decimals if bExact
+	void WriteSummary(bool bExact);
+
+	//Also add up the valid jobs by the values of the named columns, e.g.
+	//department or user, in the same pass as DoCalculate,
+	//DoCalculateParallel or DoCalculateStream.  The rows of a file without
+	//one of the columns have an empty value for it.  A file loaded by name
+	//keeps only the columns given to the constructor, so these must be too
+	void SetGroupBy(const std::vector<std::string>& vstrColumns);
+	const std::vector<std::string>& GetGroupColumns() const { return m_vstrGroupColumns; }
+	//The totals of every group, sorted by the values of the group columns
+	void GetGroups(std::vector<PrintJobGroup>& vGroups) const;
+	//Write the totals of every group to the report writer
+	void WriteGroups(bool bExact);
+
+	//Choose whether the float totals are added job by job or converted from
+	//the exact totals, Float by default
+	void SetAccountingMode(AccountingMode eMode) { m_eAccountingMode = eMode; }
+
+	float GetTotalPriceForBlackAndWhite();
+	float GetTotalPriceForColor();
+
+	//The exact totals, whatever the accounting mode and the number of threads
+	int64_t GetTotalMilliCentsForBlackAndWhite() const;
+	int64_t GetTotalMilliCentsForColor() const;
+	std::string GetExactTotalForBlackAndWhite() const { return FormatMilliCents(GetTotalMilliCentsForBlackAndWhite()); }
+	std::string GetExactTotalForColor() const { return FormatMilliCents(GetTotalMilliCentsForColor()); }
+
+	//The running totals, and a way to start from saved ones instead of 0
+	PrinterTaskTotals GetTotals() const;
+	void SetTotals(const PrinterTaskTotals& totals);
+
+	//Keep the valid jobs of DoCalculate and DoCalculateParallel, true by
+	//default.  Only the totals are kept when it is false
+	void SetRetainJobs(bool bRetain) { m_bRetainJobs = bRetain; }
+	//The jobs kept by the last calculation
+	const CPrintJobStore& GetPrintJobs() const { return m_jobs; }
+
+	//Record the rows which are not print jobs and go on with the next row,
+	//instead of stopping at the first one.  The calculation then succeeds
+	//and the totals are those of the valid rows
+	void SetContinueOnError(bool bContinue) { m_bContinueOnError = bContinue; }
+
+	// Return all invalid rows of records
+	std::vector<int> GetExceptionLines();
+
+	//Why a row is not a print job, RowError::None if it is one
+	RowError GetRowError(int iRow) const;
+	int GetNumberOfExceptionRows() const { return static_cast<int>(m_veRowErrors.size()); }
+
+	//The timers and counters of the process since the task was created,
+	//the loading of the file included.  The stats are process-wide, not
+	//per task: tasks and threads running at the same time, e.g. other
+	//tasks of a batch, count each other's work too
+	void GetStats(PrinterStats& stats) const;
+
+private:
+	//The print job columns of the rows currently loaded
+	struct PrintJobColumns
+	{
+		CsvIntColumn m_totalPages;
+		CsvIntColumn m_colorPages;
+		CsvBoolColumn m_doubleSided;
+	};
+	bool GetColumns(PrintJobColumns& columns);
+
+	//Calculate the rows currently loaded in the CSV file
+	bool CalculateRows(bool bKeepPrintJobs);
+	//Return why the row i of the columns is not a print job
+	static RowError CheckRow(const PrintJobColumns& columns, int i);
+	//Record a loaded row which could not be read as a print job
+	bool AddExceptionRow(int i, RowError eError);
+	//Set the bit and the reason of a row which is not a print job.
+	//The rows are recorded in increasing order
+	void RecordRowError(int iRow, RowError eError);
+	//Forget the totals, groups, jobs and bad rows of an earlier calculation,
+	//before a whole file is calculated again
+	void ClearResults();
+	//Convert the print job columns of the CSV file once, when they are loaded
+	void AddTypedColumns();
+	//Resolve the print job columns by name once, after the header is read
+	void ResolveColumns();
+	//Start the totals from 0
+	void ResetTotals();
+	//Return the group of the loaded row i in table, strKey is a buffer for
+	//the key of the row
+	int FindGroup(CJobGroupTable& table, std::string& strKey, int i) const;
+
+	CPrintJobStore m_jobs;
+	bool m_bRetainJobs;
+	//Store the print job which has error reading the data
+	std::map<int, std::string> m_mapExceptionRows;
+	//A bit per row set for the rows which are not print jobs, and the
+	//reason of every set bit in row order
+	CBitVector m_bvExceptionRows;
+	std::vector<RowError> m_veRowErrors;
+	bool m_bContinueOnError;
+	int m_nStreamedRows;
+	float m_totalPriceBlackAndWhite;
+	float m_totalPriceColor;
+	//Pages of the valid jobs by job type, priced exactly when the totals are read
+	int64_t m_anNoneColorPages[JOB_TYPE_COUNT];
+	int64_t m_anColorPages[JOB_TYPE_COUNT];
+	AccountingMode m_eAccountingMode;
+	//The data set read by the calculations.  m_ptrCsvFile is the same file
+	//when the task owns it, and NULL when the data set is shared
+	std::shared_ptr<const CCsvDataFile> m_ptrDataset;
+	std::shared_ptr<CCsvDataFile> m_ptrCsvFile;
+	std::unique_ptr<CReportWriter> m_ptrReport;
+	PrintTariff m_tariff;
+	CsvColumnHandle m_hTotalPages;
+	CsvColumnHandle m_hColorPages;
+	CsvColumnHandle m_hDoubleSided;
+	PrinterStats m_statsStart;
+	//The columns of SetGroupBy and the totals of their groups, NULL if
+	//the jobs are not grouped
+	std::vector<std::string> m_vstrGroupColumns;
+	std::vector<CsvColumnHandle> m_vhGroupColumns;
+	std::unique_ptr<CJobGroupTable> m_ptrGroups;
+	std::string m_strGroupKey;
 };
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "stdafx.h"
+#include "PrintJobBatch.h"
+#include "CpuFeatures.h"
+
+#if defined(CPU_HAS_X86_SIMD)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// Partial sums of a batch, one per lane, and the pages by job type.
+struct PriceLanes
+{
+	double m_adBlackAndWhite[PRICE_LANES];
+	double m_adColor[PRICE_LANES];
+	int64_t m_anNoneColorPages[JOB_TYPE_COUNT];
+	int64_t m_anColorPages[JOB_TYPE_COUNT];
+};
+
+// Prices the jobs from iBegin to iEnd one at a time, job i going to lane
+// i % PRICE_LANES.  Portable kernel, also used for the tail of the others.
+static void PriceJobsScalar(const int* pnTotalPages, const int* pnColorPages, const uint8_t* pnJobTypes, int iBegin, int iEnd,
+	const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	PriceLanes& lanes, float* pfBlackAndWhite, float* pfColor)
+{
+	for (int i = iBegin; i < iEnd; i++)
+	{
+		int nNoneColorPages = pnTotalPages[i] - pnColorPages[i];
+		int nColorPages = pnColorPages[i];
+		const JobTypePrice& price = pnJobTypes[i] != 0 ? doublePrice : singlePrice;
+
+		float fBlackAndWhite = 0.0f, fColor = 0.0f;
+		if (nNoneColorPages >= 0 && nColorPages >= 0)
+		{
+			fBlackAndWhite = price.m_fNonColorPrice * nNoneColorPages;
+			fColor = price.m_fColorPrice * nColorPages;
+			lanes.m_anNoneColorPages[pnJobTypes[i] != 0 ? 1 : 0] += nNoneColorPages;
+			lanes.m_anColorPages[pnJobTypes[i] != 0 ? 1 : 0] += nColorPages;
+		}
+		lanes.m_adBlackAndWhite[i % PRICE_LANES] += fBlackAndWhite;
+		lanes.m_adColor[i % PRICE_LANES] += fColor;
+		if (pfBlackAndWhite != NULL)
+			pfBlackAndWhite[i] = fBlackAndWhite;
+		if (pfColor != NULL)
+			pfColor[i] = fColor;
+	}
+}
+
+#if defined(CPU_HAS_X86_SIMD)
+
+// Adds four 32-bit counts, which are not negative, to two 64-bit sums.
+static __m128i AddPagesSse(__m128i anSum, __m128i nPages)
+{
+	__m128i zero = _mm_setzero_si128();
+	return _mm_add_epi64(anSum, _mm_add_epi64(_mm_unpacklo_epi32(nPages, zero), _mm_unpackhi_epi32(nPages, zero)));
+}
+
+// Costs of four jobs, 0 where isValid is clear.  isSingle selects the single
+// sided rates, and is all ones or all zeros per job.  The pages of the valid
+// jobs are added to anPages, single sided then double sided.
+static void PriceFourSse(__m128i nTotal, __m128i nColor, __m128i isSingle, const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	__m128& fBlackAndWhite, __m128& fColor, __m128i* anPages)
+{
+	__m128i nNoneColor = _mm_sub_epi32(nTotal, nColor);
+	__m128i zero = _mm_setzero_si128();
+	__m128i isValidInt = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(nNoneColor, zero), _mm_cmplt_epi32(nColor, zero)), _mm_set1_epi32(-1));
+	__m128 isValid = _mm_castsi128_ps(isValidInt);
+	__m128 single = _mm_castsi128_ps(isSingle);
+
+	__m128i nValidNoneColor = _mm_and_si128(isValidInt, nNoneColor);
+	__m128i nValidColor = _mm_and_si128(isValidInt, nColor);
+	anPages[0] = AddPagesSse(anPages[0], _mm_and_si128(isSingle, nValidNoneColor));
+	anPages[1] = AddPagesSse(anPages[1], _mm_andnot_si128(isSingle, nValidNoneColor));
+	anPages[2] = AddPagesSse(anPages[2], _mm_and_si128(isSingle, nValidColor));
+	anPages[3] = AddPagesSse(anPages[3], _mm_andnot_si128(isSingle, nValidColor));
+
+	// no blendv before SSE4.1, select with and/andnot
+	__m128 fNoneColorRate = _mm_or_ps(_mm_and_ps(single, _mm_set1_ps(singlePrice.m_fNonColorPrice)), _mm_andnot_ps(single, _mm_set1_ps(doublePrice.m_fNonColorPrice)));
+	__m128 fColorRate = _mm_or_ps(_mm_and_ps(single, _mm_set1_ps(singlePrice.m_fColorPrice)), _mm_andnot_ps(single, _mm_set1_ps(doublePrice.m_fColorPrice)));
+
+	fBlackAndWhite = _mm_and_ps(isValid, _mm_mul_ps(fNoneColorRate, _mm_cvtepi32_ps(nNoneColor)));
+	fColor = _mm_and_ps(isValid, _mm_mul_ps(fColorRate, _mm_cvtepi32_ps(nColor)));
+}
+
+// 128-bit kernel, eight jobs per step summed into four pairs of lanes.
+static int PriceJobsSse(const int* pnTotalPages, const int* pnColorPages, const uint8_t* pnJobTypes, int nJobs,
+	const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	PriceLanes& lanes, float* pfBlackAndWhite, float* pfColor)
+{
+	__m128d adBlackAndWhite[PRICE_LANES / 2], adColor[PRICE_LANES / 2];
+	for (int k = 0; k < PRICE_LANES / 2; k++)
+	{
+		adBlackAndWhite[k] = _mm_loadu_pd(&lanes.m_adBlackAndWhite[2 * k]);
+		adColor[k] = _mm_loadu_pd(&lanes.m_adColor[2 * k]);
+	}
+	// none color single, none color double, color single, color double
+	__m128i anPages[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+
+	int i = 0;
+	for (; i + PRICE_LANES <= nJobs; i += PRICE_LANES)
+	{
+		// one byte per job widened to a 32-bit mask per job
+		__m128i isSingle = _mm_cmpeq_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pnJobTypes + i)), _mm_setzero_si128());
+		isSingle = _mm_unpacklo_epi8(isSingle, isSingle);
+
+		for (int h = 0; h < 2; h++)
+		{
+			__m128i nTotal = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pnTotalPages + i + 4 * h));
+			__m128i nColor = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pnColorPages + i + 4 * h));
+			__m128i isSingleFour = h == 0 ? _mm_unpacklo_epi16(isSingle, isSingle) : _mm_unpackhi_epi16(isSingle, isSingle);
+
+			__m128 fBlackAndWhite, fColor;
+			PriceFourSse(nTotal, nColor, isSingleFour, singlePrice, doublePrice, fBlackAndWhite, fColor, anPages);
+			if (pfBlackAndWhite != NULL)
+				_mm_storeu_ps(pfBlackAndWhite + i + 4 * h, fBlackAndWhite);
+			if (pfColor != NULL)
+				_mm_storeu_ps(pfColor + i + 4 * h, fColor);
+
+			adBlackAndWhite[2 * h] = _mm_add_pd(adBlackAndWhite[2 * h], _mm_cvtps_pd(fBlackAndWhite));
+			adBlackAndWhite[2 * h + 1] = _mm_add_pd(adBlackAndWhite[2 * h + 1], _mm_cvtps_pd(_mm_movehl_ps(fBlackAndWhite, fBlackAndWhite)));
+			adColor[2 * h] = _mm_add_pd(adColor[2 * h], _mm_cvtps_pd(fColor));
+			adColor[2 * h + 1] = _mm_add_pd(adColor[2 * h + 1], _mm_cvtps_pd(_mm_movehl_ps(fColor, fColor)));
+		}
+	}
+
+	for (int k = 0; k < PRICE_LANES / 2; k++)
+	{
+		_mm_storeu_pd(&lanes.m_adBlackAndWhite[2 * k], adBlackAndWhite[k]);
+		_mm_storeu_pd(&lanes.m_adColor[2 * k], adColor[k]);
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		int64_t anSums[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(anSums), anPages[k]);
+		int64_t* pnPages = k < 2 ? lanes.m_anNoneColorPages : lanes.m_anColorPages;
+		pnPages[k % 2] += anSums[0] + anSums[1];
+	}
+	return i;
+}
+
+// Adds eight 32-bit counts, which are not negative, to four 64-bit sums.
+CPU_TARGET_AVX2 static __m256i AddPagesAvx2(__m256i anSum, __m256i nPages)
+{
+	__m256i nLow = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(nPages));
+	__m256i nHigh = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(nPages, 1));
+	return _mm256_add_epi64(anSum, _mm256_add_epi64(nLow, nHigh));
+}
+
+// 256-bit kernel, eight jobs per step summed into two quads of lanes.
+CPU_TARGET_AVX2 static int PriceJobsAvx2(const int* pnTotalPages, const int* pnColorPages, const uint8_t* pnJobTypes, int nJobs,
+	const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	PriceLanes& lanes, float* pfBlackAndWhite, float* pfColor)
+{
+	__m256d adBlackAndWhite[2], adColor[2];
+	for (int k = 0; k < 2; k++)
+	{
+		adBlackAndWhite[k] = _mm256_loadu_pd(&lanes.m_adBlackAndWhite[4 * k]);
+		adColor[k] = _mm256_loadu_pd(&lanes.m_adColor[4 * k]);
+	}
+
+	// none color single, none color double, color single, color double
+	__m256i anPages[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256 fSingleNoneColorRate = _mm256_set1_ps(singlePrice.m_fNonColorPrice);
+	const __m256 fDoubleNoneColorRate = _mm256_set1_ps(doublePrice.m_fNonColorPrice);
+	const __m256 fSingleColorRate = _mm256_set1_ps(singlePrice.m_fColorPrice);
+	const __m256 fDoubleColorRate = _mm256_set1_ps(doublePrice.m_fColorPrice);
+
+	int i = 0;
+	for (; i + PRICE_LANES <= nJobs; i += PRICE_LANES)
+	{
+		__m256i nTotal = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pnTotalPages + i));
+		__m256i nColor = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pnColorPages + i));
+		__m256i nNoneColor = _mm256_sub_epi32(nTotal, nColor);
+		__m256i nTypes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pnJobTypes + i)));
+
+		__m256i isDoubleInt = _mm256_xor_si256(_mm256_cmpeq_epi32(nTypes, zero), _mm256_set1_epi32(-1));
+		__m256i isValidInt = _mm256_xor_si256(_mm256_or_si256(_mm256_cmpgt_epi32(zero, nNoneColor), _mm256_cmpgt_epi32(zero, nColor)), _mm256_set1_epi32(-1));
+		__m256 isDouble = _mm256_castsi256_ps(isDoubleInt);
+		__m256 isValid = _mm256_castsi256_ps(isValidInt);
+
+		__m256i nValidNoneColor = _mm256_and_si256(isValidInt, nNoneColor);
+		__m256i nValidColor = _mm256_and_si256(isValidInt, nColor);
+		anPages[0] = AddPagesAvx2(anPages[0], _mm256_andnot_si256(isDoubleInt, nValidNoneColor));
+		anPages[1] = AddPagesAvx2(anPages[1], _mm256_and_si256(isDoubleInt, nValidNoneColor));
+		anPages[2] = AddPagesAvx2(anPages[2], _mm256_andnot_si256(isDoubleInt, nValidColor));
+		anPages[3] = AddPagesAvx2(anPages[3], _mm256_and_si256(isDoubleInt, nValidColor));
+
+		__m256 fBlackAndWhite = _mm256_and_ps(isValid, _mm256_mul_ps(_mm256_blendv_ps(fSingleNoneColorRate, fDoubleNoneColorRate, isDouble), _mm256_cvtepi32_ps(nNoneColor)));
+		__m256 fColor = _mm256_and_ps(isValid, _mm256_mul_ps(_mm256_blendv_ps(fSingleColorRate, fDoubleColorRate, isDouble), _mm256_cvtepi32_ps(nColor)));
+		if (pfBlackAndWhite != NULL)
+			_mm256_storeu_ps(pfBlackAndWhite + i, fBlackAndWhite);
+		if (pfColor != NULL)
+			_mm256_storeu_ps(pfColor + i, fColor);
+
+		adBlackAndWhite[0] = _mm256_add_pd(adBlackAndWhite[0], _mm256_cvtps_pd(_mm256_castps256_ps128(fBlackAndWhite)));
+		adBlackAndWhite[1] = _mm256_add_pd(adBlackAndWhite[1], _mm256_cvtps_pd(_mm256_extractf128_ps(fBlackAndWhite, 1)));
+		adColor[0] = _mm256_add_pd(adColor[0], _mm256_cvtps_pd(_mm256_castps256_ps128(fColor)));
+		adColor[1] = _mm256_add_pd(adColor[1], _mm256_cvtps_pd(_mm256_extractf128_ps(fColor, 1)));
+	}
+
+	for (int k = 0; k < 2; k++)
+	{
+		_mm256_storeu_pd(&lanes.m_adBlackAndWhite[4 * k], adBlackAndWhite[k]);
+		_mm256_storeu_pd(&lanes.m_adColor[4 * k], adColor[k]);
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		int64_t anSums[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(anSums), anPages[k]);
+		int64_t* pnPages = k < 2 ? lanes.m_anNoneColorPages : lanes.m_anColorPages;
+		pnPages[k % 2] += (anSums[0] + anSums[1]) + (anSums[2] + anSums[3]);
+	}
+	return i;
+}
+
+#endif
+
+// Adds the lanes pairwise, neighbours first.
+static double SumLanes(const double* pdLanes)
+{
+	return ((pdLanes[0] + pdLanes[1]) + (pdLanes[2] + pdLanes[3])) + ((pdLanes[4] + pdLanes[5]) + (pdLanes[6] + pdLanes[7]));
+}
+
+PriceKernel GetBestPriceKernel()
+{
+	const CpuFeatures& features = GetCpuFeatures();
+	if (features.m_bAvx2)
+		return PriceKernel::AVX2;
+	if (features.m_bSse2)
+		return PriceKernel::SSE;
+	return PriceKernel::Scalar;
+}
+
+void PricePrintJobs(const int* pnTotalPages, const int* pnColorPages, const uint8_t* pnJobTypes, int nJobs,
+	const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	PrintBatchCost& cost, float* pfBlackAndWhite, float* pfColor, PriceKernel eKernel)
+{
+	PriceLanes lanes = {};
+
+	// never run a kernel the CPU can't run
+	if (eKernel > GetBestPriceKernel())
+		eKernel = GetBestPriceKernel();
+
+	int i = 0;
+#if defined(CPU_HAS_X86_SIMD)
+	if (eKernel == PriceKernel::AVX2)
+		i = PriceJobsAvx2(pnTotalPages, pnColorPages, pnJobTypes, nJobs, singlePrice, doublePrice, lanes, pfBlackAndWhite, pfColor);
+	else if (eKernel == PriceKernel::SSE)
+		i = PriceJobsSse(pnTotalPages, pnColorPages, pnJobTypes, nJobs, singlePrice, doublePrice, lanes, pfBlackAndWhite, pfColor);
+#endif
+	PriceJobsScalar(pnTotalPages, pnColorPages, pnJobTypes, i, nJobs, singlePrice, doublePrice, lanes, pfBlackAndWhite, pfColor);
+
+	cost.m_dBlackAndWhite = SumLanes(lanes.m_adBlackAndWhite);
+	cost.m_dColor = SumLanes(lanes.m_adColor);
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		cost.m_anNoneColorPages[k] = lanes.m_anNoneColorPages[k];
+		cost.m_anColorPages[k] = lanes.m_anColorPages[k];
+	}
+}
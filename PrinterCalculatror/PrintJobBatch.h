@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include "PrintJob.h"
+
+// Implementations of the batch pricing, from slowest to fastest.
+enum class PriceKernel
+{
+	Scalar = 0,
+	SSE,
+	AVX2
+};
+
+// Returns the fastest kernel the running CPU supports.
+PriceKernel GetBestPriceKernel();
+
+// Number of partial sums kept by PricePrintJobs.  Job i is added to sum
+// i % PRICE_LANES whatever the kernel, so all kernels return the same bits.
+const static int PRICE_LANES = 8;
+
+// Sums of the costs of a batch of print jobs.
+struct PrintBatchCost
+{
+	PrintBatchCost() : m_dBlackAndWhite(0), m_dColor(0)
+	{
+		for (int i = 0; i < JOB_TYPE_COUNT; i++)
+			m_anNoneColorPages[i] = m_anColorPages[i] = 0;
+	}
+
+	double m_dBlackAndWhite;
+	double m_dColor;
+
+	// Pages of the valid jobs by job type.  Priced by the integer rates of a
+	// tariff they give the exact totals, whatever the order of the jobs.
+	int64_t m_anNoneColorPages[JOB_TYPE_COUNT];
+	int64_t m_anColorPages[JOB_TYPE_COUNT];
+};
+
+// Prices nJobs print jobs stored as arrays.  A job is double sided if its
+// entry in pnJobTypes is not 0.  Jobs with a negative number of pages cost
+// nothing, like an invalid PrintJob.  The costs of every job are also stored
+// in pfBlackAndWhite and pfColor unless they are NULL.  The costs are those
+// of PrintJob::GetBlackAndWhitePrice() and GetColorPrice().
+void PricePrintJobs(const int* pnTotalPages, const int* pnColorPages, const uint8_t* pnJobTypes, int nJobs,
+	const JobTypePrice& singlePrice, const JobTypePrice& doublePrice,
+	PrintBatchCost& cost, float* pfBlackAndWhite = NULL, float* pfColor = NULL,
+	PriceKernel eKernel = GetBestPriceKernel());
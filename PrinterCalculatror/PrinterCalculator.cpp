@@ -1,26 +1,337 @@
-// PrinterCalculatror.cpp : Defines the entry point for the console application.
-//
-
-#include "stdafx.h"
-#include "PrintJob.h"
-
-using namespace std;
-
-int main(int argc, char* argv[])
-{
-	if (argc != 2)
-	{
-		printf("Usage: PrinterCalculator.exe [filename]");
-		return -1;
-	}
-	unique_ptr<PrinterTask> printTask = make_unique<PrinterTask>(argv[1]);
-	if (printTask->DoCalculate())
-	{
-		printf("Summary:\n");
-		printf("Total cost for black and white printing is %.2f\n", printTask->GetTotalPriceForBlackAndWhite());
-		printf("Total cost for color printing is %.2f\n", printTask->GetTotalPriceForColor());
-	}
-
-	return 0;
-}
-
+// PrinterCalculatror.cpp : Defines the entry point for the console application.
+//
+
+#include "stdafx.h"
+#include "BatchRunner.h"
+#include "JobLogFollower.h"
+#include "PrintJob.h"
+#include "PrinterStats.h"
+#include "ReportWriter.h"
+#include "WorkerThreads.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// Longest wait for the job log to grow in "--follow" mode
+static const int FOLLOW_POLL_MS = 1000;
+
+// Prices the rows appended to a job log since its checkpoint and writes the
+// totals, then again every time the log grows when bFollow
+static int RunFollowMode(const char* szFileName, const string& strCheckpointName, const PrintTariff& tariff, bool bContinue, bool bExact, bool bFollow, ReportMode eReportMode)
+{
+	CJobLogFollower follower(szFileName, strCheckpointName);
+	string strError;
+	if (!follower.Open(tariff, bContinue, eReportMode, strError))
+	{
+		printf("%s", strError.c_str());
+		return -1;
+	}
+
+	int nNewRows = 0;
+	do
+	{
+		if (!follower.Update(nNewRows, strError))
+		{
+			printf("%s", strError.c_str());
+			return -1;
+		}
+		if (nNewRows > 0 || !bFollow)
+			follower.WriteSummary(bExact);
+		if (bFollow)
+			follower.WaitForChange(FOLLOW_POLL_MS);
+	} while (bFollow);
+	return 0;
+}
+
+// Loads the file once and prices it with every scenario tariff in a single
+// pass, then writes the totals of each tariff named by its file
+static int RunScenarioMode(const char* szFileName, const vector<string>& vstrScenarioFiles, int nParseThreads, bool bUseCache, bool bContinue, bool bExact, ReportMode eReportMode)
+{
+	vector<PrintTariff> vTariffs(vstrScenarioFiles.size());
+	string strError;
+	for (size_t i = 0; i < vstrScenarioFiles.size(); i++)
+	{
+		if (!vTariffs[i].LoadFromFile(vstrScenarioFiles[i].c_str(), strError))
+		{
+			printf("Meet error when loading the tariff: %s", strError.c_str());
+			return -1;
+		}
+	}
+
+	PrinterTask printTask(LoadPrintJobDataset(szFileName, nParseThreads, bUseCache));
+	printTask.SetContinueOnError(bContinue);
+	vector<PrinterScenarioTotals> vTotals;
+	vector<pair<int, RowError> > vRowErrors;
+	if (!printTask.DoCalculateScenarios(vTariffs, vTotals, vRowErrors))
+	{
+		// an error loading the file is printed by DoCalculateScenarios
+		if (!vRowErrors.empty())
+			printf("Meet error when pricing the scenarios: row %d is not a print job: %s", vRowErrors.back().first, GetRowErrorText(vRowErrors.back().second));
+		return 0;
+	}
+
+	// the totals of a scenario are its file summary, even when no jobs are reported
+	CReportWriter report(eReportMode == ReportMode::Json ? ReportMode::Json : eReportMode == ReportMode::None ? ReportMode::None : ReportMode::Text);
+	char szBlackAndWhite[REPORT_NUMBER_SIZE], szColor[REPORT_NUMBER_SIZE];
+	for (size_t i = 0; i < vTotals.size(); i++)
+	{
+		if (bExact)
+			report.WriteFileSummary(vstrScenarioFiles[i], NULL, FormatMilliCents(vTotals[i].m_nBlackAndWhiteMilliCents), FormatMilliCents(vTotals[i].m_nColorMilliCents));
+		else
+		{
+			FormatPrice(vTotals[i].m_fBlackAndWhite, szBlackAndWhite);
+			FormatPrice(vTotals[i].m_fColor, szColor);
+			report.WriteFileSummary(vstrScenarioFiles[i], NULL, szBlackAndWhite, szColor);
+		}
+	}
+	return 0;
+}
+
+// Writes the timers and counters as one line of JSON to stderr, so they do
+// not mix with the report
+static void WriteStats(const PrinterStats& stats)
+{
+	fprintf(stderr, "%s\n", stats.ToJson().c_str());
+}
+
+// Prices every file named by vstrArgs and writes the totals of each file,
+// then the totals of all of them
+static int RunBatchMode(const vector<string>& vstrArgs, const PrintTariff& tariff, bool bContinue, bool bExact, int nThreads, ReportMode eReportMode)
+{
+	vector<string> vstrFiles;
+	string strError;
+	if (!CollectBatchFiles(vstrArgs, vstrFiles, strError))
+	{
+		printf("%s", strError.c_str());
+		return -1;
+	}
+
+	vector<BatchFileResult> vResults;
+	RunBatch(vstrFiles, tariff, bContinue, nThreads, vResults);
+
+	CReportWriter report(eReportMode);
+	float fBlackAndWhite = 0, fColor = 0;
+	int64_t nBlackAndWhite = 0, nColor = 0;
+	char szBlackAndWhite[REPORT_NUMBER_SIZE], szColor[REPORT_NUMBER_SIZE];
+	for (size_t i = 0; i < vResults.size(); i++)
+	{
+		const BatchFileResult& result = vResults[i];
+		if (!result.m_bDone)
+		{
+			report.WriteFileSummary(result.m_strFileName, result.m_strError.c_str(), "", "");
+			continue;
+		}
+		fBlackAndWhite += result.m_fBlackAndWhite;
+		fColor += result.m_fColor;
+		nBlackAndWhite += result.m_nBlackAndWhiteMilliCents;
+		nColor += result.m_nColorMilliCents;
+		if (bExact)
+			report.WriteFileSummary(result.m_strFileName, NULL, FormatMilliCents(result.m_nBlackAndWhiteMilliCents), FormatMilliCents(result.m_nColorMilliCents));
+		else
+		{
+			FormatPrice(result.m_fBlackAndWhite, szBlackAndWhite);
+			FormatPrice(result.m_fColor, szColor);
+			report.WriteFileSummary(result.m_strFileName, NULL, szBlackAndWhite, szColor);
+		}
+	}
+
+	if (bExact)
+		report.WriteSummary(FormatMilliCents(nBlackAndWhite), FormatMilliCents(nColor));
+	else
+	{
+		FormatPrice(fBlackAndWhite, szBlackAndWhite);
+		FormatPrice(fColor, szColor);
+		report.WriteSummary(szBlackAndWhite, szColor);
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	// "--stream" reads the file in batches, "-" streams from stdin,
+	// "--pipeline" reads, parses and prices the batches of the file on three threads at once,
+	// "--threads N" parses and prices the file with N threads, 0 for one per core,
+	// "--tariff file" reads the rates from a CSV file,
+	// "--exact" prints the totals added exactly in milli-cents,
+	// "--continue" skips the rows which are not print jobs instead of stopping,
+	// "--report none|summary|text|json" selects what is written,
+	// "--batch" prices every file, directory and @list given, N files at a time,
+	// "--checkpoint file" prices only the rows appended since the checkpoint,
+	// "--follow" keeps pricing the rows appended to the file,
+	// "--cache" loads the file from its column cache, written by the first run,
+	// "--stats" writes where the time went as JSON to stderr,
+	// "--scenario file" prices the file with the tariff of each scenario file given,
+	// "--group-by col[,col...]" also writes the totals of the jobs by the values of the columns
+	bool bStream = false;
+	bool bPipeline = false;
+	bool bStats = false;
+	bool bBatch = false;
+	bool bBadArgument = false;
+	bool bFollow = false;
+	bool bUseCache = false;
+	const char* szCheckpointName = NULL;
+	vector<string> vstrArgs;
+	ReportMode eReportMode = ReportMode::Text;
+	bool bExact = false;
+	bool bContinue = false;
+	int nParseThreads = 1;
+	const char* szTariffFileName = NULL;
+	vector<string> vstrScenarioFiles;
+	vector<string> vstrGroupColumns;
+	const char* szFileName = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--stream") == 0)
+			bStream = true;
+		else if (strcmp(argv[i], "--pipeline") == 0)
+			bPipeline = true;
+		else if (strcmp(argv[i], "--batch") == 0)
+			bBatch = true;
+		else if (strcmp(argv[i], "--follow") == 0)
+			bFollow = true;
+		else if (strcmp(argv[i], "--cache") == 0)
+			bUseCache = true;
+		else if (strcmp(argv[i], "--stats") == 0)
+			bStats = true;
+		else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+			szCheckpointName = argv[++i];
+		else if (strcmp(argv[i], "--exact") == 0)
+			bExact = true;
+		else if (strcmp(argv[i], "--continue") == 0)
+			bContinue = true;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			nParseThreads = atoi(argv[++i]);
+			if (nParseThreads <= 0)
+				nParseThreads = GetHardwareThreadCount();
+		}
+		else if (strcmp(argv[i], "--tariff") == 0 && i + 1 < argc)
+			szTariffFileName = argv[++i];
+		else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc)
+			vstrScenarioFiles.push_back(argv[++i]);
+		else if (strcmp(argv[i], "--group-by") == 0 && i + 1 < argc)
+		{
+			string strColumns = argv[++i];
+			for (size_t iBegin = 0; iBegin <= strColumns.length();)
+			{
+				size_t iEnd = strColumns.find(',', iBegin);
+				if (iEnd == string::npos)
+					iEnd = strColumns.length();
+				if (iEnd == iBegin)
+					bBadArgument = true;
+				vstrGroupColumns.push_back(strColumns.substr(iBegin, iEnd - iBegin));
+				iBegin = iEnd + 1;
+			}
+		}
+		else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+		{
+			const char* szMode = argv[++i];
+			if (strcmp(szMode, "none") == 0)
+				eReportMode = ReportMode::None;
+			else if (strcmp(szMode, "summary") == 0)
+				eReportMode = ReportMode::Summary;
+			else if (strcmp(szMode, "json") == 0)
+				eReportMode = ReportMode::Json;
+			else if (strcmp(szMode, "text") == 0)
+				eReportMode = ReportMode::Text;
+			else
+				bBadArgument = true;
+		}
+		else
+		{
+			vstrArgs.push_back(argv[i]);
+			szFileName = szFileName == NULL ? argv[i] : "";
+		}
+	}
+	if (bBatch ? vstrArgs.empty() || bStream : szFileName == NULL || szFileName[0] == '\0')
+		bBadArgument = true;
+	if ((bFollow || szCheckpointName != NULL) && (bBatch || bStream || szFileName == NULL || strcmp(szFileName, "-") == 0))
+		bBadArgument = true;
+	if (bPipeline && (bStream || bBatch || bFollow || szCheckpointName != NULL || !vstrScenarioFiles.empty() || szFileName == NULL || strcmp(szFileName, "-") == 0))
+		bBadArgument = true;
+	if (!vstrGroupColumns.empty() && (bBatch || bFollow || szCheckpointName != NULL || !vstrScenarioFiles.empty()))
+		bBadArgument = true;
+	if (!vstrScenarioFiles.empty() && (bBatch || bStream || bFollow || szCheckpointName != NULL || szTariffFileName != NULL || szFileName == NULL || strcmp(szFileName, "-") == 0))
+		bBadArgument = true;
+	if (bBadArgument)
+	{
+		printf("Usage: PrinterCalculator.exe [--stream | --pipeline] [--threads N] [--cache] [--stats] [--tariff file] [--exact] [--continue] [--group-by col[,col...]] [--report none|summary|text|json] [filename | -]\n");
+		printf("       PrinterCalculator.exe [--follow] [--checkpoint file] [--stats] [--tariff file] [--exact] [--continue] [--report none|summary|text|json] filename\n");
+		printf("       PrinterCalculator.exe --batch [--threads N] [--stats] [--tariff file] [--exact] [--continue] [--report none|summary|text|json] file | directory | @list ...\n");
+		printf("       PrinterCalculator.exe --scenario file [--scenario file ...] [--threads N] [--cache] [--stats] [--exact] [--continue] [--report none|text|json] filename");
+		return -1;
+	}
+
+	PrintTariff tariff;
+	string strError;
+	if (szTariffFileName != NULL && !tariff.LoadFromFile(szTariffFileName, strError))
+	{
+		printf("Meet error when loading the tariff: %s", strError.c_str());
+		return -1;
+	}
+
+	if (bFollow || szCheckpointName != NULL || bBatch || !vstrScenarioFiles.empty())
+	{
+		int nResult = bBatch ? RunBatchMode(vstrArgs, tariff, bContinue, bExact, nParseThreads, eReportMode)
+			: !vstrScenarioFiles.empty() ? RunScenarioMode(szFileName, vstrScenarioFiles, nParseThreads, bUseCache, bContinue, bExact, eReportMode)
+			: RunFollowMode(szFileName, szCheckpointName != NULL ? szCheckpointName : string(szFileName) + ".checkpoint", tariff, bContinue, bExact, bFollow, eReportMode);
+		if (bStats)
+		{
+			PrinterStats stats;
+			GetProcessStats(stats);
+			WriteStats(stats);
+		}
+		return nResult;
+	}
+
+	bool bFromStdin = strcmp(szFileName, "-") == 0;
+	ifstream inFile;
+	if (bStream && !bFromStdin)
+	{
+		inFile.open(szFileName, ifstream::binary | ifstream::in);
+		if (!inFile.is_open())
+		{
+			printf("Meet error when loading the file: %s", szFileName);
+			return -1;
+		}
+	}
+
+	unique_ptr<PrinterTask> printTask;
+	if (bStream || bPipeline || bFromStdin)
+		printTask = make_unique<PrinterTask>();
+	else
+		printTask = make_unique<PrinterTask>(szFileName, nParseThreads, bUseCache, vstrGroupColumns);
+	printTask->SetTariff(tariff);
+	printTask->SetReportWriter(make_unique<CReportWriter>(eReportMode));
+	printTask->SetContinueOnError(bContinue);
+	printTask->SetGroupBy(vstrGroupColumns);
+	//The jobs are reported as they are priced, only the totals are needed after
+	printTask->SetRetainJobs(false);
+
+	bool bDone = false;
+	if (bFromStdin)
+		bDone = printTask->DoCalculateStream(cin);
+	else if (bStream)
+		bDone = printTask->DoCalculateStream(inFile);
+	else if (bPipeline)
+		bDone = printTask->DoCalculatePipeline(szFileName);
+	else
+		bDone = nParseThreads > 1 ? printTask->DoCalculateParallel(nParseThreads) : printTask->DoCalculate();
+
+	if (bDone)
+	{
+		printTask->WriteSummary(bExact);
+		printTask->WriteGroups(bExact);
+	}
+
+	if (bStats)
+	{
+		PrinterStats stats;
+		printTask->GetStats(stats);
+		WriteStats(stats);
+	}
+	return 0;
+}
@@ -0,0 +1,185 @@
+#include "PrinterStats.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// The steady clock time the ticks are measured against at least
+static const double MIN_CALIBRATION_SECONDS = 0.01;
+
+static const char* STATS_PHASE_NAMES[STATS_PHASE_COUNT] =
+{
+	"file_read", "parse", "header_lookup", "convert", "calculate", "report"
+};
+
+static const char* STATS_COUNTER_NAMES[STATS_COUNTER_COUNT] =
+{
+	"bytes", "rows", "jobs", "row_errors", "header_lookups", "report_bytes"
+};
+
+STATS_THREAD_LOCAL StatsThreadState g_statsThread;
+CStatsSlot g_aStatsSlots[MAX_STATS_THREADS];
+
+// The ticks and the time when the process started
+static const uint64_t s_nStartTicks = ReadStatsTicks();
+static const std::chrono::steady_clock::time_point s_startTime = std::chrono::steady_clock::now();
+
+const char* GetStatsPhaseName(StatsPhase ePhase)
+{
+	return STATS_PHASE_NAMES[static_cast<int>(ePhase)];
+}
+
+const char* GetStatsCounterName(StatsCounter eCounter)
+{
+	return STATS_COUNTER_NAMES[static_cast<int>(eCounter)];
+}
+
+StatsValues::StatsValues()
+{
+	memset(m_anPhaseTicks, 0, sizeof(m_anPhaseTicks));
+	memset(m_anPhaseCalls, 0, sizeof(m_anPhaseCalls));
+	memset(m_anCounters, 0, sizeof(m_anCounters));
+}
+
+bool StatsValues::IsEmpty() const
+{
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+	{
+		if (m_anPhaseCalls[i] != 0)
+			return false;
+	}
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+	{
+		if (m_anCounters[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+void StatsValues::Add(const StatsValues& other)
+{
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+	{
+		m_anPhaseTicks[i] += other.m_anPhaseTicks[i];
+		m_anPhaseCalls[i] += other.m_anPhaseCalls[i];
+	}
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+		m_anCounters[i] += other.m_anCounters[i];
+}
+
+void StatsValues::Subtract(const StatsValues& other)
+{
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+	{
+		m_anPhaseTicks[i] -= other.m_anPhaseTicks[i];
+		m_anPhaseCalls[i] -= other.m_anPhaseCalls[i];
+	}
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+		m_anCounters[i] -= other.m_anCounters[i];
+}
+
+void PrinterStats::Subtract(const PrinterStats& start)
+{
+	m_nTicks -= start.m_nTicks;
+	m_total.Subtract(start.m_total);
+	for (size_t i = 0; i < m_vThreads.size() && i < start.m_vThreads.size(); i++)
+		m_vThreads[i].Subtract(start.m_vThreads[i]);
+}
+
+double PrinterStats::GetPhaseSeconds(StatsPhase ePhase) const
+{
+	return m_total.m_anPhaseTicks[static_cast<int>(ePhase)] / GetStatsTicksPerSecond();
+}
+
+void GetProcessStats(PrinterStats& stats)
+{
+	stats.m_nTicks = ReadStatsTicks() - s_nStartTicks;
+	stats.m_total = StatsValues();
+	stats.m_vThreads.resize(MAX_STATS_THREADS);
+	for (int i = 0; i < MAX_STATS_THREADS; i++)
+	{
+		g_aStatsSlots[i].Read(stats.m_vThreads[i]);
+		stats.m_total.Add(stats.m_vThreads[i]);
+	}
+}
+
+void CStatsSlot::Read(StatsValues& values) const
+{
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+	{
+		values.m_anPhaseTicks[i] = m_anPhaseTicks[i].load(std::memory_order_relaxed);
+		values.m_anPhaseCalls[i] = m_anPhaseCalls[i].load(std::memory_order_relaxed);
+	}
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+		values.m_anCounters[i] = m_anCounters[i].load(std::memory_order_relaxed);
+}
+
+void SetStatsThread(int iThread)
+{
+	if (iThread >= MAX_STATS_THREADS)
+		iThread = MAX_STATS_THREADS - 1;
+	g_statsThread.m_pSlot = iThread > 0 ? &g_aStatsSlots[iThread] : NULL;
+}
+
+double GetStatsTicksPerSecond()
+{
+#if defined(CPU_HAS_X86_SIMD)
+	// Wait until the clocks ran long enough to compare them
+	double fSeconds;
+	uint64_t nTicks;
+	do
+	{
+		nTicks = ReadStatsTicks() - s_nStartTicks;
+		fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - s_startTime).count();
+	} while (fSeconds < MIN_CALIBRATION_SECONDS);
+	return nTicks / fSeconds;
+#else
+	return 1e9;
+#endif
+}
+
+// Appends "name":{"seconds":s,"calls":n} for every phase and "name":n for
+// every counter
+static void AppendStatsValues(std::string& strJson, const StatsValues& values, double fTicksPerSecond)
+{
+	char szNumber[128];
+	strJson += "\"phases\":{";
+	for (int i = 0; i < STATS_PHASE_COUNT; i++)
+	{
+		sprintf(szNumber, "%s\"%s\":{\"seconds\":%.6f,\"calls\":%llu}", i > 0 ? "," : "", STATS_PHASE_NAMES[i],
+			values.m_anPhaseTicks[i] / fTicksPerSecond, static_cast<unsigned long long>(values.m_anPhaseCalls[i]));
+		strJson += szNumber;
+	}
+	strJson += "},\"counters\":{";
+	for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+	{
+		sprintf(szNumber, "%s\"%s\":%llu", i > 0 ? "," : "", STATS_COUNTER_NAMES[i], static_cast<unsigned long long>(values.m_anCounters[i]));
+		strJson += szNumber;
+	}
+	strJson += "}";
+}
+
+std::string PrinterStats::ToJson() const
+{
+	double fTicksPerSecond = GetStatsTicksPerSecond();
+	char szNumber[128];
+	std::string strJson = "{";
+	sprintf(szNumber, "\"wall_seconds\":%.6f,", m_nTicks / fTicksPerSecond);
+	strJson += szNumber;
+	AppendStatsValues(strJson, m_total, fTicksPerSecond);
+
+	// only the threads which did something
+	strJson += ",\"threads\":[";
+	bool bFirst = true;
+	for (size_t i = 0; i < m_vThreads.size(); i++)
+	{
+		if (m_vThreads[i].IsEmpty())
+			continue;
+		sprintf(szNumber, "%s{\"thread\":%d,", bFirst ? "" : ",", static_cast<int>(i));
+		strJson += szNumber;
+		AppendStatsValues(strJson, m_vThreads[i], fTicksPerSecond);
+		strJson += "}";
+		bFirst = false;
+	}
+	strJson += "]}";
+	return strJson;
+}
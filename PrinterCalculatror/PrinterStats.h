@@ -0,0 +1,223 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CpuFeatures.h"
+#if defined(CPU_HAS_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(CPU_HAS_X86_SIMD)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Timers and counters of the hot paths, read with PrinterTask::GetStats() or
+// GetProcessStats().  Define PRINTER_NO_STATS to compile them out; the stats
+// are then all 0.
+
+// The phases the time is split in.  A phase inside another one, like Convert
+// inside Parse, is not counted in the outer phase too.
+enum class StatsPhase
+{
+	FileRead = 0,	// opening and mapping files, loading column caches
+	Parse,			// splitting the rows into fields
+	HeaderLookup,	// finding a column by name
+	Convert,		// converting the fields of typed columns
+	Calculate,		// pricing the jobs
+	Report			// formatting and writing the report
+};
+static const int STATS_PHASE_COUNT = 6;
+
+enum class StatsCounter
+{
+	Bytes = 0,		// bytes of the rows parsed
+	Rows,			// rows parsed
+	Jobs,			// jobs priced
+	RowErrors,		// rows which are not print jobs
+	HeaderLookups,	// columns found by name
+	ReportBytes		// bytes of report written
+};
+static const int STATS_COUNTER_COUNT = 6;
+
+// Threads of a worker pool count in their own slot, the slot of their index
+// in the pool.  Other threads count in slot 0, and the pools above this size
+// share the last slot.  A slot shared by threads running at the same time
+// is slower to count in, but counts right.
+static const int MAX_STATS_THREADS = 64;
+
+// The phases too short to time every call, like the conversion of one field,
+// time one call in this many and count it this many times
+static const int STATS_SAMPLE_RATE = 64;
+
+const char* GetStatsPhaseName(StatsPhase ePhase);
+const char* GetStatsCounterName(StatsCounter eCounter);
+
+// The stats of one thread, or of all of them
+struct StatsValues
+{
+	StatsValues();
+
+	bool IsEmpty() const;
+	void Add(const StatsValues& other);
+	void Subtract(const StatsValues& other);
+
+	uint64_t m_anPhaseTicks[STATS_PHASE_COUNT];
+	uint64_t m_anPhaseCalls[STATS_PHASE_COUNT];
+	uint64_t m_anCounters[STATS_COUNTER_COUNT];
+};
+
+// A snapshot of the stats
+struct PrinterStats
+{
+	PrinterStats() : m_nTicks(0) {}
+
+	// The stats counted after start was taken
+	void Subtract(const PrinterStats& start);
+
+	double GetPhaseSeconds(StatsPhase ePhase) const;
+	uint64_t GetCounter(StatsCounter eCounter) const { return m_total.m_anCounters[static_cast<int>(eCounter)]; }
+
+	// One JSON object, on one line
+	std::string ToJson() const;
+
+	uint64_t m_nTicks;						// ticks from the start of the process
+	StatsValues m_total;					// the sum of the threads
+	std::vector<StatsValues> m_vThreads;	// by slot
+};
+
+// Takes a snapshot of the stats of every thread
+void GetProcessStats(PrinterStats& stats);
+
+// Makes the calling thread count in slot iThread, called by the worker pools
+void SetStatsThread(int iThread);
+
+// The ticks of the timers: the time stamp counter on x86, nanoseconds elsewhere
+inline uint64_t ReadStatsTicks()
+{
+#if defined(CPU_HAS_X86_SIMD)
+	return __rdtsc();
+#else
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Ticks per second, measured against the steady clock
+double GetStatsTicksPerSecond();
+
+//////////////////////////////////////////////////////////////////////////////
+// Used by the macros below
+//////////////////////////////////////////////////////////////////////////////
+
+// The stats of a thread, or of the threads sharing the slot.  The values
+// are added to without locks, by relaxed atomic adds, and a snapshot taken
+// while other threads work may be a little behind.
+struct CStatsSlot
+{
+	void AddPhase(int iPhase, uint64_t nTicks, uint64_t nCalls)
+	{
+		m_anPhaseTicks[iPhase].fetch_add(nTicks, std::memory_order_relaxed);
+		m_anPhaseCalls[iPhase].fetch_add(nCalls, std::memory_order_relaxed);
+	}
+
+	void AddCounter(int iCounter, uint64_t nValue)
+	{
+		m_anCounters[iCounter].fetch_add(nValue, std::memory_order_relaxed);
+	}
+
+	// Copies the values into a snapshot
+	void Read(StatsValues& values) const;
+
+	std::atomic<uint64_t> m_anPhaseTicks[STATS_PHASE_COUNT];
+	std::atomic<uint64_t> m_anPhaseCalls[STATS_PHASE_COUNT];
+	std::atomic<uint64_t> m_anCounters[STATS_COUNTER_COUNT];
+	char m_aPadding[48];	// a slot per cache line or more
+};
+
+class CStatsScope;
+
+// Only the thread itself uses its state, so none of it is atomic
+struct StatsThreadState
+{
+	CStatsSlot* m_pSlot;		// NULL for slot 0
+	CStatsScope* m_pScope;		// the innermost timer running
+	uint32_t m_anUntimedCalls[STATS_PHASE_COUNT];	// calls since the last sampled one
+};
+
+#if defined(_MSC_VER)
+#define STATS_THREAD_LOCAL __declspec(thread)
+#else
+#define STATS_THREAD_LOCAL __thread
+#endif
+
+extern STATS_THREAD_LOCAL StatsThreadState g_statsThread;
+extern CStatsSlot g_aStatsSlots[MAX_STATS_THREADS];
+
+inline CStatsSlot& GetStatsSlot()
+{
+	return g_statsThread.m_pSlot != NULL ? *g_statsThread.m_pSlot : g_aStatsSlots[0];
+}
+
+// Adds the ticks from its construction to its destruction to a phase, less
+// the ticks of the timers running inside it.  With nSampleRate above 1 only
+// one scope in nSampleRate is timed, and counted nSampleRate times.
+class CStatsScope
+{
+public:
+	CStatsScope(StatsPhase ePhase, int nSampleRate = 1)
+		: m_iPhase(static_cast<int>(ePhase))
+		, m_nWeight(nSampleRate)
+	{
+		if (nSampleRate > 1)
+		{
+			uint32_t& nUntimed = g_statsThread.m_anUntimedCalls[m_iPhase];
+			if (++nUntimed < static_cast<uint32_t>(nSampleRate))
+			{
+				m_nWeight = 0;
+				return;
+			}
+			nUntimed = 0;
+		}
+		m_nChildTicks = 0;
+		m_pParent = g_statsThread.m_pScope;
+		g_statsThread.m_pScope = this;
+		m_nStart = ReadStatsTicks();
+	}
+
+	~CStatsScope()
+	{
+		if (m_nWeight == 0)
+			return;
+		uint64_t nTicks = (ReadStatsTicks() - m_nStart) * m_nWeight;
+		g_statsThread.m_pScope = m_pParent;
+		if (m_pParent != NULL)
+			m_pParent->m_nChildTicks += nTicks;
+		GetStatsSlot().AddPhase(m_iPhase, nTicks - m_nChildTicks, m_nWeight);
+	}
+
+private:
+	CStatsScope(const CStatsScope&);
+	CStatsScope& operator=(const CStatsScope&);
+
+	int m_iPhase;
+	int m_nWeight;
+	uint64_t m_nStart;
+	uint64_t m_nChildTicks;
+	CStatsScope* m_pParent;
+};
+
+#define PRINTER_STATS_JOIN2(a, b) a##b
+#define PRINTER_STATS_JOIN(a, b) PRINTER_STATS_JOIN2(a, b)
+
+#ifndef PRINTER_NO_STATS
+// Times the rest of the block as ePhase
+#define PRINTER_STATS_SCOPE(ePhase) CStatsScope PRINTER_STATS_JOIN(statsScope, __LINE__)(StatsPhase::ePhase)
+// Times one in STATS_SAMPLE_RATE runs of the rest of the block as ePhase
+#define PRINTER_STATS_SAMPLED_SCOPE(ePhase) CStatsScope PRINTER_STATS_JOIN(statsScope, __LINE__)(StatsPhase::ePhase, STATS_SAMPLE_RATE)
+// Adds nValue to the counter eCounter
+#define PRINTER_STATS_ADD(eCounter, nValue) GetStatsSlot().AddCounter(static_cast<int>(StatsCounter::eCounter), static_cast<uint64_t>(nValue))
+#else
+#define PRINTER_STATS_SCOPE(ePhase) ((void)0)
+#define PRINTER_STATS_SAMPLED_SCOPE(ePhase) ((void)0)
+#define PRINTER_STATS_ADD(eCounter, nValue) ((void)0)
+#endif
@@ -0,0 +1,80 @@
+#include "ReadAheadInput.h"
+#include "PrinterStats.h"
+
+CReadAheadStreamBuf::CReadAheadStreamBuf()
+	: m_pFile(NULL)
+	, m_queueFree(READ_AHEAD_BLOCKS)
+	, m_queueFull(READ_AHEAD_BLOCKS)
+	, m_iReading(-1)
+{
+}
+
+CReadAheadStreamBuf::~CReadAheadStreamBuf()
+{
+	m_queueFree.Close();
+	m_queueFull.Close();
+	if (m_thread.joinable())
+		m_thread.join();
+	if (m_pFile != NULL)
+		fclose(m_pFile);
+}
+
+bool CReadAheadStreamBuf::Open(const char* szFilename)
+{
+	if (m_pFile != NULL)
+		return false;
+
+	m_pFile = fopen(szFilename, "rb");
+	if (m_pFile == NULL)
+		return false;
+
+	// every block is read straight from the file with one call
+	setvbuf(m_pFile, NULL, _IONBF, 0);
+	m_v2dBlocks.assign(READ_AHEAD_BLOCKS, std::vector<char>(READ_AHEAD_BLOCK_SIZE));
+	m_vnSizes.assign(READ_AHEAD_BLOCKS, 0);
+	for (int i = 0; i < READ_AHEAD_BLOCKS; i++)
+		m_queueFree.Push(i);
+	m_thread = std::thread(&CReadAheadStreamBuf::ReadBlocks, this);
+	return true;
+}
+
+CReadAheadStreamBuf::int_type CReadAheadStreamBuf::underflow()
+{
+	if (m_iReading >= 0)
+	{
+		m_queueFree.Push(m_iReading);
+		m_iReading = -1;
+	}
+
+	int iBlock;
+	if (!m_queueFull.Pop(iBlock))
+		return traits_type::eof();
+
+	m_iReading = iBlock;
+	char* pData = &m_v2dBlocks[iBlock][0];
+	setg(pData, pData, pData + m_vnSizes[iBlock]);
+	return traits_type::to_int_type(pData[0]);
+}
+
+void CReadAheadStreamBuf::ReadBlocks()
+{
+	int iBlock;
+	while (m_queueFree.Pop(iBlock))
+	{
+		size_t nRead;
+		{
+			PRINTER_STATS_SCOPE(FileRead);
+			nRead = fread(&m_v2dBlocks[iBlock][0], 1, READ_AHEAD_BLOCK_SIZE, m_pFile);
+		}
+		if (nRead == 0)
+		{
+			if (ferror(m_pFile))
+				m_strError = "Meet error when reading the file";
+			break;
+		}
+		m_vnSizes[iBlock] = nRead;
+		if (!m_queueFull.Push(iBlock))
+			break;
+	}
+	m_queueFull.Close();
+}
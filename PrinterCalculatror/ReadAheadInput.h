@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdio>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+
+// Size of each block a CReadAheadStreamBuf reads with a single call.
+const static int READ_AHEAD_BLOCK_SIZE = 1 << 20;
+
+// Number of blocks a CReadAheadStreamBuf reads ahead of the parser.
+const static int READ_AHEAD_BLOCKS = 4;
+
+// The bytes of a file read through a std::istream.  A thread reads large
+// blocks into a ring while the reader parses the blocks read before, so
+// waiting on the disk overlaps with the parsing.  The blocks go to the
+// reader and back through two CSpscQueue, and the thread stops reading
+// while every block waits to be parsed.
+class CReadAheadStreamBuf : public std::streambuf
+{
+public:
+	CReadAheadStreamBuf();
+
+	// Stops the reading thread.
+	~CReadAheadStreamBuf();
+
+	// Opens the file and starts reading it.  Returns false if the file can
+	// not be opened.
+	bool Open(const char* szFilename);
+
+	// Returns why the reading stopped before the end of the file, empty if
+	// it did not.  Read it once the stream is at its end.
+	const std::string& GetError() const { return m_strError; }
+
+protected:
+	// Hands the block just parsed back to the thread and waits for the next.
+	int_type underflow();
+
+private:
+	CReadAheadStreamBuf(const CReadAheadStreamBuf&);
+	CReadAheadStreamBuf& operator=(const CReadAheadStreamBuf&);
+
+	// The body of the thread.
+	void ReadBlocks();
+
+	FILE* m_pFile;
+	std::vector<std::vector<char> > m_v2dBlocks;
+	std::vector<size_t> m_vnSizes;	// bytes read into every block
+	CSpscQueue<int> m_queueFree;	// blocks for the thread to read into
+	CSpscQueue<int> m_queueFull;	// blocks read, in file order
+	int m_iReading;					// block held by the reader, -1 if none
+	std::string m_strError;			// written by the thread before it closes m_queueFull
+	std::thread m_thread;
+};
@@ -0,0 +1,325 @@
+#include "stdafx.h"
+#include "ReportWriter.h"
+#include "PrinterStats.h"
+#include <cmath>
+#include <cstring>
+
+// Size of the buffer, written to the file when full
+static const size_t REPORT_BUFFER_SIZE = 1 << 20;
+
+// Longest line written for a job
+static const size_t MAX_JOB_LINE = 512;
+
+static const char* JSON_JOB_TYPE_NAMES[JOB_TYPE_COUNT] = { "single", "double" };
+
+// Rounds exactly: a float is m * 2^e with a 24-bit m, so 100 times its value
+// is an integer fraction which is rounded half to even like printf does.
+int FormatPrice(float fValue, char* buff)
+{
+	int nExponent;
+	double dMantissa = std::frexp(std::fabs(static_cast<double>(fValue)), &nExponent);
+	if (fValue != fValue || nExponent > 30)
+		return sprintf(buff, "%.2f", fValue);	// NaN, inf and huge values are rare
+
+	uint64_t nMantissa = static_cast<uint64_t>(std::ldexp(dMantissa, 24));
+	uint64_t nNumerator = nMantissa * 100;
+	int nShift = 24 - nExponent;
+	uint64_t nCents = 0;
+	if (nShift <= 0)
+		nCents = nNumerator << -nShift;
+	else if (nShift < 40)
+	{
+		nCents = nNumerator >> nShift;
+		uint64_t nRemainder = nNumerator & ((static_cast<uint64_t>(1) << nShift) - 1);
+		uint64_t nHalf = static_cast<uint64_t>(1) << (nShift - 1);
+		if (nRemainder > nHalf || (nRemainder == nHalf && (nCents & 1) != 0))
+			nCents++;
+	}
+
+	char digits[24];
+	int nDigits = 0;
+	uint64_t nUnits = nCents / 100;
+	do
+	{
+		digits[nDigits++] = static_cast<char>('0' + nUnits % 10);
+		nUnits /= 10;
+	} while (nUnits != 0);
+
+	int nLength = 0;
+	if (std::signbit(fValue))
+		buff[nLength++] = '-';
+	while (nDigits > 0)
+		buff[nLength++] = digits[--nDigits];
+	buff[nLength++] = '.';
+	buff[nLength++] = static_cast<char>('0' + nCents % 100 / 10);
+	buff[nLength++] = static_cast<char>('0' + nCents % 10);
+	buff[nLength] = '\0';
+	return nLength;
+}
+
+CReportWriter::CReportWriter(ReportMode eMode, FILE* pFile)
+	: m_eMode(eMode)
+	, m_pFile(pFile)
+	, m_nUsed(0)
+{
+}
+
+CReportWriter::~CReportWriter()
+{
+	Flush();
+}
+
+void CReportWriter::Flush()
+{
+	if (m_eMode == ReportMode::None)
+		return;
+	PRINTER_STATS_SCOPE(Report);
+	if (m_nUsed > 0)
+	{
+		PRINTER_STATS_ADD(ReportBytes, m_nUsed);
+		fwrite(&m_vBuffer[0], 1, m_nUsed, m_pFile);
+		m_nUsed = 0;
+	}
+	fflush(m_pFile);
+}
+
+void CReportWriter::Reserve(size_t nLength)
+{
+	if (m_vBuffer.empty())
+		m_vBuffer.resize(REPORT_BUFFER_SIZE);
+	if (m_nUsed + nLength > m_vBuffer.size())
+		Flush();
+	if (nLength > m_vBuffer.size())
+		m_vBuffer.resize(nLength);
+}
+
+void CReportWriter::Append(const char* szText)
+{
+	size_t nLength = strlen(szText);
+	Reserve(nLength);
+	memcpy(&m_vBuffer[m_nUsed], szText, nLength);
+	m_nUsed += nLength;
+}
+
+void CReportWriter::AppendInt(int nValue)
+{
+	char digits[16];
+	int nDigits = 0;
+	unsigned int nAbs = nValue < 0 ? 0u - static_cast<unsigned int>(nValue) : static_cast<unsigned int>(nValue);
+	do
+	{
+		digits[nDigits++] = static_cast<char>('0' + nAbs % 10);
+		nAbs /= 10;
+	} while (nAbs != 0);
+
+	Reserve(nDigits + 1);
+	if (nValue < 0)
+		m_vBuffer[m_nUsed++] = '-';
+	while (nDigits > 0)
+		m_vBuffer[m_nUsed++] = digits[--nDigits];
+}
+
+void CReportWriter::AppendPrice(float fValue)
+{
+	Reserve(REPORT_NUMBER_SIZE);
+	m_nUsed += FormatPrice(fValue, &m_vBuffer[m_nUsed]);
+}
+
+void CReportWriter::AppendJsonString(const char* szText)
+{
+	Append("\"");
+	for (const char* p = szText; *p != '\0'; p++)
+	{
+		Reserve(8);
+		unsigned char c = static_cast<unsigned char>(*p);
+		if (c == '"' || c == '\\')
+		{
+			m_vBuffer[m_nUsed++] = '\\';
+			m_vBuffer[m_nUsed++] = *p;
+		}
+		else if (c < 0x20)
+			m_nUsed += sprintf(&m_vBuffer[m_nUsed], "\\u%04x", c);
+		else
+			m_vBuffer[m_nUsed++] = *p;
+	}
+	Append("\"");
+}
+
+void CReportWriter::WriteJob(int iRow, JobType eJobType, int nBlackWhitePages, float fBlackAndWhitePrice, int nColorPages, float fColorPrice)
+{
+	if (!WritesJobs())
+		return;
+	PRINTER_STATS_SCOPE(Report);
+
+	// one reserve for the whole line, so the appends never flush half of it
+	Reserve(MAX_JOB_LINE);
+	if (m_eMode == ReportMode::Text)
+	{
+		Append("Add Print Job No. ");
+		AppendInt(iRow);
+		Append(eJobType == JobType::SinglePage ? " - Type: single Side\n Black and White Printing Pages: " : " - Type: Double Side\n Black and White Printing Pages: ");
+		AppendInt(nBlackWhitePages);
+		Append(", cost: ");
+		AppendPrice(fBlackAndWhitePrice);
+		Append("\n Color Printing Pages: ");
+		AppendInt(nColorPages);
+		Append(", cost: ");
+		AppendPrice(fColorPrice);
+		Append("\n\n ");
+	}
+	else
+	{
+		Append("{\"row\":");
+		AppendInt(iRow);
+		Append(",\"jobType\":\"");
+		Append(JSON_JOB_TYPE_NAMES[static_cast<int>(eJobType)]);
+		Append("\",\"blackAndWhitePages\":");
+		AppendInt(nBlackWhitePages);
+		Append(",\"blackAndWhiteCost\":");
+		AppendPrice(fBlackAndWhitePrice);
+		Append(",\"colorPages\":");
+		AppendInt(nColorPages);
+		Append(",\"colorCost\":");
+		AppendPrice(fColorPrice);
+		Append("}\n");
+	}
+}
+
+void CReportWriter::WriteRowError(int iRow, const char* szReason)
+{
+	if (!WritesJobs())
+		return;
+	PRINTER_STATS_SCOPE(Report);
+
+	Reserve(MAX_JOB_LINE);
+	if (m_eMode == ReportMode::Text)
+	{
+		Append("Row ");
+		AppendInt(iRow);
+		Append(" is not a print job: ");
+		Append(szReason);
+		Append("\n\n ");
+	}
+	else
+	{
+		Append("{\"row\":");
+		AppendInt(iRow);
+		Append(",\"error\":\"");
+		Append(szReason);
+		Append("\"}\n");
+	}
+}
+
+void CReportWriter::WriteFileSummary(const std::string& strFileName, const char* szError, const std::string& strBlackAndWhite, const std::string& strColor)
+{
+	if (!WritesJobs())
+		return;
+
+	if (m_eMode == ReportMode::Text)
+	{
+		Append(strFileName);
+		if (szError != NULL)
+		{
+			Append(": ");
+			Append(szError);
+		}
+		else
+		{
+			Append(": black and white ");
+			Append(strBlackAndWhite);
+			Append(", color ");
+			Append(strColor);
+		}
+		Append("\n");
+	}
+	else
+	{
+		Append("{\"file\":");
+		AppendJsonString(strFileName.c_str());
+		if (szError != NULL)
+		{
+			Append(",\"error\":");
+			AppendJsonString(szError);
+		}
+		else
+		{
+			Append(",\"blackAndWhiteCost\":");
+			Append(strBlackAndWhite);
+			Append(",\"colorCost\":");
+			Append(strColor);
+		}
+		Append("}\n");
+	}
+}
+
+void CReportWriter::WriteGroup(const std::vector<std::string>& vstrColumns, const std::vector<std::string>& vstrValues, int64_t nJobs,
+	const std::string& strBlackAndWhite, const std::string& strColor)
+{
+	if (m_eMode == ReportMode::None)
+		return;
+	PRINTER_STATS_SCOPE(Report);
+
+	if (m_eMode == ReportMode::Json)
+	{
+		Append("{\"group\":{");
+		for (size_t i = 0; i < vstrColumns.size() && i < vstrValues.size(); i++)
+		{
+			if (i > 0)
+				Append(",");
+			AppendJsonString(vstrColumns[i].c_str());
+			Append(":");
+			AppendJsonString(vstrValues[i].c_str());
+		}
+		Append("},\"jobs\":");
+		Append(std::to_string(nJobs));
+		Append(",\"blackAndWhiteCost\":");
+		Append(strBlackAndWhite);
+		Append(",\"colorCost\":");
+		Append(strColor);
+		Append("}\n");
+	}
+	else
+	{
+		Append("Group ");
+		for (size_t i = 0; i < vstrColumns.size() && i < vstrValues.size(); i++)
+		{
+			if (i > 0)
+				Append(", ");
+			Append(vstrColumns[i]);
+			Append("=");
+			Append(vstrValues[i]);
+		}
+		Append(": ");
+		Append(std::to_string(nJobs));
+		Append(" jobs, black and white ");
+		Append(strBlackAndWhite);
+		Append(", color ");
+		Append(strColor);
+		Append("\n");
+	}
+}
+
+void CReportWriter::WriteSummary(const std::string& strBlackAndWhite, const std::string& strColor)
+{
+	if (m_eMode == ReportMode::None)
+		return;
+
+	if (m_eMode == ReportMode::Json)
+	{
+		Append("{\"summary\":true,\"blackAndWhiteCost\":");
+		Append(strBlackAndWhite);
+		Append(",\"colorCost\":");
+		Append(strColor);
+		Append("}\n");
+	}
+	else
+	{
+		Append("Summary:\n");
+		Append("Total cost for black and white printing is ");
+		Append(strBlackAndWhite);
+		Append("\nTotal cost for color printing is ");
+		Append(strColor);
+		Append("\n");
+	}
+	Flush();
+}
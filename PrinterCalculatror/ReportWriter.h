@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "PrintJob.h"
+
+// What a CReportWriter writes.
+enum class ReportMode
+{
+	None = 0,   // nothing
+	Summary,    // the totals only
+	Text,       // every job and the totals, as readable text
+	Json        // every job and the totals, one JSON object per line
+};
+
+// Size of a buffer large enough for any number written by FormatPrice().
+const static int REPORT_NUMBER_SIZE = 64;
+
+// Writes fValue like printf("%.2f") without parsing a format, and returns
+// the number of characters written.  buff needs REPORT_NUMBER_SIZE chars.
+int FormatPrice(float fValue, char* buff);
+
+// Writes the report of a PrinterTask.  The lines are formatted into a large
+// buffer which is written to the file in big blocks, so reporting millions
+// of jobs costs little more than pricing them.
+class CReportWriter
+{
+public:
+	CReportWriter(ReportMode eMode = ReportMode::Text, FILE* pFile = stdout);
+
+	// Writes what is left in the buffer.
+	~CReportWriter();
+
+	ReportMode GetMode() const { return m_eMode; }
+
+	// Returns whether WriteJob() writes anything, so callers can skip
+	// computing what it would write.
+	bool WritesJobs() const { return m_eMode == ReportMode::Text || m_eMode == ReportMode::Json; }
+
+	// Writes the cost of the print job in row iRow.
+	void WriteJob(int iRow, JobType eJobType, int nBlackWhitePages, float fBlackAndWhitePrice, int nColorPages, float fColorPrice);
+
+	// Writes why the row iRow is not a print job.
+	void WriteRowError(int iRow, const char* szReason);
+
+	// Writes the totals of one file of a batch, or why it has none when
+	// szError is not NULL.
+	void WriteFileSummary(const std::string& strFileName, const char* szError, const std::string& strBlackAndWhite, const std::string& strColor);
+
+	// Writes the totals of one group of jobs, the group named by the value of
+	// every group column.  Written in every mode but None.
+	void WriteGroup(const std::vector<std::string>& vstrColumns, const std::vector<std::string>& vstrValues, int64_t nJobs,
+		const std::string& strBlackAndWhite, const std::string& strColor);
+
+	// Writes the totals, already formatted as decimals.
+	void WriteSummary(const std::string& strBlackAndWhite, const std::string& strColor);
+
+	// Writes the buffer to the file.  The buffer is allocated by the first
+	// write, so a writer which writes nothing costs nothing.
+	void Flush();
+
+private:
+	// The writer owns its buffer and can not be copied.
+	CReportWriter(const CReportWriter&);
+	CReportWriter& operator=(const CReportWriter&);
+
+	// Makes room for nLength more characters, writing the buffer if needed.
+	void Reserve(size_t nLength);
+
+	void Append(const char* szText);
+	void Append(const std::string& strText) { Append(strText.c_str()); }
+	void AppendInt(int nValue);
+	void AppendPrice(float fValue);
+	// Appends a JSON string with its quotes.
+	void AppendJsonString(const char* szText);
+
+	ReportMode m_eMode;
+	FILE* m_pFile;
+	std::vector<char> m_vBuffer;
+	size_t m_nUsed;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A bounded queue between one producer thread and one consumer thread.
+// Items are passed through a ring without locks; a thread only takes the
+// lock to sleep when the queue is full (producer) or empty (consumer), and
+// the other thread only takes it to wake a sleeping one.  A full queue
+// makes the producer wait, so a fast stage can not run ahead of a slow one
+// by more than the capacity.
+//
+// Either side may Close() the queue: the producer when it has no more
+// items, the consumer when it stops taking them.
+template <class T>
+class CSpscQueue
+{
+public:
+	explicit CSpscQueue(size_t nCapacity)
+		: m_vItems(nCapacity + 1), m_nHead(0), m_nTail(0), m_bClosed(false), m_bProducerWaiting(false), m_bConsumerWaiting(false)
+	{
+	}
+
+	// Producer: adds an item if there is room, without waiting.
+	bool TryPush(const T& item)
+	{
+		size_t nTail = m_nTail.load(std::memory_order_relaxed);
+		size_t nNext = Next(nTail);
+		if (nNext == m_nHead.load(std::memory_order_acquire))
+			return false;
+		m_vItems[nTail] = item;
+		m_nTail.store(nNext);
+		WakeWaiter(m_bConsumerWaiting);
+		return true;
+	}
+
+	// Consumer: takes the oldest item if there is one, without waiting.
+	bool TryPop(T& item)
+	{
+		size_t nHead = m_nHead.load(std::memory_order_relaxed);
+		if (nHead == m_nTail.load(std::memory_order_acquire))
+			return false;
+		item = m_vItems[nHead];
+		m_nHead.store(Next(nHead));
+		WakeWaiter(m_bProducerWaiting);
+		return true;
+	}
+
+	// Producer: adds an item, waiting for room.  Returns false if the queue
+	// is closed, the item is then dropped.
+	bool Push(const T& item)
+	{
+		for (;;)
+		{
+			if (m_bClosed.load())
+				return false;
+			if (TryPush(item))
+				return true;
+			Wait(true);
+		}
+	}
+
+	// Consumer: takes the oldest item, waiting for one.  Returns false once
+	// the queue is closed and every item pushed before was taken.
+	bool Pop(T& item)
+	{
+		for (;;)
+		{
+			if (TryPop(item))
+				return true;
+			if (m_bClosed.load())
+				return TryPop(item);
+			Wait(false);
+		}
+	}
+
+	// Ends the queue and wakes the other thread.
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bClosed.store(true);
+		m_cvChanged.notify_all();
+	}
+
+private:
+	CSpscQueue(const CSpscQueue&);
+	CSpscQueue& operator=(const CSpscQueue&);
+
+	size_t Next(size_t i) const { return i + 1 == m_vItems.size() ? 0 : i + 1; }
+
+	bool IsFull() const { return Next(m_nTail.load()) == m_nHead.load(); }
+	bool IsEmpty() const { return m_nHead.load() == m_nTail.load(); }
+
+	// Sleeps until the queue is not full for the producer, not empty for the
+	// consumer, or closed.  The flag of the waiting side is set before the
+	// queue is checked again and the other side reads it after moving its
+	// index, so one of them always sees the other.
+	void Wait(bool bProducer)
+	{
+		std::atomic<bool>& bWaiting = bProducer ? m_bProducerWaiting : m_bConsumerWaiting;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		bWaiting.store(true);
+		while (!m_bClosed.load() && (bProducer ? IsFull() : IsEmpty()))
+			m_cvChanged.wait(lock);
+		bWaiting.store(false);
+	}
+
+	void WakeWaiter(const std::atomic<bool>& bWaiting)
+	{
+		if (bWaiting.load())
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cvChanged.notify_all();
+		}
+	}
+
+	std::vector<T> m_vItems;	// one slot stays free to tell full from empty
+	std::atomic<size_t> m_nHead;	// next item to pop, moved by the consumer
+	std::atomic<size_t> m_nTail;	// next slot to push, moved by the producer
+	std::atomic<bool> m_bClosed;
+	std::atomic<bool> m_bProducerWaiting;
+	std::atomic<bool> m_bConsumerWaiting;
+	std::mutex m_mutex;
+	std::condition_variable m_cvChanged;
+};
@@ -0,0 +1,177 @@
+#include "WorkerThreads.h"
+#include "PrinterStats.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The tasks from m_iBegin to m_iEnd - 1 left to a thread of RunWorkStealing
+struct CTaskRange
+{
+	CTaskRange() : m_iBegin(0), m_iEnd(0) {}
+
+	std::mutex m_mutex;
+	int m_iBegin;
+	int m_iEnd;
+};
+
+// Moves the back half of the largest range but aRanges[iThread] to it, and
+// returns false when every range is empty.
+static bool StealTasks(CTaskRange* aRanges, int nThreads, int iThread)
+{
+	for (;;)
+	{
+		int iVictim = -1;
+		int nMost = 0;
+		for (int i = 0; i < nThreads; i++)
+		{
+			if (i == iThread)
+				continue;
+			std::lock_guard<std::mutex> lock(aRanges[i].m_mutex);
+			if (aRanges[i].m_iEnd - aRanges[i].m_iBegin > nMost)
+			{
+				nMost = aRanges[i].m_iEnd - aRanges[i].m_iBegin;
+				iVictim = i;
+			}
+		}
+		if (iVictim == -1)
+			return false;
+
+		int iBegin, iEnd;
+		{
+			std::lock_guard<std::mutex> lock(aRanges[iVictim].m_mutex);
+			CTaskRange& victim = aRanges[iVictim];
+			if (victim.m_iEnd <= victim.m_iBegin)
+				continue;	// emptied meanwhile, look again
+			iEnd = victim.m_iEnd;
+			iBegin = iEnd - (iEnd - victim.m_iBegin + 1) / 2;
+			victim.m_iEnd = iBegin;
+		}
+		std::lock_guard<std::mutex> lock(aRanges[iThread].m_mutex);
+		aRanges[iThread].m_iBegin = iBegin;
+		aRanges[iThread].m_iEnd = iEnd;
+		return true;
+	}
+}
+
+int GetHardwareThreadCount()
+{
+	unsigned int nThreads = std::thread::hardware_concurrency();
+	return nThreads > 0 ? static_cast<int>(nThreads) : 1;
+}
+
+void RunParallel(int nTasks, int nThreads, const std::function<void(int)>& fnTask)
+{
+	RunParallelOnThreads(nTasks, nThreads, [&fnTask](int i, int) { fnTask(i); });
+}
+
+void RunParallelOnThreads(int nTasks, int nThreads, const std::function<void(int, int)>& fnTask)
+{
+	if (nThreads > nTasks)
+		nThreads = nTasks;
+
+	if (nThreads <= 1)
+	{
+		for (int i = 0; i < nTasks; i++)
+			fnTask(i, 0);
+		return;
+	}
+
+	std::atomic<int> nNextTask(0);
+	std::exception_ptr ptrError;
+	std::mutex mutexError;
+
+	auto fnWorker = [&](int iThread)
+	{
+		for (int i = nNextTask++; i < nTasks; i = nNextTask++)
+		{
+			try
+			{
+				fnTask(i, iThread);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutexError);
+				if (!ptrError)
+					ptrError = std::current_exception();
+			}
+		}
+	};
+
+	// every thread counts its stats in the slot of its index
+	std::vector<std::thread> vThreads;
+	for (int i = 1; i < nThreads; i++)
+		vThreads.push_back(std::thread([&fnWorker, i]() { SetStatsThread(i); fnWorker(i); }));
+	fnWorker(0);
+	for (size_t i = 0; i < vThreads.size(); i++)
+		vThreads[i].join();
+
+	if (ptrError)
+		std::rethrow_exception(ptrError);
+}
+
+void RunWorkStealing(int nTasks, int nThreads, const std::function<void(int)>& fnTask)
+{
+	if (nThreads > nTasks)
+		nThreads = nTasks;
+
+	if (nThreads <= 1)
+	{
+		for (int i = 0; i < nTasks; i++)
+			fnTask(i);
+		return;
+	}
+
+	std::unique_ptr<CTaskRange[]> aRanges(new CTaskRange[nThreads]);
+	for (int i = 0; i < nThreads; i++)
+	{
+		aRanges[i].m_iBegin = static_cast<int>(static_cast<long long>(nTasks) * i / nThreads);
+		aRanges[i].m_iEnd = static_cast<int>(static_cast<long long>(nTasks) * (i + 1) / nThreads);
+	}
+
+	std::exception_ptr ptrError;
+	std::mutex mutexError;
+
+	auto fnWorker = [&](int iThread)
+	{
+		CTaskRange& own = aRanges[iThread];
+		for (;;)
+		{
+			int iTask = -1;
+			{
+				std::lock_guard<std::mutex> lock(own.m_mutex);
+				if (own.m_iBegin < own.m_iEnd)
+					iTask = own.m_iBegin++;
+			}
+			if (iTask == -1)
+			{
+				if (!StealTasks(aRanges.get(), nThreads, iThread))
+					return;
+				continue;
+			}
+
+			try
+			{
+				fnTask(iTask);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutexError);
+				if (!ptrError)
+					ptrError = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> vThreads;
+	for (int i = 1; i < nThreads; i++)
+		vThreads.push_back(std::thread([&fnWorker, i]() { SetStatsThread(i); fnWorker(i); }));
+	fnWorker(0);
+	for (size_t i = 0; i < vThreads.size(); i++)
+		vThreads[i].join();
+
+	if (ptrError)
+		std::rethrow_exception(ptrError);
+}
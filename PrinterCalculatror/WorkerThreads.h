@@ -0,0 +1,23 @@
+#pragma once
+#include <functional>
+
+// Returns the number of threads the machine runs concurrently, at least 1.
+int GetHardwareThreadCount();
+
+// Calls fnTask(i) for every i from 0 to nTasks - 1 on up to nThreads threads,
+// the calling thread being one of them.  Tasks are handed out in order to
+// whichever thread is free.  Returns when all tasks are done; the first
+// exception thrown by a task is rethrown here.
+void RunParallel(int nTasks, int nThreads, const std::function<void(int)>& fnTask);
+
+// Same as RunParallel, calling fnTask(i, iThread) with the index of the
+// thread running the task, 0 for the calling thread and below nThreads,
+// so a task can add to data of its own thread without locks.
+void RunParallelOnThreads(int nTasks, int nThreads, const std::function<void(int, int)>& fnTask);
+
+// Calls fnTask(i) like RunParallel, for tasks of very different lengths.  The
+// tasks are split into one range per thread; a thread runs its own range from
+// the front and, once it is empty, steals the back half of the largest range
+// left.  A few long tasks then hold up only the tasks of their own range, and
+// the threads share no counter while they have work of their own.
+void RunWorkStealing(int nTasks, int nThreads, const std::function<void(int)>& fnTask);
@@ -0,0 +1,572 @@
+// benchmark_printerCalculator.cpp : times the stages of pricing a job file
+// generated from a seed, and compares the results with a stored baseline.
+//
+#include "stdafx.h"
+#include "CSVDataFile.h"
+#include "PrintJob.h"
+#include "ReportWriter.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Lookups timed by the header lookup stage
+static const int HEADER_LOOKUPS = 1000000;
+// Bytes written to the job file at once by the generator
+static const size_t GENERATOR_BUFFER_SIZE = 1 << 20;
+// A stage slower than the baseline by more than this percentage is a regression
+static const double DEFAULT_TOLERANCE_PERCENT = 10.0;
+// Exit code when a regression was found
+static const int EXIT_REGRESSION = 2;
+
+//////////////////////////////////////////////////////////////////////////////
+// Allocations made by the process, counted by the global operator new
+//////////////////////////////////////////////////////////////////////////////
+
+static atomic<long long> g_nAllocations(0);
+
+void* operator new(size_t nSize)
+{
+	g_nAllocations++;
+	void* p = malloc(nSize == 0 ? 1 : nSize);
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t nSize)
+{
+	return operator new(nSize);
+}
+
+void operator delete(void* p)
+{
+	free(p);
+}
+
+void operator delete[](void* p)
+{
+	free(p);
+}
+
+// The sized forms called by C++14 compilers
+void operator delete(void* p, size_t)
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t)
+{
+	free(p);
+}
+
+// Returns the peak resident memory of the process in KB
+static long long GetPeakResidentKB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Starts the peak resident memory again from the current one where the
+// system allows it, so the peak of every stage is its own.  Elsewhere the
+// peak of a stage is the peak of the process until the end of the stage.
+static void ResetPeakResident()
+{
+#ifdef __linux__
+	FILE* pFile = fopen("/proc/self/clear_refs", "w");
+	if (pFile != NULL)
+	{
+		fputs("5", pFile);
+		fclose(pFile);
+	}
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// The synthetic job file
+//////////////////////////////////////////////////////////////////////////////
+
+struct BenchmarkConfig
+{
+	BenchmarkConfig() : m_nRows(1000000), m_nColumns(3), m_fQuoteDensity(0.1), m_fBadRowRatio(0.001),
+		m_bCRLF(false), m_nSeed(1), m_nRepeat(3), m_nThreads(0), m_fTolerance(DEFAULT_TOLERANCE_PERCENT), m_bKeepFile(false),
+		m_strJobFile("benchmark_jobs.csv"), m_strOutput("benchmark_results.json") {}
+
+	int m_nRows;				// rows of the job file, not counting the header
+	int m_nColumns;				// columns, the three of a print job and notes after them
+	double m_fQuoteDensity;		// part of the fields written in quotes
+	double m_fBadRowRatio;		// part of the rows which are not print jobs
+	bool m_bCRLF;				// end the lines with CR LF instead of LF
+	uint32_t m_nSeed;			// the same seed writes the same file
+	int m_nRepeat;				// runs of every stage, the fastest one is kept
+	int m_nThreads;				// threads of the parallel stages, 0 for every CPU
+	double m_fTolerance;		// percentage a metric may be worse than its baseline
+	bool m_bKeepFile;			// leave the job file on disk
+	string m_strJobFile;
+	string m_strOutput;
+	string m_strBaseline;
+};
+
+// Writes a job file which only depends on the config, so the runs of
+// different builds and machines read the same bytes
+class CJobFileGenerator
+{
+public:
+	CJobFileGenerator(const BenchmarkConfig& config) : m_config(config), m_nState(config.m_nSeed ? config.m_nSeed : 1) {}
+
+	// Writes the file and returns its size in nBytes.  Returns false if the
+	// file can not be written.
+	bool Write(const char* szFileName, long long& nBytes);
+
+private:
+	// xorshift32, the same numbers on every compiler
+	uint32_t NextRandom()
+	{
+		m_nState ^= m_nState << 13;
+		m_nState ^= m_nState >> 17;
+		m_nState ^= m_nState << 5;
+		return m_nState;
+	}
+	bool NextChance(double fRatio) { return NextRandom() < fRatio * 4294967296.0; }
+	void AppendField(string& strLine, const string& strValue, bool bFirst, bool bQuoted);
+	void AppendRow(string& strLine);
+
+	const BenchmarkConfig& m_config;
+	uint32_t m_nState;
+};
+
+void CJobFileGenerator::AppendField(string& strLine, const string& strValue, bool bFirst, bool bQuoted)
+{
+	// The space after the separator is trimmed from plain fields, but would
+	// be part of a quoted one
+	if (!bFirst)
+		strLine += bQuoted ? "," : ", ";
+	if (!bQuoted)
+	{
+		strLine += strValue;
+		return;
+	}
+	strLine += '"';
+	for (size_t i = 0; i < strValue.size(); i++)
+	{
+		if (strValue[i] == '"')
+			strLine += '"';
+		strLine += strValue[i];
+	}
+	strLine += '"';
+}
+
+void CJobFileGenerator::AppendRow(string& strLine)
+{
+	char szNumber[32];
+	int nTotalPages = 1 + static_cast<int>(NextRandom() % 1000);
+	int nColorPages = static_cast<int>(NextRandom() % (nTotalPages + 1));
+	bool bDoubleSided = (NextRandom() & 1) != 0;
+
+	// A bad row has one field which is not of the type of its column
+	int iBadColumn = NextChance(m_config.m_fBadRowRatio) ? static_cast<int>(NextRandom() % 3) : -1;
+
+	sprintf(szNumber, "%d", nTotalPages);
+	AppendField(strLine, iBadColumn == 0 ? "many" : szNumber, true, NextChance(m_config.m_fQuoteDensity));
+	sprintf(szNumber, "%d", nColorPages);
+	AppendField(strLine, iBadColumn == 1 ? "1.5" : szNumber, false, NextChance(m_config.m_fQuoteDensity));
+	AppendField(strLine, iBadColumn == 2 ? "maybe" : (bDoubleSided ? "true" : "false"), false, NextChance(m_config.m_fQuoteDensity));
+	for (int k = 3; k < m_config.m_nColumns; k++)
+	{
+		// A quoted note holds the separator and an escaped quote
+		if (NextChance(m_config.m_fQuoteDensity))
+		{
+			sprintf(szNumber, "note %u, \"%u\"", NextRandom() % 10000, NextRandom() % 100);
+			AppendField(strLine, szNumber, false, true);
+		}
+		else
+		{
+			sprintf(szNumber, "note %u", NextRandom() % 10000);
+			AppendField(strLine, szNumber, false, false);
+		}
+	}
+	strLine += m_config.m_bCRLF ? "\r\n" : "\n";
+}
+
+bool CJobFileGenerator::Write(const char* szFileName, long long& nBytes)
+{
+	FILE* pFile = fopen(szFileName, "wb");
+	if (pFile == NULL)
+		return false;
+
+	string strLine = "Total Pages, Color Pages, Double Sided";
+	char szName[32];
+	for (int k = 3; k < m_config.m_nColumns; k++)
+	{
+		sprintf(szName, ", Note %d", k - 2);
+		strLine += szName;
+	}
+	strLine += m_config.m_bCRLF ? "\r\n" : "\n";
+
+	nBytes = 0;
+	bool bWritten = true;
+	strLine.reserve(GENERATOR_BUFFER_SIZE + 1024);
+	for (int i = 0; i < m_config.m_nRows && bWritten; i++)
+	{
+		AppendRow(strLine);
+		if (strLine.size() >= GENERATOR_BUFFER_SIZE)
+		{
+			bWritten = fwrite(strLine.data(), 1, strLine.size(), pFile) == strLine.size();
+			nBytes += strLine.size();
+			strLine.clear();
+		}
+	}
+	if (bWritten && !strLine.empty())
+	{
+		bWritten = fwrite(strLine.data(), 1, strLine.size(), pFile) == strLine.size();
+		nBytes += strLine.size();
+	}
+	return fclose(pFile) == 0 && bWritten;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// The measured stages
+//////////////////////////////////////////////////////////////////////////////
+
+// A number reported by a stage, named "stage.metric"
+struct BenchmarkMetric
+{
+	string m_strName;
+	double m_fValue;
+	bool m_bHigherIsBetter;
+};
+
+// Measures one run of a stage: the time, the allocations and the peak memory
+class CStageTimer
+{
+public:
+	CStageTimer()
+	{
+		ResetPeakResident();
+		m_nAllocations = g_nAllocations;
+		m_start = chrono::steady_clock::now();
+	}
+
+	void Stop()
+	{
+		m_fSeconds = chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+		m_nAllocations = g_nAllocations - m_nAllocations;
+		m_nPeakResidentKB = GetPeakResidentKB();
+	}
+
+	double m_fSeconds;
+	long long m_nAllocations;
+	long long m_nPeakResidentKB;
+
+private:
+	chrono::steady_clock::time_point m_start;
+};
+
+// Keeps the fastest run of a stage
+static void KeepFastest(CStageTimer& best, const CStageTimer& run, int iRun)
+{
+	if (iRun == 0 || run.m_fSeconds < best.m_fSeconds)
+		best = run;
+}
+
+static void AddMetric(vector<BenchmarkMetric>& vMetrics, const char* szName, double fValue, bool bHigherIsBetter)
+{
+	BenchmarkMetric metric;
+	metric.m_strName = szName;
+	metric.m_fValue = fValue;
+	metric.m_bHigherIsBetter = bHigherIsBetter;
+	vMetrics.push_back(metric);
+}
+
+// Adds the metrics every stage has, as "szStage.seconds" and so on
+static void AddStageMetrics(vector<BenchmarkMetric>& vMetrics, const char* szStage, const CStageTimer& timer, int nRows)
+{
+	string strName = szStage;
+	AddMetric(vMetrics, (strName + ".seconds").c_str(), timer.m_fSeconds, false);
+	AddMetric(vMetrics, (strName + ".rows_per_s").c_str(), nRows / timer.m_fSeconds, true);
+	AddMetric(vMetrics, (strName + ".allocations_per_row").c_str(), static_cast<double>(timer.m_nAllocations) / nRows, false);
+	AddMetric(vMetrics, (strName + ".peak_rss_kb").c_str(), static_cast<double>(timer.m_nPeakResidentKB), false);
+}
+
+// Times the lookups of the columns by name, through a handle and the cost
+// of reading a cell by name instead of by handle
+static void RunHeaderLookup(CCsvDataFile& df, vector<BenchmarkMetric>& vMetrics)
+{
+	static const char* s_aszNames[] = { "Total Pages", "color pages", " Double Sided " };
+	int nFound = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < HEADER_LOOKUPS; i++)
+		nFound += df.ResolveColumn(s_aszNames[i % 3]).IsValid() ? 1 : 0;
+	double fResolve = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	int nRows = df.GetNumberOfRows();
+	int nValue = 0;
+	long long nSum = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < HEADER_LOOKUPS; i++)
+	{
+		if (df.GetData("Total Pages", i % nRows, nValue))
+			nSum += nValue;
+	}
+	double fByName = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	CsvColumnHandle hTotalPages = df.ResolveColumn("Total Pages");
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < HEADER_LOOKUPS; i++)
+	{
+		if (df.GetData(hTotalPages, i % nRows, nValue))
+			nSum -= nValue;
+	}
+	double fByHandle = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Both loops read the same cells, so the sum shows none was optimised away
+	if (nFound != HEADER_LOOKUPS || nSum != 0)
+		printf("Header lookup stage read different values by name and by handle\n");
+
+	AddMetric(vMetrics, "header_lookup.resolve_ns", fResolve * 1e9 / HEADER_LOOKUPS, false);
+	AddMetric(vMetrics, "header_lookup.get_by_name_ns", fByName * 1e9 / HEADER_LOOKUPS, false);
+	AddMetric(vMetrics, "header_lookup.get_by_handle_ns", fByHandle * 1e9 / HEADER_LOOKUPS, false);
+}
+
+// Loads and prices the job file m_nRepeat times, keeping the fastest run
+// of every stage
+static bool RunStages(const BenchmarkConfig& config, long long nFileBytes, vector<BenchmarkMetric>& vMetrics)
+{
+	CStageTimer parse, calculate, calculateParallel;
+	unique_ptr<PrinterTask> ptrTask;
+	int nRows = config.m_nRows > 0 ? config.m_nRows : 1;
+	for (int iRun = 0; iRun < config.m_nRepeat; iRun++)
+	{
+		ptrTask.reset();
+		CStageTimer parseRun;
+		ptrTask = make_unique<PrinterTask>(config.m_strJobFile);
+		parseRun.Stop();
+		if (ptrTask->GetLoadError()[0] != '\0')
+		{
+			printf("Meet error when loading the job file: %s\n", ptrTask->GetLoadError());
+			return false;
+		}
+		KeepFastest(parse, parseRun, iRun);
+
+		ptrTask->SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		ptrTask->SetContinueOnError(true);
+		ptrTask->SetRetainJobs(false);
+		CStageTimer calculateRun;
+		bool bDone = ptrTask->DoCalculate();
+		calculateRun.Stop();
+		if (!bDone)
+			return false;
+		KeepFastest(calculate, calculateRun, iRun);
+
+		// The same task again, its totals start from 0
+		CStageTimer parallelRun;
+		bDone = ptrTask->DoCalculateParallel(config.m_nThreads);
+		parallelRun.Stop();
+		if (!bDone)
+			return false;
+		KeepFastest(calculateParallel, parallelRun, iRun);
+	}
+
+	AddStageMetrics(vMetrics, "parse", parse, nRows);
+	AddMetric(vMetrics, "parse.mb_per_s", nFileBytes / (1024.0 * 1024.0) / parse.m_fSeconds, true);
+	AddStageMetrics(vMetrics, "calculate", calculate, nRows);
+	AddStageMetrics(vMetrics, "calculate_parallel", calculateParallel, nRows);
+
+	CCsvDataFile df(config.m_strJobFile.c_str());
+	RunHeaderLookup(df, vMetrics);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// The results file and the baseline
+//////////////////////////////////////////////////////////////////////////////
+
+static bool WriteResults(const BenchmarkConfig& config, long long nFileBytes, const vector<BenchmarkMetric>& vMetrics)
+{
+	FILE* pFile = fopen(config.m_strOutput.c_str(), "w");
+	if (pFile == NULL)
+		return false;
+	fprintf(pFile, "{\n  \"config\": {\"rows\": %d, \"columns\": %d, \"quote_density\": %g, \"bad_row_ratio\": %g, "
+		"\"crlf\": %s, \"seed\": %u, \"repeat\": %d, \"threads\": %d, \"file_bytes\": %lld},\n  \"metrics\": [\n",
+		config.m_nRows, config.m_nColumns, config.m_fQuoteDensity, config.m_fBadRowRatio,
+		config.m_bCRLF ? "true" : "false", config.m_nSeed, config.m_nRepeat, config.m_nThreads, nFileBytes);
+	for (size_t i = 0; i < vMetrics.size(); i++)
+	{
+		fprintf(pFile, "    {\"name\": \"%s\", \"value\": %.6g, \"higher_is_better\": %s}%s\n",
+			vMetrics[i].m_strName.c_str(), vMetrics[i].m_fValue, vMetrics[i].m_bHigherIsBetter ? "true" : "false",
+			i + 1 < vMetrics.size() ? "," : "");
+	}
+	fprintf(pFile, "  ]\n}\n");
+	return fclose(pFile) == 0;
+}
+
+// Reads the value of the metric strName from a results file written by
+// WriteResults.  Returns false if the file has no such metric.
+static bool FindBaselineValue(const string& strBaseline, const string& strName, double& fValue)
+{
+	string strKey = "\"name\": \"" + strName + "\"";
+	size_t nPos = strBaseline.find(strKey);
+	if (nPos == string::npos)
+		return false;
+	nPos = strBaseline.find("\"value\":", nPos + strKey.size());
+	if (nPos == string::npos)
+		return false;
+	fValue = strtod(strBaseline.c_str() + nPos + strlen("\"value\":"), NULL);
+	return true;
+}
+
+// Prints every metric next to its baseline.  Returns the number of metrics
+// worse than their baseline by more than the tolerance.
+static int CompareWithBaseline(const BenchmarkConfig& config, const vector<BenchmarkMetric>& vMetrics)
+{
+	string strBaseline;
+	FILE* pFile = fopen(config.m_strBaseline.c_str(), "rb");
+	if (pFile == NULL)
+	{
+		printf("Meet error when opening the baseline file %s\n", config.m_strBaseline.c_str());
+		return 0;
+	}
+	char szBuffer[4096];
+	size_t nRead;
+	while ((nRead = fread(szBuffer, 1, sizeof(szBuffer), pFile)) > 0)
+		strBaseline.append(szBuffer, nRead);
+	fclose(pFile);
+
+	int nRegressions = 0;
+	printf("\n%-42s %14s %14s %9s\n", "metric", "baseline", "current", "change");
+	for (size_t i = 0; i < vMetrics.size(); i++)
+	{
+		const BenchmarkMetric& metric = vMetrics[i];
+		double fBaseline = 0;
+		if (!FindBaselineValue(strBaseline, metric.m_strName, fBaseline) || fBaseline == 0)
+			continue;
+		double fChange = (metric.m_fValue - fBaseline) * 100.0 / fBaseline;
+		double fWorse = metric.m_bHigherIsBetter ? -fChange : fChange;
+		bool bRegression = fWorse > config.m_fTolerance;
+		if (bRegression)
+			nRegressions++;
+		printf("%-42s %14.6g %14.6g %+8.1f%%%s\n", metric.m_strName.c_str(), fBaseline, metric.m_fValue, fChange,
+			bRegression ? "  REGRESSION" : "");
+	}
+	return nRegressions;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void PrintUsage()
+{
+	printf("Usage: benchmark_printerCalculator [--rows n] [--columns n] [--quotes ratio] [--bad-rows ratio]\n"
+		"       [--crlf] [--seed n] [--repeat n] [--threads n] [--file name] [--keep]\n"
+		"       [--out results.json] [--baseline results.json] [--tolerance percent]\n");
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkConfig config;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* szArg = argv[i];
+		const char* szValue = i + 1 < argc ? argv[i + 1] : NULL;
+		bool bValueUsed = szValue != NULL;
+		if (strcmp(szArg, "--crlf") == 0)
+			config.m_bCRLF = true, bValueUsed = false;
+		else if (strcmp(szArg, "--keep") == 0)
+			config.m_bKeepFile = true, bValueUsed = false;
+		else if (szValue == NULL)
+		{
+			PrintUsage();
+			return -1;
+		}
+		else if (strcmp(szArg, "--rows") == 0)
+			config.m_nRows = atoi(szValue);
+		else if (strcmp(szArg, "--columns") == 0)
+			config.m_nColumns = atoi(szValue) < 3 ? 3 : atoi(szValue);
+		else if (strcmp(szArg, "--quotes") == 0)
+			config.m_fQuoteDensity = atof(szValue);
+		else if (strcmp(szArg, "--bad-rows") == 0)
+			config.m_fBadRowRatio = atof(szValue);
+		else if (strcmp(szArg, "--seed") == 0)
+			config.m_nSeed = static_cast<uint32_t>(strtoul(szValue, NULL, 10));
+		else if (strcmp(szArg, "--repeat") == 0)
+			config.m_nRepeat = atoi(szValue) < 1 ? 1 : atoi(szValue);
+		else if (strcmp(szArg, "--threads") == 0)
+			config.m_nThreads = atoi(szValue);
+		else if (strcmp(szArg, "--file") == 0)
+			config.m_strJobFile = szValue;
+		else if (strcmp(szArg, "--out") == 0)
+			config.m_strOutput = szValue;
+		else if (strcmp(szArg, "--baseline") == 0)
+			config.m_strBaseline = szValue;
+		else if (strcmp(szArg, "--tolerance") == 0)
+			config.m_fTolerance = atof(szValue);
+		else
+		{
+			PrintUsage();
+			return -1;
+		}
+		if (bValueUsed)
+			i++;
+	}
+
+	vector<BenchmarkMetric> vMetrics;
+	long long nFileBytes = 0;
+	CStageTimer generate;
+	if (!CJobFileGenerator(config).Write(config.m_strJobFile.c_str(), nFileBytes))
+	{
+		printf("Meet error when writing the job file %s\n", config.m_strJobFile.c_str());
+		return -1;
+	}
+	generate.Stop();
+	AddMetric(vMetrics, "generate.seconds", generate.m_fSeconds, false);
+
+	bool bDone = RunStages(config, nFileBytes, vMetrics);
+	if (!config.m_bKeepFile)
+		remove(config.m_strJobFile.c_str());
+	if (!bDone)
+		return -1;
+
+	for (size_t i = 0; i < vMetrics.size(); i++)
+		printf("%-42s %14.6g\n", vMetrics[i].m_strName.c_str(), vMetrics[i].m_fValue);
+	if (!WriteResults(config, nFileBytes, vMetrics))
+	{
+		printf("Meet error when writing the results file %s\n", config.m_strOutput.c_str());
+		return -1;
+	}
+
+	if (!config.m_strBaseline.empty())
+	{
+		int nRegressions = CompareWithBaseline(config, vMetrics);
+		if (nRegressions > 0)
+		{
+			printf("%d metrics are worse than the baseline by more than %g%%\n", nRegressions, config.m_fTolerance);
+			return EXIT_REGRESSION;
+		}
+	}
+	return 0;
+}
@@ -1,150 +1,1804 @@
-// unittest_printerCalculator.cpp :
-//
-#include "stdafx.h"
-#include "gtest/gtest.h"
-#include "CSVDataFile.h"
-#include "PrintJob.h"
-
-using namespace std;
-
-TEST(LOADCSVFILE, loadFile)
-{
-	string content = "Total Pages, Color Pages, Double Sided\n"
-		"25, 10,false\n"
-		"55, 13, true\n"
-		"502, 22, true\n"
-		"1, 0, false ";
-	CCsvDataFile dataFile;
-
-	dataFile.ReadFromStream(istringstream(content), dataFile);
-	//Read file OK
-	EXPECT_EQ(dataFile.GetNumberOfSamples(0),4);
-	
-	//Test read first line
-	int nValue;
-	EXPECT_TRUE(dataFile.GetData("Total Pages", 0, nValue));
-	EXPECT_EQ(nValue, 25);
-	EXPECT_TRUE(dataFile.GetData("Color Pages", 0, nValue));
-	EXPECT_EQ(nValue, 10);
-	//Read false OK
-	bool isDoubleSided;
-	EXPECT_TRUE(dataFile.GetData("Double Sided", 0, isDoubleSided));
-	EXPECT_FALSE(isDoubleSided);
-
-	//Read true OK with blank space in the front
-	EXPECT_TRUE(dataFile.GetData("Double Sided", 1, isDoubleSided));
-	EXPECT_TRUE(isDoubleSided);
-
-	//Test read last line
-	EXPECT_TRUE(dataFile.GetData("Total Pages", 3, nValue));
-	EXPECT_EQ(nValue, 1);
-	EXPECT_TRUE(dataFile.GetData("Color Pages", 3, nValue));
-	EXPECT_EQ(nValue, 0);
-	//Read true OK with blank space
-	EXPECT_TRUE(dataFile.GetData("Double Sided", 3, isDoubleSided));
-	EXPECT_FALSE(isDoubleSided);
-}
-
-TEST(LOADCSVFILE, ReadDefaultOrWrongValue)
-{
-	string content = "Total Pages, Color Pages, Double Sided\n"
-		"100,,FALSE\n"
-		",,TRUE\n"
-		"12ab,cd34,None\n";
-	CCsvDataFile dataFile;
-	dataFile.ReadFromStream(istringstream(content), dataFile);
-	//Read file OK
-	EXPECT_EQ(dataFile.GetNumberOfSamples(0), 3);
-
-	//Read first line
-	int nValue;
-	EXPECT_TRUE(dataFile.GetData("Total Pages", 0, nValue));
-	EXPECT_EQ(nValue, 100);
-	// Read empty value
-	EXPECT_TRUE(dataFile.GetData("Color Pages", 0, nValue));
-	EXPECT_EQ(nValue, 0);
-	//Read UPPER case
-	bool isDoubleSided;
-	EXPECT_TRUE(dataFile.GetData("Double Sided", 0, isDoubleSided));
-	EXPECT_FALSE(isDoubleSided);
-
-	// Read second line
-	// Read empty value
-	EXPECT_TRUE(dataFile.GetData("Total Pages", 1, nValue));
-	EXPECT_EQ(nValue, 0);
-	// Read empty page number
-	EXPECT_TRUE(dataFile.GetData("Color Pages", 1, nValue));
-	EXPECT_EQ(nValue, 0);
-	//Read UPPER case
-	EXPECT_TRUE(dataFile.GetData("Double Sided", 1, isDoubleSided));
-	EXPECT_TRUE(isDoubleSided);
-
-	//Read wrong bool
-	EXPECT_FALSE(dataFile.GetData("Total Pages", 2, nValue));
-	EXPECT_FALSE(dataFile.GetData("Total Pages", 2, nValue));
-	EXPECT_FALSE(dataFile.GetData("Double Sided", 2, isDoubleSided));
-}
-
-
-TEST(LOADPRINTJOB, ReadSingleSidePrintJob)
-{
-	PrintJob job(15, 10, JobType::SinglePage);
-	EXPECT_TRUE(job.IsValidJob());
-	EXPECT_EQ(job.GetBlackWhitePages(), 5);
-	EXPECT_EQ(job.GetColorPages(), 10);
-	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 5 * sMapPrintJobPrice.at(JobType::SinglePage).m_fNonColorPrice);
-	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 10 * sMapPrintJobPrice.at(JobType::SinglePage).m_fColorPrice);
-}
-
-TEST(LOADPRINTJOB, ReadDoulbeSidePrintJob)
-{
-	PrintJob job(25, 10, JobType::DoublePage);
-	EXPECT_TRUE(job.IsValidJob());
-	EXPECT_EQ(job.GetBlackWhitePages(), 15);
-	EXPECT_EQ(job.GetColorPages(), 10);
-	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 15 * sMapPrintJobPrice.at(JobType::DoublePage).m_fNonColorPrice);
-	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 10 * sMapPrintJobPrice.at(JobType::DoublePage).m_fColorPrice);
-}
-
-TEST(LOADPRINTJOB, ReadZeroPageWhiteAndBlackPrintJob)
-{
-	PrintJob job(15, 15, JobType::SinglePage);
-	EXPECT_TRUE(job.IsValidJob());
-	EXPECT_EQ(job.GetBlackWhitePages(), 0);
-	EXPECT_EQ(job.GetColorPages(), 15);
-	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 0);
-	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 15 * sMapPrintJobPrice.at(JobType::SinglePage).m_fColorPrice);
-}
-
-TEST(LOADPRINTJOB, ReadZeroPageColourPrintJob)
-{
-	PrintJob job(15, 0, JobType::SinglePage);
-	EXPECT_TRUE(job.IsValidJob());
-	EXPECT_EQ(job.GetBlackWhitePages(), 15);
-	EXPECT_EQ(job.GetColorPages(), 0);
-	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 15 * sMapPrintJobPrice.at(JobType::SinglePage).m_fNonColorPrice);
-	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 0);
-}
-
-TEST(LOADPRINTJOB, ReadInvalidPrintJob)
-{
-	PrintJob job(15, 16, JobType::SinglePage);
-	EXPECT_FALSE(job.IsValidJob());
-}
-
-
-TEST(PRINTTASK, CalculateTotal)
-{
-	string content = "Total Pages, Color Pages, Double Sided\n"
-		"25, 10,false\n"
-		"55, 13, true\n"
-		"502, 22, true\n"
-		"1, 0, false ";
-	std::unique_ptr<CCsvDataFile> dataFile = std::make_unique<CCsvDataFile>();
-
-	dataFile->ReadFromStream(istringstream(content), *dataFile);
-	PrinterTask task(std::move(dataFile));
-	task.DoCalculate();
-	EXPECT_FLOAT_EQ(task.GetTotalPriceForBlackAndWhite(), 15 * 0.15 + 42 * 0.1 + 480 * 0.1 + 1 * 0.15 );
-	EXPECT_FLOAT_EQ(task.GetTotalPriceForColor(), 10 * 0.25 + 13 * 0.2 + 22 * 0.2);
-}
\ No newline at end of file
+// unittest_printerCalculator.cpp :
+//
+#include "stdafx.h"
+#include "gtest/gtest.h"
+#include "CSVDataFile.h"
+#include "PrintJob.h"
+#include "CsvScanner.h"
+#include "CsvFieldConvert.h"
+#include "CsvColumnCache.h"
+#include "DecompressInput.h"
+#include "PrintJobBatch.h"
+#include "ReportWriter.h"
+#include "BatchRunner.h"
+#include "JobLogFollower.h"
+#include "WorkerThreads.h"
+#include "PrinterStats.h"
+#include "JobGroupTable.h"
+#include "SpscQueue.h"
+#include <fstream>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#ifdef PRINTER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+TEST(LOADCSVFILE, loadFile)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n"
+		"25, 10,false\n"
+		"55, 13, true\n"
+		"502, 22, true\n"
+		"1, 0, false ";
+	CCsvDataFile dataFile;
+
+	dataFile.ReadFromStream(istringstream(content), dataFile);
+	//Read file OK
+	EXPECT_EQ(dataFile.GetNumberOfSamples(0),4);
+	
+	//Test read first line
+	int nValue;
+	EXPECT_TRUE(dataFile.GetData("Total Pages", 0, nValue));
+	EXPECT_EQ(nValue, 25);
+	EXPECT_TRUE(dataFile.GetData("Color Pages", 0, nValue));
+	EXPECT_EQ(nValue, 10);
+	//Read false OK
+	bool isDoubleSided;
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 0, isDoubleSided));
+	EXPECT_FALSE(isDoubleSided);
+
+	//Read true OK with blank space in the front
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 1, isDoubleSided));
+	EXPECT_TRUE(isDoubleSided);
+
+	//Test read last line
+	EXPECT_TRUE(dataFile.GetData("Total Pages", 3, nValue));
+	EXPECT_EQ(nValue, 1);
+	EXPECT_TRUE(dataFile.GetData("Color Pages", 3, nValue));
+	EXPECT_EQ(nValue, 0);
+	//Read true OK with blank space
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 3, isDoubleSided));
+	EXPECT_FALSE(isDoubleSided);
+}
+
+TEST(LOADCSVFILE, ReadDefaultOrWrongValue)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n"
+		"100,,FALSE\n"
+		",,TRUE\n"
+		"12ab,cd34,None\n";
+	CCsvDataFile dataFile;
+	dataFile.ReadFromStream(istringstream(content), dataFile);
+	//Read file OK
+	EXPECT_EQ(dataFile.GetNumberOfSamples(0), 3);
+
+	//Read first line
+	int nValue;
+	EXPECT_TRUE(dataFile.GetData("Total Pages", 0, nValue));
+	EXPECT_EQ(nValue, 100);
+	// Read empty value
+	EXPECT_TRUE(dataFile.GetData("Color Pages", 0, nValue));
+	EXPECT_EQ(nValue, 0);
+	//Read UPPER case
+	bool isDoubleSided;
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 0, isDoubleSided));
+	EXPECT_FALSE(isDoubleSided);
+
+	// Read second line
+	// Read empty value
+	EXPECT_TRUE(dataFile.GetData("Total Pages", 1, nValue));
+	EXPECT_EQ(nValue, 0);
+	// Read empty page number
+	EXPECT_TRUE(dataFile.GetData("Color Pages", 1, nValue));
+	EXPECT_EQ(nValue, 0);
+	//Read UPPER case
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 1, isDoubleSided));
+	EXPECT_TRUE(isDoubleSided);
+
+	//Read wrong bool
+	EXPECT_FALSE(dataFile.GetData("Total Pages", 2, nValue));
+	EXPECT_FALSE(dataFile.GetData("Total Pages", 2, nValue));
+	EXPECT_FALSE(dataFile.GetData("Double Sided", 2, isDoubleSided));
+}
+
+TEST(LOADCSVFILE, ReadInBatches)
+{
+	string content = "Total Pages, Color Pages, Double Sided\r\n"
+		"25, 10,false\r\n"
+		"55, 13, true\r\n"
+		"502, 22, true\r\n"
+		"\"7\", 1, true\r\n"
+		"1, 0, false\r\n";
+	istringstream stream(content);
+	CCsvDataFile dataFile;
+	EXPECT_TRUE(dataFile.BeginStream(stream));
+	EXPECT_EQ(dataFile.GetNumberOfVariables(), 3);
+
+	//Every batch replaces the previous one and keeps counting rows
+	EXPECT_EQ(dataFile.ReadNextBatch(stream, 2), 2);
+	EXPECT_EQ(dataFile.GetFirstSampleRow(), 0);
+	EXPECT_EQ(dataFile.GetNumberOfSamples(0), 2);
+
+	EXPECT_EQ(dataFile.ReadNextBatch(stream, 2), 2);
+	EXPECT_EQ(dataFile.GetFirstSampleRow(), 2);
+	EXPECT_EQ(dataFile.GetNumberOfSamples(2), 2);
+	int nValue;
+	EXPECT_TRUE(dataFile.GetData("Total Pages", 1, nValue));
+	EXPECT_EQ(nValue, 7);
+
+	EXPECT_EQ(dataFile.ReadNextBatch(stream, 2), 1);
+	EXPECT_EQ(dataFile.GetFirstSampleRow(), 4);
+	bool isDoubleSided;
+	EXPECT_TRUE(dataFile.GetData("Double Sided", 0, isDoubleSided));
+	EXPECT_FALSE(isDoubleSided);
+
+	EXPECT_EQ(dataFile.ReadNextBatch(stream, 2), 0);
+}
+
+TEST(LOADCSVFILE, ReadMappedFileSameAsStream)
+{
+	string content = "Total Pages,\"Color Pages\", Double Sided\r\n"
+		"25, 10,false\r\n"
+		"\"55\",\"1\"\"3\", true\n"
+		"\"502\",22,\"true\"\r\n"
+		"12\\n,,TRUE\r"
+		"7,\"3\"\n"
+		"1, 0, false, extra";
+	const char* szFileName = "mapped_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	CCsvDataFile mappedFile(szFileName);
+	std::remove(szFileName);
+
+	istringstream stream(content);
+	CCsvDataFile streamFile;
+	streamFile.ReadFromStream(stream, streamFile);
+
+	ASSERT_EQ(mappedFile.GetNumberOfVariables(), streamFile.GetNumberOfVariables());
+	for (int iVar = 0; iVar < streamFile.GetNumberOfVariables(); iVar++)
+	{
+		string mappedName, streamName;
+		mappedFile.GetVariableName(iVar, mappedName);
+		streamFile.GetVariableName(iVar, streamName);
+		EXPECT_EQ(mappedName, streamName);
+		EXPECT_EQ(mappedFile.GetNumberOfSamples(iVar), streamFile.GetNumberOfSamples(iVar));
+	}
+	EXPECT_GT(mappedFile.GetNumberOfSamples(0), 0);
+
+	for (int i = 0; i < streamFile.GetNumberOfSamples(0); i++)
+	{
+		int nMapped = -1, nStream = -1;
+		EXPECT_EQ(mappedFile.GetData("Total Pages", i, nMapped), streamFile.GetData("Total Pages", i, nStream));
+		EXPECT_EQ(nMapped, nStream);
+		EXPECT_EQ(mappedFile.GetData("Color Pages", i, nMapped), streamFile.GetData("Color Pages", i, nStream));
+		EXPECT_EQ(nMapped, nStream);
+		bool bMapped = false, bStream = false;
+		EXPECT_EQ(mappedFile.GetData("Double Sided", i, bMapped), streamFile.GetData("Double Sided", i, bStream));
+		EXPECT_EQ(bMapped, bStream);
+	}
+}
+
+TEST(LOADCSVFILE, ReadTypedColumns)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n"
+		"100,,FALSE\n"
+		",,TRUE\n"
+		"12ab,cd34,None\n"
+		" 7, 3, true \n";
+
+	//Typed columns declared before the load are converted while reading
+	istringstream stream(content);
+	CCsvDataFile dataFile;
+	dataFile.AddTypedColumn("Total Pages", CsvColumnType::Int32);
+	dataFile.AddTypedColumn("double sided ", CsvColumnType::Bool);
+	dataFile.ReadFromStream(stream, dataFile);
+	//Typed columns added after the load convert the rows already read
+	dataFile.AddTypedColumn("Color Pages", CsvColumnType::Int32);
+
+	CsvIntColumn totalPages, colorPages;
+	CsvBoolColumn doubleSided;
+	ASSERT_TRUE(dataFile.GetIntColumn("Total Pages", totalPages));
+	ASSERT_TRUE(dataFile.GetIntColumn("Color Pages", colorPages));
+	ASSERT_TRUE(dataFile.GetBoolColumn("Double Sided", doubleSided));
+	EXPECT_FALSE(dataFile.GetBoolColumn("Total Pages", doubleSided));
+	EXPECT_FALSE(dataFile.GetIntColumn("Missing", totalPages));
+
+	ASSERT_EQ(totalPages.m_nCount, 4);
+	EXPECT_EQ(colorPages.m_nCount, 4);
+	EXPECT_EQ(doubleSided.m_nCount, 4);
+
+	//Same results as GetData, with invalid cells flagged
+	int expectedTotal[] = { 100, 0, 0, 7 };
+	int expectedColor[] = { 0, 0, 0, 3 };
+	bool expectedValid[] = { true, true, false, true };
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_EQ(totalPages.IsValid(i), expectedValid[i]);
+		EXPECT_EQ(colorPages.IsValid(i), expectedValid[i]);
+		EXPECT_EQ(doubleSided.IsValid(i), expectedValid[i]);
+		EXPECT_EQ(totalPages.m_pValues[i], expectedTotal[i]);
+		EXPECT_EQ(colorPages.m_pValues[i], expectedColor[i]);
+	}
+	EXPECT_FALSE(doubleSided.GetValue(0));
+	EXPECT_TRUE(doubleSided.GetValue(1));
+	EXPECT_TRUE(doubleSided.GetValue(3));
+	EXPECT_FALSE(totalPages.IsValid(4));
+}
+
+TEST(LOADCSVFILE, ReadByColumnHandle)
+{
+	string content = "Total Pages, Color Pages, Double Sided, Total Pages\n"
+		"25, 10,false, 1\n"
+		"12ab,cd34,None, 2\n";
+	istringstream stream(content);
+	CCsvDataFile dataFile;
+	dataFile.ReadFromStream(stream, dataFile);
+
+	//Names match ignoring case and surrounding space, the first one wins
+	CsvColumnHandle hTotalPages = dataFile.ResolveColumn(" total PAGES ");
+	CsvColumnHandle hDoubleSided = dataFile.ResolveColumn("Double Sided");
+	EXPECT_TRUE(hTotalPages.IsValid());
+	EXPECT_FALSE(dataFile.ResolveColumn("Pages").IsValid());
+
+	int nValue;
+	EXPECT_TRUE(dataFile.GetData(hTotalPages, 0, nValue));
+	EXPECT_EQ(nValue, 25);
+	bool isDoubleSided = true;
+	EXPECT_TRUE(dataFile.GetData(hDoubleSided, 0, isDoubleSided));
+	EXPECT_FALSE(isDoubleSided);
+
+	//Wrong values, rows and handles are reported without exceptions
+	EXPECT_FALSE(dataFile.GetData(hTotalPages, 1, nValue));
+	EXPECT_FALSE(dataFile.GetData(hDoubleSided, 1, isDoubleSided));
+	EXPECT_FALSE(dataFile.GetData(hTotalPages, 2, nValue));
+	EXPECT_FALSE(dataFile.GetData(CsvColumnHandle(), 0, nValue));
+}
+
+TEST(LOADCSVFILE, ReadMappedFileInParallel)
+{
+	//Quoted line ends must not start a chunk, the second file has an
+	//unbalanced quote so the chunks are found at the wrong lines
+	for (int iFile = 0; iFile < 2; iFile++)
+	{
+		string content = "Total Pages, Color Pages, Double Sided, Note\n";
+		for (int i = 0; i < 20000; i++)
+		{
+			content += to_string(i) + "," + to_string(i % 7) + "," + (i % 3 == 0 ? "true" : "false");
+			content += (i % 5 == 0) ? ",\"line\nbreak, \"\"quoted\"\"\"\n" : ",plain\r\n";
+			if (iFile == 1 && i == 100)
+				content += "1,2,true,\"unbalanced\n";
+		}
+		const char* szFileName = "parallel_test.csv";
+		{
+			ofstream outFile(szFileName, ofstream::binary);
+			outFile << content;
+		}
+		CsvReadOptions options;
+		options.m_vTypedColumns.push_back(CsvColumnSpec("Double Sided", CsvColumnType::Bool));
+		CCsvDataFile serialFile(szFileName, options);
+		options.m_nParseThreads = 4;
+		CCsvDataFile parallelFile(szFileName, options);
+		std::remove(szFileName);
+
+		for (int iVar = 0; iVar < serialFile.GetNumberOfVariables(); iVar++)
+			EXPECT_EQ(parallelFile.GetNumberOfSamples(iVar), serialFile.GetNumberOfSamples(iVar));
+		if (iFile == 0)
+		{
+			EXPECT_EQ(parallelFile.GetNumberOfSamples(0), 20000);
+		}
+
+		CsvColumnHandle hTotalPages = serialFile.ResolveColumn("Total Pages");
+		CsvBoolColumn serialColumn, parallelColumn;
+		ASSERT_TRUE(serialFile.GetBoolColumn("Double Sided", serialColumn));
+		ASSERT_TRUE(parallelFile.GetBoolColumn("Double Sided", parallelColumn));
+		ASSERT_EQ(parallelColumn.m_nCount, serialColumn.m_nCount);
+		for (int i = 0; i < serialFile.GetNumberOfSamples(0); i++)
+		{
+			int nSerial = -1, nParallel = -1;
+			EXPECT_EQ(parallelFile.GetData(hTotalPages, i, nParallel), serialFile.GetData(hTotalPages, i, nSerial));
+			EXPECT_EQ(nParallel, nSerial);
+			EXPECT_EQ(parallelColumn.IsValid(i), serialColumn.IsValid(i));
+			EXPECT_EQ(parallelColumn.GetValue(i), serialColumn.GetValue(i));
+		}
+	}
+}
+
+TEST(LOADCSVFILE, ProjectColumns)
+{
+	//The skipped columns have quoted line ends, escapes and long text
+	string content = "Title, Total Pages, Owner, Color Pages, Double Sided\n";
+	for (int i = 0; i < 20000; i++)
+	{
+		content += (i % 5 == 0) ? "\"report\nof \"\"" + to_string(i) + "\"\"\"" : string(i % 7 == 0 ? 300 : 10, 'x');
+		content += "," + to_string(i % 50) + ",\\owner" + to_string(i % 3) + "," + to_string(i % 9) + "," + (i % 2 == 0 ? "true" : "false");
+		content += (i == 500) ? ",too,many\n" : "\r\n";
+	}
+	const char* szFileName = "projection_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	CsvReadOptions options;
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Double Sided", CsvColumnType::Bool));
+	CCsvDataFile fullFile(szFileName, options);
+	options.m_vstrProjectedColumns.push_back("total pages");
+	options.m_vstrProjectedColumns.push_back("Color Pages");
+	options.m_vstrProjectedColumns.push_back("No Such Column");
+	CCsvDataFile projectedFile(szFileName, options);
+	options.m_nParseThreads = 4;
+	CCsvDataFile parallelFile(szFileName, options);
+	std::remove(szFileName);
+
+	CCsvDataFile streamFile;
+	streamFile.AddTypedColumn("Double Sided", CsvColumnType::Bool);
+	streamFile.SetProjectedColumns(options.m_vstrProjectedColumns);
+	istringstream stream(content);
+	streamFile.ReadFromStream(stream, streamFile);
+
+	CCsvDataFile* apFiles[] = { &projectedFile, &parallelFile, &streamFile };
+	for (int iFile = 0; iFile < 3; iFile++)
+	{
+		CCsvDataFile& df = *apFiles[iFile];
+		//The names stay, only the skipped columns hold no rows
+		ASSERT_EQ(df.GetNumberOfVariables(), 5);
+		EXPECT_EQ(df.GetNumberOfRows(), 20000);
+		EXPECT_EQ(df.GetNumberOfSamples(0), 0);
+		EXPECT_EQ(df.GetNumberOfSamples(2), 0);
+		EXPECT_EQ(df.GetNumberOfSamples(4), 20000);
+		const char* pField;
+		int nLength;
+		EXPECT_FALSE(df.GetField(df.ResolveColumn("Owner"), 0, pField, nLength));
+
+		CsvColumnHandle hTotalPages = df.ResolveColumn("Total Pages");
+		CsvColumnHandle hColorPages = df.ResolveColumn("Color Pages");
+		CsvBoolColumn fullColumn, column;
+		ASSERT_TRUE(fullFile.GetBoolColumn("Double Sided", fullColumn));
+		ASSERT_TRUE(df.GetBoolColumn("Double Sided", column));
+		ASSERT_EQ(column.m_nCount, fullColumn.m_nCount);
+		for (int i = 0; i < df.GetNumberOfRows(); i++)
+		{
+			int nFull = -1, nValue = -2;
+			EXPECT_TRUE(fullFile.GetData(hTotalPages, i, nFull));
+			EXPECT_TRUE(df.GetData(hTotalPages, i, nValue));
+			EXPECT_EQ(nValue, nFull);
+			EXPECT_TRUE(fullFile.GetData(hColorPages, i, nFull));
+			EXPECT_TRUE(df.GetData(hColorPages, i, nValue));
+			EXPECT_EQ(nValue, nFull);
+			EXPECT_EQ(column.GetValue(i), fullColumn.GetValue(i));
+		}
+	}
+
+	//A task loading a file by name keeps the columns it groups by
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	vector<string> vstrGroupColumns(1, "Owner");
+	PrinterTask task(szFileName, 1, false, vstrGroupColumns);
+	std::remove(szFileName);
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	task.SetContinueOnError(true);
+	task.SetGroupBy(vstrGroupColumns);
+	EXPECT_TRUE(task.DoCalculate());
+	vector<PrintJobGroup> vGroups;
+	task.GetGroups(vGroups);
+	ASSERT_EQ(vGroups.size(), 3u);
+	EXPECT_EQ(vGroups[2].m_vstrValues[0], "\\owner2");
+}
+
+TEST(LOADCSVFILE, ReadColumnCache)
+{
+	string content = "Total Pages, Color Pages, Double Sided, Note\n";
+	for (int i = 0; i < 70000; i++)
+		content += to_string(i % 300) + "," + (i % 1000 == 7 ? "x" : to_string(i % 5)) + "," + (i % 3 == 0 ? "true" : "false") + ",\"a, \"\"b\"\"\"\n";
+	const char* szFileName = "cache_test.csv";
+	string strCacheName = GetCsvCacheFileName(szFileName);
+	std::remove(strCacheName.c_str());
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+
+	CsvReadOptions options;
+	options.m_bUseCache = true;
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Color Pages", CsvColumnType::Int32));
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Double Sided", CsvColumnType::Bool));
+	CCsvDataFile parsedFile(szFileName, options);
+
+	//The second load maps the cache written by the first one
+	CCsvColumnCache cache;
+	ASSERT_TRUE(cache.Open(strCacheName.c_str(), szFileName));
+	EXPECT_TRUE(cache.VerifyData());
+	EXPECT_EQ(70000, cache.GetNumberOfRows());
+	CsvCacheBlockStats stats;
+	ASSERT_TRUE(cache.GetBlockStats(1, 1, stats));
+	EXPECT_EQ(0, stats.m_nMin);
+	EXPECT_EQ(4, stats.m_nMax);
+	EXPECT_EQ(70000 - 65536 - 4, stats.m_nValid);
+	EXPECT_FALSE(cache.GetBlockStats(0, 0, stats));
+
+	//Total Pages is converted from the cached text, the others used in place
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Total Pages", CsvColumnType::Int32));
+	CCsvDataFile cachedFile(szFileName, options);
+	ASSERT_EQ(parsedFile.GetNumberOfVariables(), cachedFile.GetNumberOfVariables());
+	ASSERT_EQ(parsedFile.GetNumberOfSamples(0), cachedFile.GetNumberOfSamples(0));
+	CsvIntColumn parsedColor, cachedColor, cachedTotal;
+	CsvBoolColumn parsedDoubleSided, cachedDoubleSided;
+	ASSERT_TRUE(parsedFile.GetIntColumn("Color Pages", parsedColor));
+	ASSERT_TRUE(cachedFile.GetIntColumn("Color Pages", cachedColor));
+	ASSERT_TRUE(cachedFile.GetIntColumn("Total Pages", cachedTotal));
+	ASSERT_TRUE(parsedFile.GetBoolColumn("Double Sided", parsedDoubleSided));
+	ASSERT_TRUE(cachedFile.GetBoolColumn("Double Sided", cachedDoubleSided));
+	CsvColumnHandle hNote = parsedFile.ResolveColumn("Note");
+	for (int i = 0; i < parsedFile.GetNumberOfSamples(0); i++)
+	{
+		EXPECT_EQ(parsedColor.IsValid(i), cachedColor.IsValid(i));
+		EXPECT_EQ(parsedColor.m_pValues[i], cachedColor.m_pValues[i]);
+		EXPECT_EQ(i % 300, cachedTotal.m_pValues[i]);
+		EXPECT_EQ(parsedDoubleSided.GetValue(i), cachedDoubleSided.GetValue(i));
+		string strParsed, strCached;
+		parsedFile.GetData(hNote, i, strParsed);
+		cachedFile.GetData(hNote, i, strCached);
+		EXPECT_EQ(strParsed, strCached);
+	}
+
+	//A changed file is parsed again
+	{
+		ofstream outFile(szFileName, ofstream::binary | ofstream::app);
+		outFile << "1, 1, true, c\n";
+	}
+	EXPECT_FALSE(cache.Open(strCacheName.c_str(), szFileName));
+	CCsvDataFile changedFile(szFileName, options);
+	EXPECT_EQ(70001, changedFile.GetNumberOfSamples(0));
+	EXPECT_TRUE(cache.Open(strCacheName.c_str(), szFileName));
+
+	//A cache which can not be written does not fail the load
+	{
+		ofstream outFile(szFileName, ofstream::binary | ofstream::app);
+		outFile << "2, 1, false, d\n";
+	}
+	string strTempName = strCacheName + ".tmp";
+#ifdef _WIN32
+	ASSERT_EQ(0, _mkdir(strTempName.c_str()));
+#else
+	ASSERT_EQ(0, mkdir(strTempName.c_str(), 0700));
+#endif
+	PrinterTask task(szFileName, 1, true);
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	task.SetContinueOnError(true);
+	EXPECT_STREQ("", task.GetLoadError());
+	EXPECT_TRUE(task.DoCalculate());
+	EXPECT_FALSE(cache.Open(strCacheName.c_str(), szFileName));
+#ifdef _WIN32
+	_rmdir(strTempName.c_str());
+#else
+	rmdir(strTempName.c_str());
+#endif
+	std::remove(szFileName);
+	std::remove(strCacheName.c_str());
+}
+
+TEST(LOADCSVFILE, IgnoreDamagedColumnCache)
+{
+	string content = "Total Pages, Color Pages, Double Sided, Note\n";
+	for (int i = 0; i < 10; i++)
+		content += to_string(i + 5) + ",1,true,note " + to_string(i) + "\n";
+	const char* szFileName = "damaged_cache_test.csv";
+	string strCacheName = GetCsvCacheFileName(szFileName);
+	std::remove(strCacheName.c_str());
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	CsvReadOptions options;
+	options.m_bUseCache = true;
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Total Pages", CsvColumnType::Int32));
+	CCsvDataFile parsedFile(szFileName, options);
+
+	//Field ends of the Note column which go back, the header still matches
+	string strCache;
+	{
+		ifstream inFile(strCacheName.c_str(), ifstream::binary);
+		strCache.assign(istreambuf_iterator<char>(inFile), istreambuf_iterator<char>());
+	}
+	ASSERT_GT(strCache.size(), sizeof(CsvCacheHeader) + 4 * sizeof(CsvCacheColumn));
+	CsvCacheColumn note;
+	memcpy(&note, &strCache[sizeof(CsvCacheHeader) + 3 * sizeof(CsvCacheColumn)], sizeof(note));
+	uint64_t nEnd = 0;
+	memcpy(&strCache[static_cast<size_t>(note.m_nFieldEndsOffset + 5 * sizeof(uint64_t))], &nEnd, sizeof(nEnd));
+	{
+		ofstream outFile(strCacheName.c_str(), ofstream::binary);
+		outFile << strCache;
+	}
+
+	{
+		CCsvColumnCache cache;
+		ASSERT_TRUE(cache.Open(strCacheName.c_str(), szFileName));
+		EXPECT_FALSE(cache.VerifyData());
+		const char* pField;
+		int nLength;
+		EXPECT_FALSE(cache.GetField(3, 5, pField, nLength));
+		EXPECT_TRUE(cache.GetField(3, 4, pField, nLength));
+		EXPECT_EQ("note 4", string(pField, nLength));
+	}
+
+	//A cell of the damaged column is an error, not a read past the text
+	CCsvDataFile cachedFile(szFileName, options);
+	string strNote;
+	EXPECT_FALSE(cachedFile.GetData(cachedFile.ResolveColumn("Note"), 5, strNote));
+
+	//Converting the damaged column parses the file instead
+	options.m_vTypedColumns.push_back(CsvColumnSpec("Note", CsvColumnType::Int32));
+	CCsvDataFile convertedFile(szFileName, options);
+	EXPECT_STREQ("", convertedFile.GetLastError());
+	EXPECT_TRUE(convertedFile.GetData(convertedFile.ResolveColumn("Note"), 5, strNote));
+	EXPECT_EQ("note 5", strNote);
+	std::remove(szFileName);
+	std::remove(strCacheName.c_str());
+}
+
+TEST(LOADCSVFILE, ReadCompressedFile)
+{
+	const char* szFileName = "compressed_test.csv.gz";
+	{
+		//Not a format this build reads unless it has zstd
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << "\x28\xb5\x2f\xfd" << "Total Pages\n";
+	}
+	EXPECT_EQ(CompressionFormat::Zstd, DetectCompression(szFileName));
+	if (!IsCompressionSupported(CompressionFormat::Zstd))
+	{
+		CCsvDataFile dataFile(szFileName);
+		EXPECT_NE(string::npos, string(dataFile.GetLastError()).find("ERROR 0010"));
+	}
+
+#ifdef PRINTER_HAVE_ZLIB
+	//Two gzip members, larger than the blocks, read like the plain text
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 200000; i++)
+		content += to_string(i) + "," + to_string(i % 7) + "," + (i % 3 == 0 ? "true" : "false") + "\n";
+	size_t nHalf = content.size() / 2;
+	for (int iMember = 0; iMember < 2; iMember++)
+	{
+		gzFile pFile = gzopen(szFileName, iMember == 0 ? "wb" : "ab");
+		ASSERT_TRUE(pFile != NULL);
+		string strPart = iMember == 0 ? content.substr(0, nHalf) : content.substr(nHalf);
+		gzwrite(pFile, strPart.data(), static_cast<unsigned>(strPart.size()));
+		gzclose(pFile);
+	}
+	EXPECT_EQ(CompressionFormat::Gzip, DetectCompression(szFileName));
+
+	CCsvDataFile compressedFile(szFileName);
+	EXPECT_STREQ("", compressedFile.GetLastError());
+	ASSERT_EQ(200000, compressedFile.GetNumberOfSamples(0));
+	CsvColumnHandle hTotalPages = compressedFile.ResolveColumn("Total Pages");
+	CsvColumnHandle hDoubleSided = compressedFile.ResolveColumn("Double Sided");
+	for (int i = 0; i < 200000; i += 997)
+	{
+		int nValue = -1;
+		bool bValue = false;
+		EXPECT_TRUE(compressedFile.GetData(hTotalPages, i, nValue));
+		EXPECT_EQ(i, nValue);
+		EXPECT_TRUE(compressedFile.GetData(hDoubleSided, i, bValue));
+		EXPECT_EQ(i % 3 == 0, bValue);
+	}
+
+	//A member ending exactly where a block is full
+	string strBlock = "Total Pages, Color Pages, Double Sided\n";
+	int nBlockRows = 0;
+	for (; strBlock.size() + 18 <= DECOMPRESS_BLOCK_SIZE; nBlockRows++)
+		strBlock += "5,1,true\n";
+	strBlock += string(DECOMPRESS_BLOCK_SIZE - strBlock.size() - 9, '0') + "5,1,true\n";
+	nBlockRows++;
+	ASSERT_EQ(static_cast<size_t>(DECOMPRESS_BLOCK_SIZE), strBlock.size());
+	{
+		gzFile pFile = gzopen(szFileName, "wb");
+		ASSERT_TRUE(pFile != NULL);
+		gzwrite(pFile, strBlock.data(), static_cast<unsigned>(strBlock.size()));
+		gzclose(pFile);
+	}
+	CCsvDataFile blockFile(szFileName);
+	EXPECT_STREQ("", blockFile.GetLastError());
+	EXPECT_EQ(nBlockRows, blockFile.GetNumberOfRows());
+
+	//A file cut short is an error, not fewer rows
+	{
+		gzFile pFile = gzopen(szFileName, "wb");
+		ASSERT_TRUE(pFile != NULL);
+		gzwrite(pFile, content.data(), static_cast<unsigned>(content.size()));
+		gzclose(pFile);
+	}
+	string strCompressed;
+	{
+		ifstream inFile(szFileName, ifstream::binary);
+		strCompressed.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+	}
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << strCompressed.substr(0, strCompressed.size() / 3);
+	}
+	CCsvDataFile truncatedFile(szFileName);
+	EXPECT_NE(string::npos, string(truncatedFile.GetLastError()).find("ERROR 0011"));
+#endif
+	std::remove(szFileName);
+}
+
+TEST(LOADCSVFILE, ReadLongFields)
+{
+	//Fields far longer than a line buffer, quoted or not
+	string strPlain(5000, 'x');
+	string strQuoted;
+	while (strQuoted.length() < 3000)
+		strQuoted += "a, \"b\" ";
+	string strEscaped = strQuoted;
+	for (size_t i = strEscaped.find('"'); i != string::npos; i = strEscaped.find('"', i + 2))
+		strEscaped.insert(i, 1, '"');
+	string content = "Pages,Note\r\n"
+		"1," + strPlain + "\r\n"
+		"2,\"" + strEscaped + "\"\r\n"
+		"3,short\r\n";
+
+	const char* szFileName = "long_fields_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	CCsvDataFile mappedFile(szFileName);
+	std::remove(szFileName);
+
+	istringstream stream(content);
+	CCsvDataFile streamFile;
+	streamFile.ReadFromStream(stream, streamFile);
+
+	CCsvDataFile* apFiles[] = { &mappedFile, &streamFile };
+	for (int iFile = 0; iFile < 2; iFile++)
+	{
+		CCsvDataFile& dataFile = *apFiles[iFile];
+		ASSERT_EQ(dataFile.GetNumberOfSamples(0), 3);
+		CsvColumnHandle hNote = dataFile.ResolveColumn("Note");
+		string strNote;
+		EXPECT_TRUE(dataFile.GetData(hNote, 0, strNote));
+		EXPECT_EQ(strNote, strPlain);
+		EXPECT_TRUE(dataFile.GetData(hNote, 1, strNote));
+		EXPECT_EQ(strNote, strQuoted);
+		int nPages;
+		EXPECT_TRUE(dataFile.GetData("Pages", 2, nPages));
+		EXPECT_EQ(nPages, 3);
+	}
+
+	//A copy keeps its cells while the original reads the next batch
+	istringstream batchStream(content);
+	CCsvDataFile batchFile;
+	EXPECT_TRUE(batchFile.BeginStream(batchStream));
+	EXPECT_EQ(batchFile.ReadNextBatch(batchStream, 2), 2);
+	CCsvDataFile copyFile(batchFile);
+	EXPECT_EQ(batchFile.ReadNextBatch(batchStream, 2), 1);
+	string strNote;
+	EXPECT_TRUE(copyFile.GetData(copyFile.ResolveColumn("Note"), 1, strNote));
+	EXPECT_EQ(strNote, strQuoted);
+	EXPECT_TRUE(batchFile.GetData(batchFile.ResolveColumn("Note"), 0, strNote));
+	EXPECT_EQ(strNote, "short");
+}
+
+TEST(CSVARENA, FieldsStayInPlace)
+{
+	CCsvArena arena;
+	vector<CsvFieldView> vFields;
+	vector<string> vExpected;
+	//Enough fields for several slabs, one of them larger than a slab
+	for (int i = 0; i < 20000; i++)
+	{
+		string strField = std::to_string(i);
+		if (i == 777)
+			strField.append(CCsvArena::SLAB_SIZE * 2, 'y');
+		for (size_t c = 0; c < strField.length(); c++)
+			arena.Put(strField[c]);
+		vFields.push_back(arena.EndField());
+		vExpected.push_back(strField);
+
+		//A discarded field leaves nothing behind
+		arena.Put('z');
+		arena.DiscardField();
+	}
+	for (size_t i = 0; i < vFields.size(); i++)
+		EXPECT_EQ(string(vFields[i].m_pData, vFields[i].m_nLength), vExpected[i]);
+
+	CsvFieldView empty = arena.EndField();
+	EXPECT_EQ(empty.m_nLength, 0);
+	CsvFieldView stored = arena.Store("stored", 6);
+	EXPECT_EQ(string(stored.m_pData, stored.m_nLength), "stored");
+
+	//Reset keeps a single slab to be filled again
+	arena.Reset();
+	EXPECT_LE(arena.GetReservedSize(), CCsvArena::SLAB_SIZE * 5);
+	arena.Put('a');
+	CsvFieldView field = arena.EndField();
+	EXPECT_EQ(string(field.m_pData, field.m_nLength), "a");
+}
+
+TEST(SCANCSV, KernelsMatchScalar)
+{
+	//Every kernel the CPU supports must find the same structural characters
+	const char alphabet[] = "ab1,\"\r\n\\ ";
+	char block[CCsvScanner::BLOCK_SIZE];
+	unsigned int nSeed = 7;
+	CCsvScanner scalar(',', CsvScanKernel::Scalar);
+	CCsvScanner sse(',', CsvScanKernel::SSE);
+	CCsvScanner avx2(',', CsvScanKernel::AVX2);
+	for (int iBlock = 0; iBlock < 100; iBlock++)
+	{
+		for (int i = 0; i < CCsvScanner::BLOCK_SIZE; i++)
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			block[i] = alphabet[(nSeed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		CsvBlockMasks expected, actual;
+		scalar.ScanBlock(block, expected);
+		for (const CCsvScanner* pScanner : { &sse, &avx2 })
+		{
+			pScanner->ScanBlock(block, actual);
+			EXPECT_EQ(actual.m_nDelimiters, expected.m_nDelimiters);
+			EXPECT_EQ(actual.m_nQuotes, expected.m_nQuotes);
+			EXPECT_EQ(actual.m_nNewLines, expected.m_nNewLines);
+			EXPECT_EQ(actual.m_nBackslashes, expected.m_nBackslashes);
+		}
+	}
+}
+
+TEST(SCANCSV, FindFieldEnd)
+{
+	string content = "25,10,false\r\n"
+		"a long field which runs past the end of the first block of 64 bytes,\"x\"\n"
+		"tail";
+	const char* pBegin = content.c_str();
+	const char* pEnd = pBegin + content.length();
+	CCsvScanner scanner(',');
+
+	EXPECT_EQ(scanner.FindFieldEnd(pBegin, pEnd, true), pBegin + 2);
+	EXPECT_EQ(scanner.FindFieldEnd(pBegin + 3, pEnd, true), pBegin + 5);
+	//Without delimiters only the line end counts
+	EXPECT_EQ(scanner.FindFieldEnd(pBegin + 3, pEnd, false), pBegin + 11);
+	size_t nComma = content.find(",\"x");
+	EXPECT_EQ(scanner.FindFieldEnd(pBegin + 13, pEnd, true), pBegin + nComma);
+	EXPECT_EQ(scanner.FindFieldEnd(pBegin + nComma + 1, pEnd, true), pBegin + nComma + 4);
+	EXPECT_EQ(scanner.FindFieldEnd(pEnd - 4, pEnd, true), pEnd);
+}
+
+TEST(CONVERTFIELD, ConvertIntAndBool)
+{
+	int nValue;
+	const char* aszValid[] = { "0", "7", "-7", "+7", " \t42", "00000000000000000012", "12345678", "-123456789",
+		"2147483647", "-2147483648" };
+	for (const char* szField : aszValid)
+	{
+		EXPECT_TRUE(ConvertCsvInt(szField, static_cast<int>(strlen(szField)), nValue)) << szField;
+		EXPECT_EQ(nValue, strtol(szField, NULL, 10)) << szField;
+	}
+	//Empty is 0, but not white space alone
+	EXPECT_TRUE(ConvertCsvInt("", 0, nValue));
+	EXPECT_EQ(nValue, 0);
+	const char* aszInvalid[] = { " ", "-", "+", "12ab", "1234567a9", "42 ", "- 5", "0x10", "1.5",
+		"2147483648", "-2147483649", "99999999999999999999" };
+	for (const char* szField : aszInvalid)
+		EXPECT_FALSE(ConvertCsvInt(szField, static_cast<int>(strlen(szField)), nValue)) << szField;
+
+	//Only the bytes of the field are read
+	EXPECT_TRUE(ConvertCsvInt("1234567890", 3, nValue));
+	EXPECT_EQ(nValue, 123);
+
+	//Random digit strings short enough to fit convert as strtol does
+	unsigned int nSeed = 11;
+	char buff[16];
+	for (int i = 0; i < 10000; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		int nLength = 1 + (nSeed >> 16) % 9;
+		for (int k = 0; k < nLength; k++)
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			buff[k] = static_cast<char>('0' + (nSeed >> 16) % 10);
+		}
+		buff[nLength] = '\0';
+		EXPECT_TRUE(ConvertCsvInt(buff, nLength, nValue));
+		EXPECT_EQ(nValue, strtol(buff, NULL, 10)) << buff;
+	}
+
+	bool bValue;
+	EXPECT_TRUE(ConvertCsvBool(" TRUE\t", 6, bValue));
+	EXPECT_TRUE(bValue);
+	EXPECT_TRUE(ConvertCsvBool("fAlSe", 5, bValue));
+	EXPECT_FALSE(bValue);
+	const char* aszNotBool[] = { "", "  ", "tru", "truee", "t rue", "false1", "0", "1", "yes", "TRUE FALSE" };
+	for (const char* szField : aszNotBool)
+		EXPECT_FALSE(ConvertCsvBool(szField, static_cast<int>(strlen(szField)), bValue)) << szField;
+	//Bytes which only match a letter once the case bit is set
+	EXPECT_FALSE(ConvertCsvBool("\x54\x52\x55\x05", 4, bValue));
+}
+
+TEST(LOADPRINTJOB, ReadSingleSidePrintJob)
+{
+	PrintJob job(15, 10, JobType::SinglePage);
+	EXPECT_TRUE(job.IsValidJob());
+	EXPECT_EQ(job.GetBlackWhitePages(), 5);
+	EXPECT_EQ(job.GetColorPages(), 10);
+	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 5 * sMapPrintJobPrice.at(JobType::SinglePage).m_fNonColorPrice);
+	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 10 * sMapPrintJobPrice.at(JobType::SinglePage).m_fColorPrice);
+}
+
+TEST(LOADPRINTJOB, ReadDoulbeSidePrintJob)
+{
+	PrintJob job(25, 10, JobType::DoublePage);
+	EXPECT_TRUE(job.IsValidJob());
+	EXPECT_EQ(job.GetBlackWhitePages(), 15);
+	EXPECT_EQ(job.GetColorPages(), 10);
+	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 15 * sMapPrintJobPrice.at(JobType::DoublePage).m_fNonColorPrice);
+	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 10 * sMapPrintJobPrice.at(JobType::DoublePage).m_fColorPrice);
+}
+
+TEST(LOADPRINTJOB, ReadZeroPageWhiteAndBlackPrintJob)
+{
+	PrintJob job(15, 15, JobType::SinglePage);
+	EXPECT_TRUE(job.IsValidJob());
+	EXPECT_EQ(job.GetBlackWhitePages(), 0);
+	EXPECT_EQ(job.GetColorPages(), 15);
+	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 0);
+	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 15 * sMapPrintJobPrice.at(JobType::SinglePage).m_fColorPrice);
+}
+
+TEST(LOADPRINTJOB, ReadZeroPageColourPrintJob)
+{
+	PrintJob job(15, 0, JobType::SinglePage);
+	EXPECT_TRUE(job.IsValidJob());
+	EXPECT_EQ(job.GetBlackWhitePages(), 15);
+	EXPECT_EQ(job.GetColorPages(), 0);
+	EXPECT_DOUBLE_EQ(job.GetBlackAndWhitePrice(), 15 * sMapPrintJobPrice.at(JobType::SinglePage).m_fNonColorPrice);
+	EXPECT_DOUBLE_EQ(job.GetColorPrice(), 0);
+}
+
+TEST(LOADPRINTJOB, ReadInvalidPrintJob)
+{
+	PrintJob job(15, 16, JobType::SinglePage);
+	EXPECT_FALSE(job.IsValidJob());
+}
+
+
+TEST(LOADPRINTJOB, ReadPrintJobWithTariff)
+{
+	//The built-in tariff has the rates of the compile time ones
+	EXPECT_EQ(GetDefaultTariff().GetPrice(JobType::SinglePage).m_fNonColorPrice, JobTypeTariff<JobType::SinglePage>::NonColorPrice());
+	EXPECT_EQ(GetDefaultTariff().GetPrice(JobType::DoublePage).m_fColorPrice, sMapPrintJobPrice.at(JobType::DoublePage).m_fColorPrice);
+
+	const char* szFileName = "tariff_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << "Job Type, Black And White Price, Color Price\n double side , 0.5, 1.5\n";
+	}
+	PrintTariff tariff;
+	string strError;
+	EXPECT_TRUE(tariff.LoadFromFile(szFileName, strError));
+	PrintJob job(12, 2, JobType::DoublePage, tariff);
+	EXPECT_FLOAT_EQ(job.GetBlackAndWhitePrice(), 5.0f);
+	EXPECT_FLOAT_EQ(job.GetColorPrice(), 3.0f);
+	//Job types without a row keep their rates
+	EXPECT_EQ(tariff.GetPrice(JobType::SinglePage).m_fColorPrice, 0.25f);
+
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << "Job Type, Black And White Price, Color Price\nTriple Side, 0.5, 1.5\n";
+	}
+	EXPECT_FALSE(tariff.LoadFromFile(szFileName, strError));
+	EXPECT_EQ(tariff.GetPrice(JobType::DoublePage).m_fNonColorPrice, 0.5f);
+	std::remove(szFileName);
+	EXPECT_FALSE(tariff.LoadFromFile(szFileName, strError));
+}
+
+TEST(LOADPRINTJOB, RejectTariffRates)
+{
+	const char* szFileName = "tariff_rates_test.csv";
+	const char* aszRates[] = { "nan, 1.5", "0.5, inf", "-0.5, 1.5", "0.5, -inf", "1e30, 1.5", "0.5, 10001" };
+	PrintTariff tariff;
+	string strError;
+	for (size_t i = 0; i < sizeof(aszRates) / sizeof(aszRates[0]); i++)
+	{
+		{
+			ofstream outFile(szFileName, ofstream::binary);
+			outFile << "Job Type, Black And White Price, Color Price\nSingle Side, 0.5, 1.5\nDouble Side, " << aszRates[i] << "\n";
+		}
+		EXPECT_FALSE(tariff.LoadFromFile(szFileName, strError)) << aszRates[i];
+		EXPECT_EQ("Invalid tariff in row 1: Double Side", strError);
+		EXPECT_EQ(GetDefaultTariff().GetPrice(JobType::DoublePage).m_nColorMilliCents, tariff.GetPrice(JobType::DoublePage).m_nColorMilliCents);
+		EXPECT_EQ(GetDefaultTariff().GetPrice(JobType::SinglePage).m_fNonColorPrice, tariff.GetPrice(JobType::SinglePage).m_fNonColorPrice);
+	}
+
+	//Free pages and the highest rate are valid
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << "Job Type, Black And White Price, Color Price\nDouble Side, 0, 10000\n";
+	}
+	EXPECT_TRUE(tariff.LoadFromFile(szFileName, strError));
+	EXPECT_EQ(1000000000, tariff.GetPrice(JobType::DoublePage).m_nColorMilliCents);
+	std::remove(szFileName);
+}
+
+TEST(PRICEJOBS, ExactTotals)
+{
+	EXPECT_EQ(PriceToMilliCents(0.15f), 15000);
+	EXPECT_EQ(FormatMilliCents(5460000), "54.60");
+	EXPECT_EQ(FormatMilliCents(125), "0.00125");
+	EXPECT_EQ(FormatMilliCents(-1500000), "-15.00");
+
+	//A thousand jobs of 0.15 add up to exactly 150.00
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 1000; i++)
+		content += "1, 0, false\n";
+	unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+	istringstream stream(content);
+	ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+	PrinterTask task(std::move(ptrDataFile));
+	EXPECT_TRUE(task.DoCalculateParallel(2));
+	EXPECT_EQ(task.GetTotalMilliCentsForBlackAndWhite(), 1000 * 15000);
+	EXPECT_EQ(task.GetExactTotalForBlackAndWhite(), "150.00");
+	EXPECT_EQ(task.GetExactTotalForColor(), "0.00");
+	task.SetAccountingMode(AccountingMode::MilliCents);
+	EXPECT_EQ(task.GetTotalPriceForBlackAndWhite(), 150.0f);
+
+	//Serial, streamed and parallel calculations agree to the milli-cent
+	string mixed = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 10000; i++)
+		mixed += to_string(i % 13) + "," + to_string(i % 5) + "," + (i % 4 == 0 ? "true" : "false") + "\n";
+	unique_ptr<CCsvDataFile> ptrMixedFile = make_unique<CCsvDataFile>();
+	istringstream mixedStream(mixed);
+	ptrMixedFile->ReadFromStream(mixedStream, *ptrMixedFile);
+	PrinterTask parallelTask(std::move(ptrMixedFile));
+	EXPECT_TRUE(parallelTask.DoCalculateParallel(3));
+	PrinterTask streamTask;
+	istringstream mixedStream2(mixed);
+	EXPECT_TRUE(streamTask.DoCalculateStream(mixedStream2, 777));
+	EXPECT_EQ(parallelTask.GetTotalMilliCentsForBlackAndWhite(), streamTask.GetTotalMilliCentsForBlackAndWhite());
+	EXPECT_EQ(parallelTask.GetTotalMilliCentsForColor(), streamTask.GetTotalMilliCentsForColor());
+}
+
+TEST(PRICEJOBS, KernelsMatchPrintJob)
+{
+	const int nJobs = 1003;
+	vector<int> vnTotalPages(nJobs), vnColorPages(nJobs);
+	vector<uint8_t> vnJobTypes(nJobs);
+	srand(7);
+	for (int i = 0; i < nJobs; i++)
+	{
+		vnTotalPages[i] = rand() % 2000 - 10;
+		vnColorPages[i] = rand() % 1000 - 10;
+		vnJobTypes[i] = static_cast<uint8_t>(rand() % 3);
+	}
+
+	const JobTypePrice& singlePrice = sMapPrintJobPrice.at(JobType::SinglePage);
+	const JobTypePrice& doublePrice = sMapPrintJobPrice.at(JobType::DoublePage);
+	PrintBatchCost scalarCost;
+	vector<float> vfBlackAndWhite(nJobs), vfColor(nJobs);
+	PricePrintJobs(&vnTotalPages[0], &vnColorPages[0], &vnJobTypes[0], nJobs, singlePrice, doublePrice,
+		scalarCost, &vfBlackAndWhite[0], &vfColor[0], PriceKernel::Scalar);
+
+	//Every job costs the same as a PrintJob
+	for (int i = 0; i < nJobs; i++)
+	{
+		PrintJob job(vnTotalPages[i], vnColorPages[i], vnJobTypes[i] != 0 ? JobType::DoublePage : JobType::SinglePage);
+		EXPECT_EQ(vfBlackAndWhite[i], job.GetBlackAndWhitePrice());
+		EXPECT_EQ(vfColor[i], job.GetColorPrice());
+	}
+
+	//The sums are the same bits with every kernel, with or without the costs of the jobs
+	PriceKernel aeKernels[] = { PriceKernel::SSE, PriceKernel::AVX2 };
+	for (int k = 0; k < 2; k++)
+	{
+		PrintBatchCost cost;
+		vector<float> vfKernelColor(nJobs);
+		PricePrintJobs(&vnTotalPages[0], &vnColorPages[0], &vnJobTypes[0], nJobs, singlePrice, doublePrice,
+			cost, NULL, &vfKernelColor[0], aeKernels[k]);
+		EXPECT_EQ(cost.m_dBlackAndWhite, scalarCost.m_dBlackAndWhite);
+		EXPECT_EQ(cost.m_dColor, scalarCost.m_dColor);
+		for (int t = 0; t < JOB_TYPE_COUNT; t++)
+		{
+			EXPECT_EQ(cost.m_anNoneColorPages[t], scalarCost.m_anNoneColorPages[t]);
+			EXPECT_EQ(cost.m_anColorPages[t], scalarCost.m_anColorPages[t]);
+		}
+		EXPECT_TRUE(vfKernelColor == vfColor);
+	}
+}
+
+TEST(REPORT, FormatPriceMatchesPrintf)
+{
+	char buff[REPORT_NUMBER_SIZE], expected[REPORT_NUMBER_SIZE];
+	float afValues[] = { 0.0f, -0.0f, 0.125f, 0.375f, 2.25f, 0.1f * 3, 48.0f, 54.6f, 1e-8f, 123456.78f, 1e9f, 3e38f, -7.005f };
+	for (size_t i = 0; i < sizeof(afValues) / sizeof(afValues[0]); i++)
+	{
+		FormatPrice(afValues[i], buff);
+		sprintf(expected, "%.2f", afValues[i]);
+		EXPECT_STREQ(buff, expected);
+	}
+	srand(11);
+	for (int i = 0; i < 100000; i++)
+	{
+		float fValue = static_cast<float>(rand()) / RAND_MAX * (i % 2 == 0 ? 10.0f : 100000.0f);
+		FormatPrice(fValue, buff);
+		sprintf(expected, "%.2f", fValue);
+		ASSERT_STREQ(buff, expected);
+	}
+}
+
+TEST(REPORT, WriteJobs)
+{
+	const char* szFileName = "report_test.txt";
+	FILE* pFile = fopen(szFileName, "wb");
+	ASSERT_TRUE(pFile != NULL);
+	{
+		CReportWriter textReport(ReportMode::Text, pFile);
+		textReport.WriteJob(3, JobType::DoublePage, 42, 4.2f, 13, 2.6f);
+		textReport.WriteSummary("54.60", "9.50");
+		CReportWriter jsonReport(ReportMode::Json, pFile);
+		jsonReport.WriteJob(4, JobType::SinglePage, 15, 2.25f, 10, 2.5f);
+		CReportWriter summaryReport(ReportMode::Summary, pFile);
+		summaryReport.WriteJob(5, JobType::SinglePage, 15, 2.25f, 10, 2.5f);
+	}
+	fclose(pFile);
+
+	ifstream inFile(szFileName, ifstream::binary);
+	string content((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+	inFile.close();
+	std::remove(szFileName);
+	EXPECT_EQ(content, "Add Print Job No. 3 - Type: Double Side\n Black and White Printing Pages: 42, cost: 4.20\n Color Printing Pages: 13, cost: 2.60\n\n "
+		"Summary:\nTotal cost for black and white printing is 54.60\nTotal cost for color printing is 9.50\n"
+		"{\"row\":4,\"jobType\":\"single\",\"blackAndWhitePages\":15,\"blackAndWhiteCost\":2.25,\"colorPages\":10,\"colorCost\":2.50}\n");
+}
+
+TEST(PRINTTASK, CalculateTotal)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n"
+		"25, 10,false\n"
+		"55, 13, true\n"
+		"502, 22, true\n"
+		"1, 0, false ";
+	std::unique_ptr<CCsvDataFile> dataFile = std::make_unique<CCsvDataFile>();
+
+	dataFile->ReadFromStream(istringstream(content), *dataFile);
+	PrinterTask task(std::move(dataFile));
+	task.DoCalculate();
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForBlackAndWhite(), 15 * 0.15 + 42 * 0.1 + 480 * 0.1 + 1 * 0.15 );
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForColor(), 10 * 0.25 + 13 * 0.2 + 22 * 0.2);
+}
+
+TEST(PRINTTASK, CalculateStream)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n"
+		"25, 10,false\n"
+		"55, 13, true\n"
+		"502, 22, true\n"
+		"1, 0, false ";
+	istringstream stream(content);
+	PrinterTask task;
+	EXPECT_TRUE(task.DoCalculateStream(stream, 3));
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForBlackAndWhite(), 15 * 0.15 + 42 * 0.1 + 480 * 0.1 + 1 * 0.15);
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForColor(), 10 * 0.25 + 13 * 0.2 + 22 * 0.2);
+}
+
+TEST(PRINTTASK, CalculateParallel)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 9000; i++)
+		content += to_string(i % 97 + 3) + "," + to_string(i % 3) + "," + (i % 2 == 0 ? "true" : "false") + "\n";
+
+	//The totals are the same bits whatever the number of threads
+	float fBlackAndWhite = 0, fColor = 0;
+	for (int nThreads = 1; nThreads <= 3; nThreads++)
+	{
+		unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+		istringstream stream(content);
+		ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+		PrinterTask task(std::move(ptrDataFile));
+		EXPECT_TRUE(task.DoCalculateParallel(nThreads));
+		if (nThreads == 1)
+		{
+			fBlackAndWhite = task.GetTotalPriceForBlackAndWhite();
+			fColor = task.GetTotalPriceForColor();
+		}
+		EXPECT_EQ(task.GetTotalPriceForBlackAndWhite(), fBlackAndWhite);
+		EXPECT_EQ(task.GetTotalPriceForColor(), fColor);
+	}
+
+	PrinterTask serialTask(make_unique<CCsvDataFile>());
+	istringstream stream(content);
+	EXPECT_TRUE(serialTask.DoCalculateStream(stream));
+	EXPECT_NEAR(serialTask.GetTotalPriceForBlackAndWhite(), fBlackAndWhite, 0.5);
+	EXPECT_NEAR(serialTask.GetTotalPriceForColor(), fColor, 0.5);
+
+	//The rows after an invalid one are not priced
+	unique_ptr<CCsvDataFile> ptrBadFile = make_unique<CCsvDataFile>();
+	istringstream badStream(content + "12, abc, true\n" + content.substr(content.find('\n') + 1));
+	ptrBadFile->ReadFromStream(badStream, *ptrBadFile);
+	PrinterTask badTask(std::move(ptrBadFile));
+	EXPECT_FALSE(badTask.DoCalculateParallel(4));
+	EXPECT_EQ(badTask.GetTotalPriceForBlackAndWhite(), fBlackAndWhite);
+	EXPECT_EQ(badTask.GetTotalPriceForColor(), fColor);
+}
+
+TEST(PRINTTASK, RetainPackedJobs)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 5000; i++)
+	{
+		if (i % 7 == 3)
+			content += "1, 5, true\n";	//more color pages than pages, not kept
+		else
+			content += to_string(i % 89 + 5) + "," + to_string(i % 4) + "," + (i % 3 == 0 ? "true" : "false") + "\n";
+	}
+
+	for (int nThreads = 0; nThreads <= 2; nThreads++)
+	{
+		unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+		istringstream stream(content);
+		ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+		PrinterTask task(std::move(ptrDataFile));
+		task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		EXPECT_TRUE(nThreads == 0 ? task.DoCalculate() : task.DoCalculateParallel(nThreads));
+
+		const CPrintJobStore& jobs = task.GetPrintJobs();
+		EXPECT_EQ(5000 - 714, jobs.Size());
+		EXPECT_LT(jobs.GetMemoryUsage(), 16u * jobs.Size());	//a map node alone is 48 bytes
+
+		//The jobs are in row order and found by row
+		int iLastRow = -1, nJobs = 0;
+		int64_t nBlackAndWhite = 0;
+		jobs.ForEach([&](int iRow, const PackedPrintJob& job)
+		{
+			EXPECT_LT(iLastRow, iRow);
+			PackedPrintJob found;
+			EXPECT_TRUE(jobs.Find(iRow, found));
+			EXPECT_EQ(job.GetBlackWhitePages(), found.GetBlackWhitePages());
+			EXPECT_EQ(job.GetColorPages(), found.GetColorPages());
+			EXPECT_EQ(job.GetPrintType(), found.GetPrintType());
+			nBlackAndWhite += job.ToPrintJob().GetBlackAndWhiteMilliCents();
+			iLastRow = iRow;
+			nJobs++;
+		});
+		EXPECT_EQ(jobs.Size(), nJobs);
+		EXPECT_EQ(task.GetTotalMilliCentsForBlackAndWhite(), nBlackAndWhite);
+		PackedPrintJob found;
+		EXPECT_FALSE(jobs.Find(iLastRow + 1, found));
+	}
+
+	//Only the totals are kept
+	unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+	istringstream stream(content);
+	ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+	PrinterTask task(std::move(ptrDataFile));
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	task.SetRetainJobs(false);
+	EXPECT_TRUE(task.DoCalculate());
+	EXPECT_TRUE(task.GetPrintJobs().Empty());
+	EXPECT_LT(0, task.GetTotalMilliCentsForBlackAndWhite());
+}
+
+TEST(PRINTTASK, ContinueOnError)
+{
+	string header = "Total Pages, Color Pages, Double Sided\n";
+	string content;
+	for (int i = 0; i < 6000; i++)
+		content += to_string(i % 89 + 5) + "," + to_string(i % 4) + "," + (i % 3 == 0 ? "true" : "false") + "\n";
+
+	PrinterTask validTask(make_unique<CCsvDataFile>());
+	validTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	istringstream validStream(header + content);
+	EXPECT_TRUE(validTask.DoCalculateStream(validStream));
+
+	//A bad row before, inside and after the valid ones, one of each kind
+	string badContent = header + "abc, 1, true\n" + content.substr(0, content.size() / 2) + "10, x, false\n"
+		+ content.substr(content.size() / 2) + "10, 2, maybe\n";
+	for (int nThreads = 0; nThreads <= 3; nThreads++)
+	{
+		unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+		istringstream stream(badContent);
+		ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+		PrinterTask task(std::move(ptrDataFile));
+		task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		task.SetContinueOnError(true);
+		task.SetGroupBy(vector<string>(1, "Double Sided"));
+		EXPECT_TRUE(nThreads == 0 ? task.DoCalculate() : task.DoCalculateParallel(nThreads));
+
+		std::vector<int> vnRows = task.GetExceptionLines();
+		ASSERT_EQ(3, vnRows.size());
+		EXPECT_EQ(3, task.GetNumberOfExceptionRows());
+		EXPECT_LT(vnRows[0], vnRows[1]);
+		EXPECT_EQ(vnRows[0] + 6002, vnRows[2]);
+		EXPECT_EQ(RowError::TotalPages, task.GetRowError(vnRows[0]));
+		EXPECT_EQ(RowError::ColorPages, task.GetRowError(vnRows[1]));
+		EXPECT_EQ(RowError::DoubleSided, task.GetRowError(vnRows[2]));
+		EXPECT_EQ(RowError::None, task.GetRowError(vnRows[0] + 1));
+
+		//The totals are those of the valid rows
+		EXPECT_EQ(validTask.GetTotalMilliCentsForBlackAndWhite(), task.GetTotalMilliCentsForBlackAndWhite());
+		EXPECT_EQ(validTask.GetTotalMilliCentsForColor(), task.GetTotalMilliCentsForColor());
+
+		vector<PrintJobGroup> vGroups;
+		task.GetGroups(vGroups);
+		ASSERT_EQ(2u, vGroups.size());
+		EXPECT_EQ(6000, vGroups[0].m_nJobs + vGroups[1].m_nJobs);
+
+		//Calculating again records every bad row once, with its own reason,
+		//and starts the totals and the groups from 0
+		EXPECT_TRUE(nThreads == 0 ? task.DoCalculateParallel(2) : task.DoCalculate());
+		EXPECT_EQ(3, task.GetNumberOfExceptionRows());
+		EXPECT_EQ(vnRows, task.GetExceptionLines());
+		EXPECT_EQ(RowError::ColorPages, task.GetRowError(vnRows[1]));
+		EXPECT_EQ(RowError::DoubleSided, task.GetRowError(vnRows[2]));
+		EXPECT_EQ(validTask.GetTotalMilliCentsForBlackAndWhite(), task.GetTotalMilliCentsForBlackAndWhite());
+		EXPECT_EQ(validTask.GetTotalMilliCentsForColor(), task.GetTotalMilliCentsForColor());
+		EXPECT_FLOAT_EQ(validTask.GetTotalPriceForBlackAndWhite(), task.GetTotalPriceForBlackAndWhite());
+		vector<PrintJobGroup> vGroupsAgain;
+		task.GetGroups(vGroupsAgain);
+		ASSERT_EQ(2u, vGroupsAgain.size());
+		EXPECT_EQ(vGroups[0].m_nJobs, vGroupsAgain[0].m_nJobs);
+		EXPECT_EQ(vGroups[1].m_nJobs, vGroupsAgain[1].m_nJobs);
+		EXPECT_EQ(vGroups[0].m_nBlackAndWhiteMilliCents, vGroupsAgain[0].m_nBlackAndWhiteMilliCents);
+	}
+}
+
+TEST(PRINTTASK, PriceScenarios)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 10000; i++)
+		content += to_string(i % 17) + "," + to_string(i % 7) + "," + (i % 3 == 0 ? "true" : "false") + "\n";
+	const char* szFileName = "scenario_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	std::shared_ptr<const CCsvDataFile> ptrDataset = LoadPrintJobDataset(szFileName);
+	std::remove(szFileName);
+
+	vector<PrintTariff> vTariffs(3);
+	vTariffs[1].SetPrice(JobType::SinglePage, JobTypePrice(0.12f, 0.3f));
+	vTariffs[2].SetPrice(JobType::DoublePage, JobTypePrice(0.07f, 0.18f));
+	PrinterTask scenarioTask(ptrDataset);
+	vector<PrinterScenarioTotals> vTotals;
+	vector<pair<int, RowError> > vRowErrors;
+	EXPECT_TRUE(scenarioTask.DoCalculateScenarios(vTariffs, vTotals, vRowErrors));
+	EXPECT_TRUE(vRowErrors.empty());
+	ASSERT_EQ(vTotals.size(), 3u);
+
+	//Tasks sharing the data set on their own threads get the same totals
+	vector<unique_ptr<PrinterTask> > vptrTasks;
+	vector<std::thread> vThreads;
+	for (size_t i = 0; i < vTariffs.size(); i++)
+	{
+		vptrTasks.push_back(make_unique<PrinterTask>(ptrDataset));
+		vptrTasks[i]->SetTariff(vTariffs[i]);
+		vptrTasks[i]->SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		PrinterTask* pTask = vptrTasks[i].get();
+		vThreads.push_back(std::thread([pTask]() { pTask->DoCalculate(); }));
+	}
+	for (size_t i = 0; i < vThreads.size(); i++)
+		vThreads[i].join();
+	for (size_t i = 0; i < vTariffs.size(); i++)
+	{
+		EXPECT_EQ(vTotals[i].m_fBlackAndWhite, vptrTasks[i]->GetTotalPriceForBlackAndWhite());
+		EXPECT_EQ(vTotals[i].m_fColor, vptrTasks[i]->GetTotalPriceForColor());
+		EXPECT_EQ(vTotals[i].m_nBlackAndWhiteMilliCents, vptrTasks[i]->GetTotalMilliCentsForBlackAndWhite());
+		EXPECT_EQ(vTotals[i].m_nColorMilliCents, vptrTasks[i]->GetTotalMilliCentsForColor());
+	}
+	EXPECT_NE(vTotals[0].m_nBlackAndWhiteMilliCents, vTotals[1].m_nBlackAndWhiteMilliCents);
+	EXPECT_NE(vTotals[0].m_nColorMilliCents, vTotals[2].m_nColorMilliCents);
+
+	//A shared data set can not be streamed into
+	istringstream stream(content);
+	EXPECT_FALSE(scenarioTask.DoCalculateStream(stream));
+
+	//The rows before a bad one still count, like in DoCalculate
+	const char* szBadFileName = "scenario_bad_test.csv";
+	{
+		ofstream outFile(szBadFileName, ofstream::binary);
+		outFile << "Total Pages, Color Pages, Double Sided\n25, 10, false\nmany, 1, true\n5, 0, true\n";
+	}
+	PrinterTask badTask(LoadPrintJobDataset(szBadFileName));
+	std::remove(szBadFileName);
+	badTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	EXPECT_FALSE(badTask.DoCalculateScenarios(vTariffs, vTotals, vRowErrors));
+	EXPECT_EQ(vTotals[0].m_nBlackAndWhiteMilliCents, 15 * 15000);
+	ASSERT_EQ(1u, vRowErrors.size());
+	EXPECT_EQ(1, vRowErrors[0].first);
+	EXPECT_EQ(RowError::TotalPages, vRowErrors[0].second);
+
+	//The bad rows go to vRowErrors only, the task records its own calculations
+	EXPECT_EQ(RowError::None, badTask.GetRowError(1));
+	EXPECT_EQ(0, badTask.GetNumberOfExceptionRows());
+	badTask.SetContinueOnError(true);
+	EXPECT_TRUE(badTask.DoCalculateScenarios(vTariffs, vTotals, vRowErrors));
+	EXPECT_EQ(1u, vRowErrors.size());
+	EXPECT_EQ(0, badTask.GetNumberOfExceptionRows());
+	EXPECT_TRUE(badTask.DoCalculate());
+	EXPECT_EQ(1, badTask.GetNumberOfExceptionRows());
+	EXPECT_EQ(RowError::TotalPages, badTask.GetRowError(1));
+}
+
+TEST(GROUPBY, FindAndMergeGroups)
+{
+	CJobGroupTable table;
+	vector<string> vstrKeys;
+	//More groups than the first table has slots
+	for (int i = 0; i < 1000; i++)
+	{
+		string strKey;
+		string strValue = "user" + to_string(i);
+		AppendGroupKey(strKey, "Sales", 5);
+		AppendGroupKey(strKey, strValue.c_str(), static_cast<int>(strValue.length()));
+		EXPECT_EQ(table.FindOrAdd(strKey.data(), static_cast<int>(strKey.length())), i);
+		table.GetCounts(i).m_nJobs += i;
+		vstrKeys.push_back(strKey);
+	}
+	for (int i = 0; i < 1000; i++)
+		EXPECT_EQ(table.FindOrAdd(vstrKeys[i].data(), static_cast<int>(vstrKeys[i].length())), i);
+	EXPECT_EQ(table.Size(), 1000);
+
+	//The values are split back, and an empty value is kept
+	string strKey;
+	AppendGroupKey(strKey, "", 0);
+	AppendGroupKey(strKey, "a,b", 3);
+	int iGroup = table.FindOrAdd(strKey.data(), static_cast<int>(strKey.length()));
+	vector<string> vstrValues;
+	SplitGroupKey(table.GetKey(iGroup), vstrValues);
+	ASSERT_EQ(vstrValues.size(), 2u);
+	EXPECT_EQ(vstrValues[0], "");
+	EXPECT_EQ(vstrValues[1], "a,b");
+
+	//Merging adds the counts of the groups found in both tables
+	CJobGroupTable other;
+	other.GetCounts(other.FindOrAdd(vstrKeys[5].data(), static_cast<int>(vstrKeys[5].length()))).m_nJobs = 10;
+	other.GetCounts(other.FindOrAdd("new", 3)).m_anColorPages[1] = 7;
+	table.Merge(other);
+	EXPECT_EQ(table.Size(), 1002);
+	EXPECT_EQ(table.GetCounts(5).m_nJobs, 15);
+	EXPECT_EQ(table.GetCounts(table.FindOrAdd("new", 3)).m_anColorPages[1], 7);
+
+	table.Clear();
+	EXPECT_EQ(table.Size(), 0);
+	EXPECT_EQ(table.FindOrAdd("new", 3), 0);
+}
+
+TEST(PRINTTASK, GroupJobs)
+{
+	string content = "Department, User, Total Pages, Color Pages, Double Sided\n";
+	int64_t nValidJobs = 0;
+	for (int i = 0; i < 10000; i++)
+	{
+		//more color pages than pages is not a job
+		if (i % 17 >= i % 7)
+			nValidJobs++;
+		content += string(i % 3 == 0 ? "Sales" : "Support") + ",u" + to_string(i % 5) + "," + to_string(i % 17) + "," + to_string(i % 7) + "," + (i % 4 == 0 ? "true" : "false") + "\n";
+	}
+	vector<string> vstrColumns;
+	vstrColumns.push_back("Department");
+	vstrColumns.push_back("User");
+
+	vector<vector<PrintJobGroup> > vResults;
+	//0 streams the file, 1 prices it serially, more in parallel
+	for (int nThreads = 0; nThreads <= 3; nThreads++)
+	{
+		unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+		istringstream stream(content);
+		if (nThreads > 0)
+			ptrDataFile->ReadFromStream(stream, *ptrDataFile);
+		PrinterTask task(std::move(ptrDataFile));
+		task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		task.SetGroupBy(vstrColumns);
+		if (nThreads == 0)
+			EXPECT_TRUE(task.DoCalculateStream(stream, 777));
+		else
+			EXPECT_TRUE(nThreads == 1 ? task.DoCalculate() : task.DoCalculateParallel(nThreads));
+		vResults.push_back(vector<PrintJobGroup>());
+		task.GetGroups(vResults.back());
+
+		//The groups add up to the totals of the task
+		int64_t nJobs = 0, nBlackAndWhite = 0, nColor = 0;
+		for (size_t i = 0; i < vResults.back().size(); i++)
+		{
+			nJobs += vResults.back()[i].m_nJobs;
+			nBlackAndWhite += vResults.back()[i].m_nBlackAndWhiteMilliCents;
+			nColor += vResults.back()[i].m_nColorMilliCents;
+		}
+		EXPECT_EQ(nJobs, nValidJobs);
+		EXPECT_EQ(nBlackAndWhite, task.GetTotalMilliCentsForBlackAndWhite());
+		EXPECT_EQ(nColor, task.GetTotalMilliCentsForColor());
+	}
+
+	//10 groups sorted by their values, the same however the file is priced
+	ASSERT_EQ(vResults[0].size(), 10u);
+	EXPECT_EQ(vResults[0][0].m_vstrValues[0], "Sales");
+	EXPECT_EQ(vResults[0][0].m_vstrValues[1], "u0");
+	EXPECT_EQ(vResults[0][9].m_vstrValues[0], "Support");
+	EXPECT_EQ(vResults[0][9].m_vstrValues[1], "u4");
+	for (size_t r = 1; r < vResults.size(); r++)
+	{
+		ASSERT_EQ(vResults[r].size(), vResults[0].size());
+		for (size_t i = 0; i < vResults[0].size(); i++)
+		{
+			EXPECT_EQ(vResults[r][i].m_vstrValues, vResults[0][i].m_vstrValues);
+			EXPECT_EQ(vResults[r][i].m_nJobs, vResults[0][i].m_nJobs);
+			EXPECT_EQ(vResults[r][i].m_nBlackWhitePages, vResults[0][i].m_nBlackWhitePages);
+			EXPECT_EQ(vResults[r][i].m_nColorPages, vResults[0][i].m_nColorPages);
+			EXPECT_EQ(vResults[r][i].m_nBlackAndWhiteMilliCents, vResults[0][i].m_nBlackAndWhiteMilliCents);
+			EXPECT_EQ(vResults[r][i].m_nColorMilliCents, vResults[0][i].m_nColorMilliCents);
+		}
+	}
+
+	//A missing column groups by an empty value, and the jobs after a bad row are not counted
+	unique_ptr<CCsvDataFile> ptrBadFile = make_unique<CCsvDataFile>();
+	istringstream badStream("Department, Total Pages, Color Pages, Double Sided\nSales, 25, 10, false\nSales, 55, x, true\nSupport, 5, 0, true\n");
+	ptrBadFile->ReadFromStream(badStream, *ptrBadFile);
+	PrinterTask badTask(std::move(ptrBadFile));
+	badTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	badTask.SetGroupBy(vstrColumns);
+	EXPECT_FALSE(badTask.DoCalculateParallel(2));
+	vector<PrintJobGroup> vGroups;
+	badTask.GetGroups(vGroups);
+	ASSERT_EQ(vGroups.size(), 1u);
+	EXPECT_EQ(vGroups[0].m_vstrValues[0], "Sales");
+	EXPECT_EQ(vGroups[0].m_vstrValues[1], "");
+	EXPECT_EQ(vGroups[0].m_nJobs, 1);
+	EXPECT_EQ(vGroups[0].m_nColorPages, 10);
+}
+
+TEST(SPSCQUEUE, PassItemsInOrder)
+{
+	//A queue far smaller than the items makes both threads wait in turn
+	CSpscQueue<int> queue(3);
+	std::thread producer([&queue]()
+	{
+		for (int i = 0; i < 100000; i++)
+			queue.Push(i);
+		queue.Close();
+	});
+	int nItem, nExpected = 0;
+	while (queue.Pop(nItem))
+		EXPECT_EQ(nItem, nExpected++);
+	producer.join();
+	EXPECT_EQ(nExpected, 100000);
+	EXPECT_FALSE(queue.Push(1));
+
+	//Closing by the consumer stops a producer waiting for room
+	CSpscQueue<int> stopped(2);
+	EXPECT_TRUE(stopped.TryPush(1));
+	EXPECT_TRUE(stopped.TryPush(2));
+	EXPECT_FALSE(stopped.TryPush(3));
+	std::thread blocked([&stopped]() { EXPECT_FALSE(stopped.Push(3)); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	stopped.Close();
+	blocked.join();
+	EXPECT_TRUE(stopped.Pop(nItem));
+	EXPECT_EQ(nItem, 1);
+}
+
+TEST(PRINTTASK, CalculatePipeline)
+{
+	//Larger than a read-ahead block, with bad rows all along
+	string content = "Department, Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 100000; i++)
+		content += string(i % 2 == 0 ? "Sales" : "Support") + "," + (i % 7919 == 5 ? "x" : to_string(i % 97 + 3)) + "," + to_string(i % 3) + "," + (i % 4 == 0 ? "true" : "false") + "\n";
+	const char* szFileName = "pipeline_test.csv";
+	{
+		ofstream outFile(szFileName, ofstream::binary);
+		outFile << content;
+	}
+	vector<string> vstrColumns(1, "Department");
+
+	PrinterTask streamTask;
+	streamTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	streamTask.SetContinueOnError(true);
+	streamTask.SetGroupBy(vstrColumns);
+	istringstream stream(content);
+	EXPECT_TRUE(streamTask.DoCalculateStream(stream, 1000));
+
+	PrinterTask pipelineTask;
+	pipelineTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	pipelineTask.SetContinueOnError(true);
+	pipelineTask.SetGroupBy(vstrColumns);
+	EXPECT_TRUE(pipelineTask.DoCalculatePipeline(szFileName, 1000));
+	EXPECT_EQ(pipelineTask.GetTotalPriceForBlackAndWhite(), streamTask.GetTotalPriceForBlackAndWhite());
+	EXPECT_EQ(pipelineTask.GetTotalPriceForColor(), streamTask.GetTotalPriceForColor());
+	EXPECT_EQ(pipelineTask.GetTotalMilliCentsForBlackAndWhite(), streamTask.GetTotalMilliCentsForBlackAndWhite());
+	EXPECT_EQ(pipelineTask.GetExceptionLines(), streamTask.GetExceptionLines());
+	vector<PrintJobGroup> vStreamGroups, vPipelineGroups;
+	streamTask.GetGroups(vStreamGroups);
+	pipelineTask.GetGroups(vPipelineGroups);
+	ASSERT_EQ(vPipelineGroups.size(), 2u);
+	ASSERT_EQ(vStreamGroups.size(), 2u);
+	EXPECT_EQ(vPipelineGroups[1].m_nJobs, vStreamGroups[1].m_nJobs);
+	EXPECT_EQ(vPipelineGroups[1].m_nColorMilliCents, vStreamGroups[1].m_nColorMilliCents);
+
+	//Without --continue the first bad row stops both the same way
+	PrinterTask stopStreamTask;
+	stopStreamTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	istringstream stopStream(content);
+	EXPECT_FALSE(stopStreamTask.DoCalculateStream(stopStream, 1000));
+	PrinterTask stopTask;
+	stopTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	EXPECT_FALSE(stopTask.DoCalculatePipeline(szFileName, 1000));
+	ASSERT_EQ(stopTask.GetExceptionLines().size(), 1u);
+	EXPECT_EQ(stopTask.GetExceptionLines()[0], 5);
+	EXPECT_EQ(stopTask.GetTotalMilliCentsForBlackAndWhite(), stopStreamTask.GetTotalMilliCentsForBlackAndWhite());
+	std::remove(szFileName);
+
+	PrinterTask missingTask;
+	EXPECT_FALSE(missingTask.DoCalculatePipeline("no_such_pipeline_file.csv"));
+}
+
+TEST(PRINTTASK, CollectStats)
+{
+	string content = "Total Pages, Color Pages, Double Sided\n";
+	for (int i = 0; i < 10000; i++)
+		content += i % 1000 == 7 ? "x, 1, true\n" : to_string(i % 89 + 5) + "," + to_string(i % 4) + ",false\n";
+
+	FILE* pReport = tmpfile();
+	ASSERT_TRUE(pReport != NULL);
+	PrinterTask task(make_unique<CCsvDataFile>());
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::Json, pReport));
+	task.SetContinueOnError(true);
+	istringstream stream(content);
+	EXPECT_TRUE(task.DoCalculateStream(stream));
+	long nReportBytes = ftell(pReport);
+	//The writer flushes to its file until it is replaced
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	fclose(pReport);
+
+	PrinterStats stats;
+	task.GetStats(stats);
+#ifndef PRINTER_NO_STATS
+	EXPECT_EQ(10000u, stats.GetCounter(StatsCounter::Rows));
+	EXPECT_EQ(9990u, stats.GetCounter(StatsCounter::Jobs));
+	EXPECT_EQ(10u, stats.GetCounter(StatsCounter::RowErrors));
+	EXPECT_EQ(static_cast<uint64_t>(nReportBytes), stats.GetCounter(StatsCounter::ReportBytes));
+	EXPECT_GT(stats.GetPhaseSeconds(StatsPhase::Parse), 0.0);
+	EXPECT_GT(stats.GetPhaseSeconds(StatsPhase::Calculate), 0.0);
+	EXPECT_NE(string::npos, stats.ToJson().find("\"rows\":10000"));
+
+	//The blocks priced on other threads are counted in their own slots
+	unique_ptr<CCsvDataFile> ptrDataFile = make_unique<CCsvDataFile>();
+	istringstream parallelStream(content);
+	ptrDataFile->ReadFromStream(parallelStream, *ptrDataFile);
+	PrinterTask parallelTask(std::move(ptrDataFile));
+	parallelTask.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	parallelTask.SetContinueOnError(true);
+	EXPECT_TRUE(parallelTask.DoCalculateParallel(3));
+	parallelTask.GetStats(stats);
+	EXPECT_EQ(0u, stats.GetCounter(StatsCounter::Rows));
+	EXPECT_EQ(9990u, stats.GetCounter(StatsCounter::Jobs));
+	uint64_t nJobs = 0;
+	for (size_t i = 0; i < stats.m_vThreads.size(); i++)
+		nJobs += stats.m_vThreads[i].m_anCounters[static_cast<int>(StatsCounter::Jobs)];
+	EXPECT_EQ(9990u, nJobs);
+#else
+	EXPECT_EQ(0u, stats.GetCounter(StatsCounter::Rows));
+#endif
+}
+
+TEST(BATCH, RunWorkStealing)
+{
+	//Every task runs once, however long the tasks of one range are
+	std::vector<int> vnRuns(1000, 0);
+	RunWorkStealing(static_cast<int>(vnRuns.size()), 4, [&](int i)
+	{
+		if (i < 10)
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		vnRuns[i]++;
+	});
+	for (size_t i = 0; i < vnRuns.size(); i++)
+		EXPECT_EQ(1, vnRuns[i]);
+
+	EXPECT_THROW(RunWorkStealing(100, 3, [](int i) { if (i == 57) throw std::runtime_error("task"); }), std::runtime_error);
+}
+
+TEST(BATCH, PriceFiles)
+{
+	const char* aszFileNames[] = { "batch_test_1.csv", "batch_test_2.csv", "batch_test_3.csv" };
+	const char* aszContents[] = {
+		"Total Pages, Color Pages, Double Sided\n25, 10, false\n55, 13, true\n",
+		"Total Pages, Color Pages, Double Sided\n502, 22, true\n1, 0, false\n",
+		"Total Pages, Color Pages, Double Sided\n12, abc, true\n"
+	};
+	for (int i = 0; i < 3; i++)
+	{
+		ofstream outFile(aszFileNames[i], ofstream::binary);
+		outFile << aszContents[i];
+	}
+	const char* szListName = "batch_test.txt";
+	{
+		ofstream outFile(szListName, ofstream::binary);
+		outFile << aszFileNames[1] << "\r\n\n" << aszFileNames[2] << "\n";
+	}
+
+	std::vector<std::string> vstrArgs, vstrFiles;
+	vstrArgs.push_back(aszFileNames[0]);
+	vstrArgs.push_back(string("@") + szListName);
+	vstrArgs.push_back("batch_missing.csv");
+	string strError;
+	ASSERT_TRUE(CollectBatchFiles(vstrArgs, vstrFiles, strError));
+	ASSERT_EQ(4, vstrFiles.size());
+	EXPECT_EQ(aszFileNames[1], vstrFiles[1]);
+
+	std::vector<BatchFileResult> vResults;
+	RunBatch(vstrFiles, GetDefaultTariff(), false, 3, vResults);
+	ASSERT_EQ(4, vResults.size());
+	for (int i = 0; i < 2; i++)
+	{
+		PrinterTask task(aszFileNames[i]);
+		task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+		EXPECT_TRUE(task.DoCalculate());
+		EXPECT_TRUE(vResults[i].m_bDone);
+		EXPECT_EQ(aszFileNames[i], vResults[i].m_strFileName);
+		EXPECT_EQ(task.GetTotalPriceForBlackAndWhite(), vResults[i].m_fBlackAndWhite);
+		EXPECT_EQ(task.GetTotalMilliCentsForColor(), vResults[i].m_nColorMilliCents);
+	}
+	EXPECT_FALSE(vResults[2].m_bDone);
+	EXPECT_NE(string::npos, vResults[2].m_strError.find("Color Pages"));
+	EXPECT_FALSE(vResults[3].m_bDone);
+	EXPECT_FALSE(vResults[3].m_strError.empty());
+
+	for (int i = 0; i < 3; i++)
+		std::remove(aszFileNames[i]);
+	std::remove(szListName);
+	EXPECT_FALSE(CollectBatchFiles(vstrArgs, vstrFiles, strError));
+}
+
+TEST(FOLLOW, PriceAppendedRows)
+{
+	const char* szLogName = "follow_test.csv";
+	const char* szCheckpointName = "follow_test.checkpoint";
+	std::remove(szCheckpointName);
+	string strHeader = "Total Pages, Color Pages, Double Sided\n";
+	string strRows = "25, 10, false\n55, 13, true\n502, 22, true\n1, 0, false\n";
+	{
+		//The last line is not complete yet
+		ofstream outFile(szLogName, ofstream::binary);
+		outFile << strHeader << strRows.substr(0, 20);
+	}
+
+	string strError;
+	int nNewRows = 0;
+	{
+		CJobLogFollower follower(szLogName, szCheckpointName);
+		ASSERT_TRUE(follower.Open(GetDefaultTariff(), false, ReportMode::None, strError));
+		EXPECT_TRUE(follower.Update(nNewRows, strError));
+		EXPECT_EQ(1, nNewRows);
+		EXPECT_EQ(strHeader.size() + 14, follower.GetCheckpoint().m_nOffset);
+		EXPECT_TRUE(follower.Update(nNewRows, strError));
+		EXPECT_EQ(0, nNewRows);
+	}
+
+	//A new follower, as after a crash, resumes from the checkpoint
+	{
+		ofstream outFile(szLogName, ofstream::binary | ofstream::app);
+		outFile << strRows.substr(20);
+	}
+	CJobLogFollower follower(szLogName, szCheckpointName);
+	ASSERT_TRUE(follower.Open(GetDefaultTariff(), false, ReportMode::None, strError));
+	EXPECT_EQ(1, follower.GetCheckpoint().m_nRows);
+	EXPECT_TRUE(follower.Update(nNewRows, strError));
+	EXPECT_EQ(3, nNewRows);
+
+	PrinterTask task(make_unique<CCsvDataFile>());
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	istringstream stream(strHeader + strRows);
+	EXPECT_TRUE(task.DoCalculateStream(stream));
+	JobLogCheckpoint checkpoint;
+	EXPECT_TRUE(LoadCheckpoint(szCheckpointName, checkpoint, strError));
+	EXPECT_EQ(static_cast<int64_t>(strHeader.size() + strRows.size()), checkpoint.m_nOffset);
+	EXPECT_EQ(4, checkpoint.m_nRows);
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		EXPECT_EQ(task.GetTotals().m_anNoneColorPages[k], checkpoint.m_totals.m_anNoneColorPages[k]);
+		EXPECT_EQ(task.GetTotals().m_anColorPages[k], checkpoint.m_totals.m_anColorPages[k]);
+	}
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForBlackAndWhite(), checkpoint.m_totals.m_fBlackAndWhite);
+
+	//A log which was rewritten is not priced from the checkpoint
+	{
+		ofstream outFile(szLogName, ofstream::binary);
+		outFile << strHeader;
+	}
+	EXPECT_FALSE(follower.Update(nNewRows, strError));
+	std::remove(szLogName);
+	std::remove(szCheckpointName);
+}
+
+TEST(FOLLOW, PriceLogLongerThanWindow)
+{
+	const char* szLogName = "follow_window_test.csv";
+	const char* szCheckpointName = "follow_window_test.checkpoint";
+	std::remove(szCheckpointName);
+	string strHeader = "Total Pages,Color Pages,Double Sided,Note\n";
+	string strRows;
+	for (int i = 0; i < 500; i++)
+		strRows += to_string(i % 37 + 3) + "," + to_string(i % 3) + "," + (i % 2 == 0 ? "true" : "false") + ",n" + to_string(i) + "\n";
+	//A row longer than the window
+	strRows += "7,1,false,\"" + string(300, 'x') + "\n" + string(300, 'y') + "\"\n";
+	{
+		ofstream outFile(szLogName, ofstream::binary);
+		outFile << strHeader << strRows;
+	}
+
+	string strError;
+	int nNewRows = 0;
+	CJobLogFollower follower(szLogName, szCheckpointName);
+	follower.SetMaxReadBytes(100);
+	ASSERT_TRUE(follower.Open(GetDefaultTariff(), false, ReportMode::None, strError));
+	EXPECT_TRUE(follower.Update(nNewRows, strError)) << strError;
+	EXPECT_EQ(501, nNewRows);
+	EXPECT_EQ(501, follower.GetCheckpoint().m_nRows);
+	EXPECT_EQ(static_cast<int64_t>(strHeader.size() + strRows.size()), follower.GetCheckpoint().m_nOffset);
+
+	PrinterTask task(make_unique<CCsvDataFile>());
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	istringstream stream(strHeader + strRows);
+	EXPECT_TRUE(task.DoCalculateStream(stream));
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		EXPECT_EQ(task.GetTotals().m_anNoneColorPages[k], follower.GetCheckpoint().m_totals.m_anNoneColorPages[k]);
+		EXPECT_EQ(task.GetTotals().m_anColorPages[k], follower.GetCheckpoint().m_totals.m_anColorPages[k]);
+	}
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForBlackAndWhite(), follower.GetCheckpoint().m_totals.m_fBlackAndWhite);
+	EXPECT_FLOAT_EQ(task.GetTotalPriceForColor(), follower.GetCheckpoint().m_totals.m_fColor);
+	std::remove(szLogName);
+	std::remove(szCheckpointName);
+}
+
+TEST(FOLLOW, WaitForQuotedLineEnd)
+{
+	const char* szLogName = "follow_quoted_test.csv";
+	const char* szCheckpointName = "follow_quoted_test.checkpoint";
+	std::remove(szCheckpointName);
+	string strHeader = "Total Pages,Color Pages,Double Sided,Note\n";
+	string strFirst = "10,2,false,a\n5,1,true,\"line one\n";
+	string strSecond = "line two\"\n3,1,false,\"x\"\"\n\"\n";
+	{
+		//The quoted field of the second row is still being written
+		ofstream outFile(szLogName, ofstream::binary);
+		outFile << strHeader << strFirst;
+	}
+
+	string strError;
+	int nNewRows = 0;
+	CJobLogFollower follower(szLogName, szCheckpointName);
+	ASSERT_TRUE(follower.Open(GetDefaultTariff(), false, ReportMode::None, strError));
+	EXPECT_TRUE(follower.Update(nNewRows, strError));
+	EXPECT_EQ(1, nNewRows);
+	EXPECT_EQ(static_cast<int64_t>(strHeader.size() + 13), follower.GetCheckpoint().m_nOffset);
+
+	{
+		ofstream outFile(szLogName, ofstream::binary | ofstream::app);
+		outFile << strSecond;
+	}
+	EXPECT_TRUE(follower.Update(nNewRows, strError)) << strError;
+	EXPECT_EQ(2, nNewRows);
+	EXPECT_EQ(3, follower.GetCheckpoint().m_nRows);
+	EXPECT_EQ(static_cast<int64_t>(strHeader.size() + strFirst.size() + strSecond.size()), follower.GetCheckpoint().m_nOffset);
+
+	PrinterTask task(make_unique<CCsvDataFile>());
+	task.SetReportWriter(make_unique<CReportWriter>(ReportMode::None));
+	istringstream stream(strHeader + strFirst + strSecond);
+	EXPECT_TRUE(task.DoCalculateStream(stream));
+	for (int k = 0; k < JOB_TYPE_COUNT; k++)
+	{
+		EXPECT_EQ(task.GetTotals().m_anNoneColorPages[k], follower.GetCheckpoint().m_totals.m_anNoneColorPages[k]);
+		EXPECT_EQ(task.GetTotals().m_anColorPages[k], follower.GetCheckpoint().m_totals.m_anColorPages[k]);
+	}
+	std::remove(szLogName);
+	std::remove(szCheckpointName);
+}